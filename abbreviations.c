@@ -22,32 +22,174 @@
 /* $Id: abbreviations.c,v 1.8 2011/11/12 04:50:27 bediger Exp $ */
 
 #include <stdio.h>
+#include <signal.h>  /* sig_atomic_t */
+#include <stdlib.h>  /* malloc(), free() */
+#include <context.h>
 #include <hashtable.h>
 #include <small_hashtable.h>
 #include <buffer.h>
 #include <lambda_expression.h>
 #include <abbreviations.h>
 
-struct hashtable *abbr_table = NULL;
-
-void
-setup_abbreviation_table(struct hashtable *h)
+/* A complete copy of the abbreviation's definition, with any
+ * abbreviations it uses expanded as well. */
+struct lambda_expression *
+abbreviation_lookup(struct lc_context *ctx, const char *id)
 {
-	abbr_table = h;
+	struct lambda_expression *r = NULL;
+	struct abbreviation *a = lookup_key(ctx->abbr_table, id);
+	if (a) r = expand_expression(ctx, a->expression);
+	return r;
 }
 
+/* A single ABBREVIATION node standing in for the definition. */
 struct lambda_expression *
-abbreviation_lookup(const char *id)
+abbreviation_reference(struct lc_context *ctx, const char *id)
 {
 	struct lambda_expression *r = NULL;
-	void *p = lookup_key(abbr_table, id);
-	if (p) r = copy_expression(p);
+	struct abbreviation *a = lookup_key(ctx->abbr_table, id);
+	if (a) r = new_abbreviation_reference(ctx, a);
 	return r;
 }
 
+struct abbreviation *
+abbreviation_add(struct lc_context *ctx, const char *id, struct lambda_expression *exp)
+{
+	struct abbreviation *prev;
+	struct abbreviation *a = malloc(sizeof(*a));
+	struct small_hashtable *free_vars = init_small_hashtable(ctx, 16);
+	struct small_hashtable *bound_vars = init_small_hashtable(ctx, 16);
+	int i, n = 0;
+
+	find_free_vars(ctx, exp, bound_vars, free_vars);
+	tag_expression(exp, id);
+
+	a->name = id;
+	a->expression = exp;
+	a->closed = (0 == free_vars->size);
+	a->refcount = 1;
+
+	a->free_var_count = free_vars->size;
+	a->free_vars = malloc((free_vars->size + 1)*sizeof(*a->free_vars));
+	for (i = 0; i < free_vars->count; ++i)
+	{
+		struct small_hashnode *chain = free_vars->buckets[i]->next;
+		for (; chain; chain = chain->next)
+			if (chain->key)
+				a->free_vars[n++] = chain->key;
+	}
+	a->normal_form = NULL;
+	a->normal_form_eta = 0;
+
+	a->seq = ctx->next_seq++;
+	a->next = NULL;
+	a->prev = ctx->newest;
+	if (ctx->newest)
+		ctx->newest->next = a;
+	else
+		ctx->oldest = a;
+	ctx->newest = a;
+
+	free_small_hashtable(ctx, free_vars);
+	free_small_hashtable(ctx, bound_vars);
+
+	prev = insert_data(ctx->abbr_table, id, a);
+	if (prev) abbreviation_release(ctx, prev);
+
+	return a;
+}
+
+/* Does variable appear free in the abbreviation's definition? */
+int
+abbreviation_has_free(struct abbreviation *a, const char *variable)
+{
+	int i;
+	for (i = 0; i < a->free_var_count; ++i)
+		if (a->free_vars[i] == variable)
+			return 1;
+	return 0;
+}
+
+void
+abbreviation_release(struct lc_context *ctx, struct abbreviation *a)
+{
+	if (0 == --a->refcount)
+	{
+		free_expression(ctx, a->expression);
+		a->expression = NULL;
+		if (a->normal_form)
+			free_expression(ctx, a->normal_form);
+		a->normal_form = NULL;
+		a->name = NULL;
+		free(a->free_vars);
+		a->free_vars = NULL;
+		if (a->prev)
+			a->prev->next = a->next;
+		else
+			ctx->oldest = a->next;
+		if (a->next)
+			a->next->prev = a->prev;
+		else
+			ctx->newest = a->prev;
+		a->prev = a->next = NULL;
+		free(a);
+	}
+}
+
+/* Remember a normal form of the definition, computed with the
+ * current setting of eta reduction. */
+void
+abbreviation_set_normal_form(struct lc_context *ctx, struct abbreviation *a, struct lambda_expression *nf)
+{
+	if (a->normal_form)
+		free_expression(ctx, a->normal_form);
+	tag_expression(nf, a->name);
+	a->normal_form = nf;
+	a->normal_form_eta = ctx->eta_reduction;
+}
+
+/* The term that an ABBREVIATION node expands to during reduction:
+ * the normal form, if one got worked out under the same eta reduction
+ * setting as now in effect, otherwise the definition as written.
+ * Either one reduces to the same normal form.
+ */
 struct lambda_expression *
-abbreviation_add(const char *id, struct lambda_expression *exp)
+abbreviation_expansion(struct lc_context *ctx, struct abbreviation *a)
+{
+	if (a->normal_form && a->normal_form_eta == ctx->eta_reduction)
+		return a->normal_form;
+	return a->expression;
+}
+
+struct abbreviation *
+abbreviation_list(struct lc_context *ctx)
 {
-	return (struct lambda_expression *)insert_data(abbr_table, id, exp);
+	return ctx->oldest;
 }
 
+/* Sequence number the next definition will get */
+unsigned int
+abbreviation_sequence(struct lc_context *ctx)
+{
+	return ctx->next_seq;
+}
+
+/* Let go of every definition the table holds, then the table.  A
+ * definition only refers to ones made before it, so releasing one can
+ * free older, superseded definitions, but never the next one on the
+ * list. */
+void
+free_abbreviation_table(struct lc_context *ctx)
+{
+	struct abbreviation *a, *next;
+
+	for (a = ctx->oldest; a; a = next)
+	{
+		next = a->next;
+		if (lookup_key(ctx->abbr_table, a->name) == a)
+			abbreviation_release(ctx, a);
+	}
+
+	free_hashtable(ctx->abbr_table);
+	ctx->abbr_table = NULL;
+}
@@ -20,7 +20,40 @@
 */
 /* $Id: abbreviations.h,v 1.4 2011/11/12 04:50:27 bediger Exp $ */
 
-void setup_abbreviation_table(struct hashtable *h);
+/* One definition of an abbreviation.  Terms that use the abbreviation
+ * hold ABBREVIATION nodes pointing at one of these, and only get a
+ * copy of the definition when reduction reaches the node.  Redefining
+ * a name makes a new struct abbreviation: terms parsed earlier keep
+ * the old one alive through refcount, just as if they held a copy.
+ */
+struct abbreviation {
+	const char *name;
+	struct lambda_expression *expression;
+	int closed;     /* expression has no free variables */
+	int refcount;   /* ABBREVIATION nodes, plus one for the table */
 
-struct lambda_expression *abbreviation_lookup(const char *id);
-struct lambda_expression *abbreviation_add(const char *id, struct lambda_expression *exp);
+	/* Atoms of the free variables of expression, worked out once */
+	const char **free_vars;
+	int free_var_count;
+
+	/* Optional: normal form of expression, worked out once at
+	 * definition time, with eta reduction on or off as noted. */
+	struct lambda_expression *normal_form;
+	int normal_form_eta;
+
+	/* Every living struct abbreviation, in order of definition */
+	unsigned int seq;
+	struct abbreviation *prev;
+	struct abbreviation *next;
+};
+
+struct lambda_expression *abbreviation_lookup(struct lc_context *ctx, const char *id);
+struct lambda_expression *abbreviation_reference(struct lc_context *ctx, const char *id);
+struct abbreviation *abbreviation_add(struct lc_context *ctx, const char *id, struct lambda_expression *exp);
+void abbreviation_release(struct lc_context *ctx, struct abbreviation *a);
+int  abbreviation_has_free(struct abbreviation *a, const char *variable);
+void abbreviation_set_normal_form(struct lc_context *ctx, struct abbreviation *a, struct lambda_expression *nf);
+struct lambda_expression *abbreviation_expansion(struct lc_context *ctx, struct abbreviation *a);
+struct abbreviation *abbreviation_list(struct lc_context *ctx);
+unsigned int abbreviation_sequence(struct lc_context *ctx);
+void free_abbreviation_table(struct lc_context *ctx);
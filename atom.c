@@ -29,25 +29,156 @@
  */
 
 
+#include <stdio.h>   /* fprintf() */
+#include <stdlib.h>  /* malloc(), calloc(), free(), abort() */
 #include <string.h>
-#include <hashtable.h>
+#include <pthread.h>
 #include <atom.h>
 
 /* $Id: atom.c,v 1.8 2011/11/12 17:08:31 bediger Exp $ */
 
-static struct hashtable *atom_table = NULL;
+/* Every session in the process shares the one table of atoms, so
+ * threads look strings up far more often than they add them.  The
+ * table splits into ATOM_SHARDS shards by hash, each a chained hash
+ * table with a lock that only inserts take.  Lookups don't lock at
+ * all: an atom, once in a chain, never changes or goes away, and
+ * inserts and rehashes only ever store whole pointers, after the
+ * memory they point at.  A lookup that races a rehash can miss an
+ * atom that is there, but a miss always tries again under the lock,
+ * so the worst that happens is a slower lookup.
+ *
+ * Compilers without the GCC __atomic builtins get lookups that lock.
+ */
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7))
+#define LOCK_FREE_LOOKUPS 1
+#define LOAD_ACQUIRE(p)     __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#else
+#define LOAD_ACQUIRE(p)     (*(p))
+#define STORE_RELEASE(p, v) (*(p) = (v))
+#endif
+
+#define ATOM_SHARDS 64
+#define INITIAL_BUCKETS 64
+
+/* Bucket arrays a shard has grown out of stay around, because a
+ * lookup might still be reading one, until free_atom_table(). */
+struct buckets {
+	unsigned int    size;     /* a power of 2 */
+	struct buckets *retired;
+	struct atom    *bucket[1];
+};
+
+struct shard {
+	pthread_mutex_t lock;
+	struct buckets *buckets;
+	unsigned int    count;
+	char            pad[64];  /* keep shards' locks off each other's cache lines */
+};
+
+/* atoms_by_id maps the other way, from dense ID to interned string.
+ * It's a directory of fixed-size chunks, so it never moves, and a
+ * reader can't catch it part way through a realloc(). */
+#define CHUNK_BITS 12
+#define CHUNK_SIZE (1U << CHUNK_BITS)
+#define MAX_CHUNKS 16384
+
+static struct shard shards[ATOM_SHARDS];
+static const char **atoms_by_id[MAX_CHUNKS];
+static unsigned int atom_count = 0;
+
+/* Only held to hand out the next ID, and publish its string */
+static pthread_mutex_t id_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t shards_once = PTHREAD_ONCE_INIT;
+
+static unsigned int atom_hash(const char *str);
+static void setup_shards(void);
+static struct atom *find_atom(struct shard *s, const char *str, unsigned int hash, size_t len);
+static void grow_shard(struct shard *s);
+static void assign_id(struct atom *a);
 
+#define SHARD_OF(hash) (&shards[((hash) * 2654435761U) >> 26])
+
+/* The structs atom, and old and current bucket arrays, all go,
+ * leaving an empty table that Atom_new() can start filling again. */
 void
-setup_atom_table(struct hashtable *h)
+free_atom_table(void)
 {
-	atom_table = h;
+	unsigned int i, j;
+
+	for (i = 0; i < MAX_CHUNKS && atoms_by_id[i]; ++i)
+	{
+		free(atoms_by_id[i]);
+		atoms_by_id[i] = NULL;
+	}
+	atom_count = 0;
+
+	for (i = 0; i < ATOM_SHARDS; ++i)
+	{
+		struct buckets *b = shards[i].buckets;
+
+		/* Every atom is on exactly one chain of the current array */
+		for (j = 0; b && j < b->size; ++j)
+		{
+			struct atom *a = b->bucket[j];
+
+			while (a)
+			{
+				struct atom *next = a->next;
+				free(a);
+				a = next;
+			}
+		}
+
+		while (b)
+		{
+			struct buckets *next = b->retired;
+			free(b);
+			b = next;
+		}
+		shards[i].buckets = NULL;
+		shards[i].count = 0;
+	}
 }
 
 const char *
 Atom_new(const char *str)
 {
-	int len = 0;
-	return string_lookup(atom_table, str, &len);
+	unsigned int hash = atom_hash(str);
+	size_t len = strlen(str);
+	struct shard *s = SHARD_OF(hash);
+	struct atom *a;
+
+#ifdef LOCK_FREE_LOOKUPS
+	if ((a = find_atom(s, str, hash, len)))
+		return a->string;
+#endif
+
+	pthread_once(&shards_once, setup_shards);
+	pthread_mutex_lock(&s->lock);
+
+	if (!(a = find_atom(s, str, hash, len)))
+	{
+		struct atom **chain;
+
+		a = malloc(sizeof(*a) + len);
+		a->hash = hash;
+		a->length = len;
+		memcpy(a->string, str, len + 1);
+		assign_id(a);
+
+		if (!s->buckets || s->count >= 2*s->buckets->size)
+			grow_shard(s);
+
+		chain = &s->buckets->bucket[hash & (s->buckets->size - 1)];
+		a->next = *chain;
+		STORE_RELEASE(chain, a);
+		++s->count;
+	}
+
+	pthread_mutex_unlock(&s->lock);
+
+	return a->string;
 }
 
 const char *
@@ -55,3 +186,135 @@ Atom_string(const char *str)
 {
 	return Atom_new(str);
 }
+
+const char *
+Atom_from_id(unsigned int id)
+{
+	const char *r = NULL;
+
+#ifndef LOCK_FREE_LOOKUPS
+	pthread_mutex_lock(&id_lock);
+#endif
+	if (id < LOAD_ACQUIRE(&atom_count))
+		r = atoms_by_id[id >> CHUNK_BITS][id & (CHUNK_SIZE - 1)];
+#ifndef LOCK_FREE_LOOKUPS
+	pthread_mutex_unlock(&id_lock);
+#endif
+
+	return r;
+}
+
+unsigned int
+Atom_count(void)
+{
+	unsigned int r;
+
+#ifndef LOCK_FREE_LOOKUPS
+	pthread_mutex_lock(&id_lock);
+#endif
+	r = LOAD_ACQUIRE(&atom_count);
+#ifndef LOCK_FREE_LOOKUPS
+	pthread_mutex_unlock(&id_lock);
+#endif
+
+	return r;
+}
+
+static void
+setup_shards(void)
+{
+	int i;
+
+	for (i = 0; i < ATOM_SHARDS; ++i)
+		pthread_mutex_init(&shards[i].lock, NULL);
+}
+
+static struct atom *
+find_atom(struct shard *s, const char *str, unsigned int hash, size_t len)
+{
+	struct buckets *b = LOAD_ACQUIRE(&s->buckets);
+	struct atom *a;
+
+	if (!b)
+		return NULL;
+
+	for (a = LOAD_ACQUIRE(&b->bucket[hash & (b->size - 1)]); a; a = LOAD_ACQUIRE(&a->next))
+		if (a->hash == hash && (size_t)a->length == len && !memcmp(a->string, str, len))
+			return a;
+
+	return NULL;
+}
+
+/* Called with the shard locked.  Atoms move to the new array one at
+ * a time, each from the head of its old chain, so every chain a
+ * lookup might be on stays a proper, NULL-terminated list. */
+static void
+grow_shard(struct shard *s)
+{
+	struct buckets *old = s->buckets;
+	unsigned int size = old? 2*old->size: INITIAL_BUCKETS;
+	struct buckets *b = calloc(1, sizeof(*b) + (size - 1)*sizeof(b->bucket[0]));
+	unsigned int i;
+
+	b->size = size;
+	b->retired = old;
+
+	if (old)
+	{
+		for (i = 0; i < old->size; ++i)
+		{
+			struct atom *a;
+
+			while ((a = old->bucket[i]))
+			{
+				struct atom **chain = &b->bucket[a->hash & (size - 1)];
+
+				STORE_RELEASE(&old->bucket[i], a->next);
+				STORE_RELEASE(&a->next, *chain);
+				*chain = a;
+			}
+		}
+	}
+
+	STORE_RELEASE(&s->buckets, b);
+}
+
+/* IDs go out in order, and Atom_count() only counts an ID once its
+ * string is in atoms_by_id, so 0 up to Atom_count() never has holes. */
+static void
+assign_id(struct atom *a)
+{
+	unsigned int id;
+
+	pthread_mutex_lock(&id_lock);
+
+	id = atom_count;
+	if ((id >> CHUNK_BITS) >= MAX_CHUNKS)
+	{
+		fprintf(stderr, "Too many distinct identifiers\n");
+		abort();
+	}
+	if (!atoms_by_id[id >> CHUNK_BITS])
+		atoms_by_id[id >> CHUNK_BITS] = malloc(CHUNK_SIZE*sizeof(**atoms_by_id));
+
+	a->id = id;
+	atoms_by_id[id >> CHUNK_BITS][id & (CHUNK_SIZE - 1)] = a->string;
+	STORE_RELEASE(&atom_count, id + 1);
+
+	pthread_mutex_unlock(&id_lock);
+}
+
+/* djb2 hash function, xor variant.  It's the one struct small_hashtable
+ * always used, so variables come out of those tables in the same order
+ * they always have. */
+static unsigned int
+atom_hash(const char *str)
+{
+	unsigned long hv = 5381;
+	unsigned int c;
+
+	while ((c = (unsigned char)*str++))
+		hv = (hv * 33) ^ c;
+
+	return hv;
+}
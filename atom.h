@@ -20,6 +20,33 @@
 */
 /* $Id: atom.h,v 1.6 2011/11/12 17:08:31 bediger Exp $ */
 
-void        setup_atom_table(struct hashtable *h);
-const char *Atom_new(const char *str);
-const char *Atom_string(const char *str);
+#include <stddef.h>  /* offsetof() */
+
+/* Every interned string lives at the end of one of these.  The
+ * "const char *" that Atom_string() hands out points at the string
+ * member, so consumers that only want pointer-identity never notice,
+ * but the hash value, length and a dense ID come along for free.
+ * IDs run 0, 1, 2, ... in order of interning, so they can index
+ * arrays and bitsets.
+ */
+struct atom {
+	struct atom *next;    /* atom.c's hash chain */
+	unsigned int id;
+	unsigned int hash;
+	int          length;
+	char         string[1];
+};
+
+#define ATOM_HEADER(a) \
+	((const struct atom *)((const char *)(a) - offsetof(struct atom, string)))
+
+/* Only valid on strings returned by Atom_new()/Atom_string() */
+#define Atom_id(a)     (ATOM_HEADER(a)->id)
+#define Atom_hash(a)   (ATOM_HEADER(a)->hash)
+#define Atom_length(a) (ATOM_HEADER(a)->length)
+
+void         free_atom_table(void);
+const char  *Atom_new(const char *str);
+const char  *Atom_string(const char *str);
+const char  *Atom_from_id(unsigned int id);
+unsigned int Atom_count(void);
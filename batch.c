@@ -0,0 +1,559 @@
+/*
+	Copyright (C) 2006-2011, Bruce Ediger
+
+    This file is part of lc.
+
+    lc is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    lc is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with lc; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/*
+ * Batch mode.  The parent process reads a line at a time, and hands
+ * each line to an idle worker process.  Workers get forked after
+ * -L files and images have loaded, so they share the atom and
+ * abbreviation tables copy-on-write.  A worker runs its line through
+ * the ordinary parser with stdout and stderr going to temporary
+ * files, then ships both back.  The parent prints them in input
+ * order, whatever order the workers finish in.
+ *
+ * Lines that change interpreter state ("define", "load", "eta" and
+ * so forth) run in the parent once all earlier lines have finished.
+ * Workers get re-forked after that, so they see the change.
+ *
+ * A worker that dies, or that runs well past the reduction timeout,
+ * costs only the line it was working on: the parent reports that
+ * line as failed and forks a replacement.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>     /* malloc(), free(), realloc() */
+#include <string.h>     /* strncmp(), memcpy() */
+#include <errno.h>
+#include <signal.h>     /* signal(), kill() */
+#include <time.h>       /* time() */
+#include <unistd.h>     /* fork(), pipe(), read(), write(), pread() */
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>   /* waitpid() */
+
+#include <context.h>
+#include <buffer.h>
+#include <small_hashtable.h>
+#include <lambda_expression.h>
+#include <writer.h>
+#include <batch.h>
+
+/* these live in grammar.y */
+extern int interpret_line(struct lc_context *ctx, const char *line, int length, int lineno);
+
+/* With a reduction timeout set, a worker gets this many more seconds
+ * to report back before the parent decides it has hung. */
+#define WATCHDOG_GRACE 5
+
+/* Finished output of at most this many lines per worker can wait
+ * behind a slow line before the parent stops reading input. */
+#define WINDOW_PER_WORKER 16
+
+struct worker {
+	pid_t pid;      /* 0 when not running */
+	int job_fd;     /* parent writes lines here */
+	int result_fd;  /* and reads output from here */
+	long job;       /* -1 when idle */
+	time_t started;
+};
+
+struct job {
+	int done;
+	int lineno;
+	char *out;
+	char *err;
+	unsigned long out_length;
+	unsigned long err_length;
+};
+
+/* Keywords that start statements run in the parent, not in workers */
+static const char *state_changing[] = {
+	"def", "define", "load", "save", "eta", "prenormalize",
+	"timer", "trace", "step", "profile", "checkpoint", "resume",
+	"divergence", "typed", NULL
+};
+
+static int  write_all(int fd, const void *buf, unsigned long length);
+static int  read_all(int fd, void *buf, unsigned long length);
+static char *read_line(FILE *in, int *length);
+static int  blank_line(const char *line);
+static int  changes_state(const char *line);
+static int  start_worker(struct lc_context *ctx, struct worker *w, struct worker *all, int count);
+static void stop_worker(struct worker *w);
+static void worker_loop(struct lc_context *ctx, int job_fd, int result_fd);
+static int  copy_capture(int fd, unsigned long length, int to);
+static void fail_job(struct worker *w, struct job *j, const char *why);
+static int  collect_results(struct lc_context *ctx, struct worker *workers, int count,
+	struct job *jobs, int window, struct pollfd *fds);
+static void flush_jobs(struct job *jobs, int window, long *next_output, long next_job);
+
+int
+run_batch(struct lc_context *ctx, FILE *in, int worker_count)
+{
+	struct worker *workers = malloc(worker_count*sizeof(*workers));
+	int window = WINDOW_PER_WORKER*worker_count;
+	struct job *jobs = malloc(window*sizeof(*jobs));
+	struct pollfd *fds = malloc(worker_count*sizeof(*fds));
+	long next_job = 0, next_output = 0;
+	int outstanding = 0, eof = 0, lineno = 0, i;
+	char *barrier = NULL;
+	int barrier_length = 0;
+	int barrier_lineno = 0;
+	void (*old_sigpipe_handler)(int) = signal(SIGPIPE, SIG_IGN);
+
+	for (i = 0; i < worker_count; ++i)
+	{
+		workers[i].pid = 0;
+		workers[i].job = -1;
+	}
+
+	while (!eof || outstanding > 0 || barrier)
+	{
+		flush_jobs(jobs, window, &next_output, next_job);
+
+		if (barrier && 0 == outstanding)
+		{
+			/* Every earlier line has finished: change state here,
+			 * and fork workers that can see the change. */
+			for (i = 0; i < worker_count; ++i)
+				stop_worker(&workers[i]);
+			(void)interpret_line(ctx, barrier, barrier_length, barrier_lineno);
+			fflush(stdout);
+			free(barrier);
+			barrier = NULL;
+			continue;
+		}
+
+		while (!eof && !barrier && next_job - next_output < window)
+		{
+			struct worker *w = NULL;
+			struct job *j;
+			char *line;
+			int length;
+			unsigned int header[2];
+
+			for (i = 0; i < worker_count && !w; ++i)
+				if (-1 == workers[i].job)
+					w = &workers[i];
+			if (!w)
+				break;
+
+			if (NULL == (line = read_line(in, &length)))
+			{
+				eof = 1;
+				break;
+			}
+			++lineno;
+
+			if (blank_line(line))
+			{
+				free(line);
+				continue;
+			}
+			if (changes_state(line))
+			{
+				barrier = line;
+				barrier_length = length;
+				barrier_lineno = lineno;
+				break;
+			}
+
+			j = &jobs[next_job % window];
+			j->done = 0;
+			j->lineno = lineno;
+			j->out = j->err = NULL;
+			j->out_length = j->err_length = 0;
+			w->job = next_job++;
+			w->started = time(NULL);
+			++outstanding;
+
+			header[0] = length;
+			header[1] = lineno;
+			if (!(w->pid || start_worker(ctx, w, workers, worker_count))
+				|| !write_all(w->job_fd, header, sizeof(header))
+				|| !write_all(w->job_fd, line, length))
+			{
+				fail_job(w, j, "could not hand line to worker process");
+				--outstanding;
+			}
+
+			free(line);
+		}
+
+		if (outstanding > 0)
+			outstanding -= collect_results(ctx, workers, worker_count, jobs, window, fds);
+	}
+
+	flush_jobs(jobs, window, &next_output, next_job);
+
+	for (i = 0; i < worker_count; ++i)
+		stop_worker(&workers[i]);
+
+	signal(SIGPIPE, old_sigpipe_handler);
+
+	free(fds);
+	free(jobs);
+	free(workers);
+
+	return 0;
+}
+
+static int
+write_all(int fd, const void *buf, unsigned long length)
+{
+	const char *p = buf;
+	while (length > 0)
+	{
+		ssize_t n = write(fd, p, length);
+		if (n < 0 && EINTR == errno)
+			continue;
+		if (n <= 0)
+			return 0;
+		p += n;
+		length -= n;
+	}
+	return 1;
+}
+
+static int
+read_all(int fd, void *buf, unsigned long length)
+{
+	char *p = buf;
+	while (length > 0)
+	{
+		ssize_t n = read(fd, p, length);
+		if (n < 0 && EINTR == errno)
+			continue;
+		if (n <= 0)
+			return 0;
+		p += n;
+		length -= n;
+	}
+	return 1;
+}
+
+/* A malloc'ed line of input, always ending in a newline,
+ * since the grammar wants a TK_EOL to end a statement. */
+static char *
+read_line(FILE *in, int *length)
+{
+	struct buffer *b = new_buffer(256);
+	char chunk[4096];
+	char *r = NULL;
+
+	while (fgets(chunk, sizeof(chunk), in))
+	{
+		int n = strlen(chunk);
+		buffer_append(b, chunk, n);
+		if ('\n' == chunk[n - 1])
+			break;
+	}
+
+	if (b->offset > 0)
+	{
+		if ('\n' != b->buffer[b->offset - 1])
+			buffer_append(b, "\n", 1);
+		*length = b->offset;
+		r = malloc(b->offset + 1);
+		memcpy(r, b->buffer, b->offset + 1);
+	}
+
+	delete_buffer(b);
+
+	return r;
+}
+
+/* Nothing but whitespace or a comment */
+static int
+blank_line(const char *line)
+{
+	while (' ' == *line || '\t' == *line || '\r' == *line)
+		++line;
+	return '\n' == *line || '#' == *line;
+}
+
+static int
+changes_state(const char *line)
+{
+	int i, n;
+
+	while (' ' == *line || '\t' == *line)
+		++line;
+
+	for (n = 0; ('a' <= line[n] && line[n] <= 'z'); ++n)
+		;
+
+	for (i = 0; state_changing[i]; ++i)
+		if ((int)strlen(state_changing[i]) == n
+			&& !strncmp(line, state_changing[i], n))
+			return 1;
+
+	return 0;
+}
+
+static int
+start_worker(struct lc_context *ctx, struct worker *w, struct worker *all, int count)
+{
+	int jobs[2], results[2], i;
+	pid_t pid;
+
+	if (pipe(jobs) < 0)
+	{
+		fprintf(stderr, "Problem creating pipe: %s\n", strerror(errno));
+		return 0;
+	}
+	if (pipe(results) < 0)
+	{
+		fprintf(stderr, "Problem creating pipe: %s\n", strerror(errno));
+		close(jobs[0]);
+		close(jobs[1]);
+		return 0;
+	}
+
+	/* Don't let a child inherit half-written output */
+	fflush(stdout);
+	fflush(stderr);
+
+	if (0 == (pid = fork()))
+	{
+		/* Other workers only see end-of-file on their
+		 * pipes when nobody else holds the write end. */
+		for (i = 0; i < count; ++i)
+			if (all[i].pid)
+			{
+				close(all[i].job_fd);
+				close(all[i].result_fd);
+			}
+		close(jobs[1]);
+		close(results[0]);
+		worker_loop(ctx, jobs[0], results[1]);
+	}
+
+	close(jobs[0]);
+	close(results[1]);
+
+	if (pid < 0)
+	{
+		fprintf(stderr, "Problem forking worker: %s\n", strerror(errno));
+		close(jobs[1]);
+		close(results[0]);
+		return 0;
+	}
+
+	w->pid = pid;
+	w->job_fd = jobs[1];
+	w->result_fd = results[0];
+
+	return 1;
+}
+
+static void
+stop_worker(struct worker *w)
+{
+	if (w->pid)
+	{
+		/* An idle worker exits when it reads end-of-file */
+		close(w->job_fd);
+		close(w->result_fd);
+		if (-1 != w->job)
+			kill(w->pid, SIGKILL);
+		waitpid(w->pid, NULL, 0);
+		w->pid = 0;
+	}
+	w->job = -1;
+}
+
+/* Runs in the forked child. Each line comes in as two unsigned ints,
+ * its length and its line number, and the text; output goes back as two unsigned longs,
+ * lengths of stdout and stderr output, then the output itself. */
+static void
+worker_loop(struct lc_context *ctx, int job_fd, int result_fd)
+{
+	struct lambda_expression *inherited = ctx->previous_result;
+	FILE *out = tmpfile();
+	FILE *err = tmpfile();
+	char *line = NULL;
+
+	if (!out || !err || dup2(fileno(out), 1) < 0 || dup2(fileno(err), 2) < 0)
+		_exit(2);
+
+	/* Every line sees the $$ that was current at fork time,
+	 * not whatever the line before it on this worker left. */
+	ctx->previous_result = NULL;
+
+	for (;;)
+	{
+		unsigned int header[2];
+		unsigned long lengths[2];
+
+		if (!read_all(job_fd, header, sizeof(header)))
+			break;
+		line = realloc(line, header[0]);
+		if (!read_all(job_fd, line, header[0]))
+			break;
+
+		if (ctx->previous_result)
+			free_expression(ctx, ctx->previous_result);
+		ctx->previous_result = inherited? copy_expression(ctx, inherited): NULL;
+
+		(void)interpret_line(ctx, line, header[0], header[1]);
+		writer_finish(ctx);
+
+		fflush(stdout);
+		fflush(stderr);
+		lengths[0] = lseek(1, 0, SEEK_CUR);
+		lengths[1] = lseek(2, 0, SEEK_CUR);
+
+		if (!write_all(result_fd, lengths, sizeof(lengths))
+			|| !copy_capture(1, lengths[0], result_fd)
+			|| !copy_capture(2, lengths[1], result_fd))
+			break;
+
+		if (ftruncate(1, 0) < 0 || ftruncate(2, 0) < 0)
+			break;
+		lseek(1, 0, SEEK_SET);
+		lseek(2, 0, SEEK_SET);
+	}
+
+	/* Freeing the tables would only dirty copy-on-write pages */
+	_exit(0);
+}
+
+static int
+copy_capture(int fd, unsigned long length, int to)
+{
+	char chunk[8192];
+	unsigned long offset = 0;
+
+	while (offset < length)
+	{
+		ssize_t n = pread(fd, chunk, sizeof(chunk), offset);
+		if (n <= 0 || !write_all(to, chunk, n))
+			return 0;
+		offset += n;
+	}
+	return 1;
+}
+
+/* Mark a worker's line as finished without output from the worker,
+ * and get rid of the worker, which will get replaced when needed. */
+static void
+fail_job(struct worker *w, struct job *j, const char *why)
+{
+	char message[128];
+
+	sprintf(message, "Line %d: %.80s\n", j->lineno, why);
+	j->err_length = strlen(message);
+	j->err = malloc(j->err_length + 1);
+	strcpy(j->err, message);
+	j->done = 1;
+
+	stop_worker(w);
+}
+
+/* Wait for at least one busy worker to report back, or die,
+ * and collect output.  Returns how many lines finished. */
+static int
+collect_results(struct lc_context *ctx, struct worker *workers, int count,
+	struct job *jobs, int window, struct pollfd *fds)
+{
+	int i, n = 0, finished = 0;
+	int wait_ms = ctx->reduction_timeout > 0? 1000: -1;
+
+	for (i = 0; i < count; ++i)
+	{
+		if (-1 == workers[i].job)
+			continue;
+		fds[n].fd = workers[i].result_fd;
+		fds[n].events = POLLIN;
+		fds[n].revents = 0;
+		++n;
+	}
+
+	if (poll(fds, n, wait_ms) < 0 && EINTR != errno)
+	{
+		fprintf(stderr, "Problem waiting on workers: %s\n", strerror(errno));
+		return 0;
+	}
+
+	for (i = 0, n = 0; i < count; ++i)
+	{
+		struct worker *w = &workers[i];
+		struct job *j;
+		unsigned long lengths[2];
+
+		if (-1 == w->job)
+			continue;
+
+		j = &jobs[w->job % window];
+
+		if (fds[n++].revents)
+		{
+			if (read_all(w->result_fd, lengths, sizeof(lengths)))
+			{
+				j->out = malloc(lengths[0] + 1);
+				j->err = malloc(lengths[1] + 1);
+				if (read_all(w->result_fd, j->out, lengths[0])
+					&& read_all(w->result_fd, j->err, lengths[1]))
+				{
+					j->out_length = lengths[0];
+					j->err_length = lengths[1];
+					j->done = 1;
+					w->job = -1;
+					++finished;
+					continue;
+				}
+				free(j->out);
+				free(j->err);
+				j->out = j->err = NULL;
+			}
+			fail_job(w, j, "worker process died");
+			++finished;
+		} else if (ctx->reduction_timeout > 0
+			&& time(NULL) - w->started > ctx->reduction_timeout + WATCHDOG_GRACE) {
+			fail_job(w, j, "no result in time, worker process killed");
+			++finished;
+		}
+	}
+
+	return finished;
+}
+
+/* Print output of finished lines, in input order, up to the
+ * first line that hasn't finished. */
+static void
+flush_jobs(struct job *jobs, int window, long *next_output, long next_job)
+{
+	while (*next_output < next_job && jobs[*next_output % window].done)
+	{
+		struct job *j = &jobs[*next_output % window];
+
+		fwrite(j->out, 1, j->out_length, stdout);
+		fflush(stdout);
+		fwrite(j->err, 1, j->err_length, stderr);
+
+		free(j->out);
+		free(j->err);
+		j->out = j->err = NULL;
+		j->done = 0;
+
+		++*next_output;
+	}
+}
@@ -0,0 +1,538 @@
+/*
+	Copyright (C) 2006-2011, Bruce Ediger
+
+    This file is part of lc.
+
+    lc is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    lc is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with lc; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/*
+ * Microbenchmarks for lc's core data structures: atoms, both kinds
+ * of hashtable, node allocation, and the walks over terms that
+ * reduction leans on.  Every input comes from a fixed seed, so two
+ * builds time exactly the same work.  Each benchmark runs REPEATS
+ * times, and the fastest run counts: slower runs only measure
+ * interference from the rest of the machine.
+ *
+ * Output is one line of key=value pairs per benchmark, like bench/run:
+ *
+ *   bench=copy_expression shape=balanced nodes=10001 ops=200 ns_per_op=171234.5
+ *
+ * The threaded atom benchmark reports wall-clock time over every
+ * thread's operations, so ns_per_op falls as throughput scales.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>       /* clock_gettime() */
+#include <signal.h>     /* sig_atomic_t */
+#include <pthread.h>
+
+#include <context.h>
+#include <hashtable.h>
+#include <atom.h>
+#include <small_hashtable.h>
+#include <buffer.h>
+#include <lambda_expression.h>
+
+#define REPEATS 5
+#define KEY_COUNT 100000
+#define POOL_SIZE 16
+#define THREAD_OPS 200000
+#define NEW_PERCENT 10   /* share of threaded interning that adds atoms */
+
+/* Nodes and small hashtables come out of one session's free lists */
+static struct lc_context *ctx;
+
+enum shape { BALANCED, SPINE, DEEP };
+static const char *shape_names[] = { "balanced", "spine", "deep" };
+
+static unsigned long long rng_state = 0x2545F4914F6CDD1DULL;
+static const char *free_pool[POOL_SIZE];
+static const char *bound_pool[POOL_SIZE];
+static const char **keys;        /* KEY_COUNT interned strings */
+
+static unsigned int random_below(unsigned int n);
+static double now_ns(void);
+static void report(const char *bench, const char *shape, long nodes, long ops, double best_ns);
+static struct lambda_expression *make_term(enum shape shape, long nodes);
+static struct lambda_expression *balanced_term(long nodes, int depth);
+static long count_nodes(struct lambda_expression *e);
+
+static void bench_atoms(void);
+static void bench_atoms_threaded(int thread_count);
+static void *intern_worker(void *arg);
+static void bench_hashtable(void);
+static void bench_small_hashtable(void);
+static void bench_nodes(void);
+static void bench_terms(enum shape shape, long nodes, long ops);
+
+int
+main(int ac, char **av)
+{
+	int i;
+	char name[32];
+
+	(void)ac; (void)av;
+
+	ctx = new_context();
+
+	for (i = 0; i < POOL_SIZE; ++i)
+	{
+		sprintf(name, "v%d", i);
+		free_pool[i] = Atom_string(name);
+		sprintf(name, "x%d", i);
+		bound_pool[i] = Atom_string(name);
+	}
+
+	bench_atoms();
+	for (i = 1; i <= 8; i *= 2)
+		bench_atoms_threaded(i);
+	bench_hashtable();
+	bench_small_hashtable();
+	bench_nodes();
+
+	for (i = BALANCED; i <= DEEP; ++i)
+	{
+		bench_terms(i, 100, 20000);
+		bench_terms(i, 10000, 20);
+	}
+
+	free(keys);
+	free_context(ctx);
+	free_atom_table();
+
+	return 0;
+}
+
+/* Atom_string() on strings it hasn't seen, then on ones it has */
+static void
+bench_atoms(void)
+{
+	double best_new = 0.0, best_lookup = 0.0;
+	char **strings = malloc(KEY_COUNT*sizeof(*strings));
+	char buf[64];
+	int rep, i;
+
+	keys = malloc(KEY_COUNT*sizeof(*keys));
+
+	for (rep = 0; rep < REPEATS; ++rep)
+	{
+		double start;
+
+		/* Fresh strings every time, so that every call interns */
+		for (i = 0; i < KEY_COUNT; ++i)
+		{
+			sprintf(buf, "k%d_%u", rep, random_below(1000000000));
+			strings[i] = strdup(buf);
+		}
+
+		start = now_ns();
+		for (i = 0; i < KEY_COUNT; ++i)
+			keys[i] = Atom_string(strings[i]);
+		start = now_ns() - start;
+		if (0 == rep || start < best_new) best_new = start;
+
+		start = now_ns();
+		for (i = 0; i < KEY_COUNT; ++i)
+			(void)Atom_string(strings[i]);
+		start = now_ns() - start;
+		if (0 == rep || start < best_lookup) best_lookup = start;
+
+		for (i = 0; i < KEY_COUNT; ++i)
+			free(strings[i]);
+	}
+
+	free(strings);
+
+	report("atom_intern", NULL, 0, KEY_COUNT, best_new);
+	report("atom_lookup", NULL, 0, KEY_COUNT, best_lookup);
+}
+
+/* One thread's share of bench_atoms_threaded(): strings already
+ * interned, with NEW_PERCENT of them swapped for strings nobody has
+ * interned yet. */
+struct intern_work {
+	const char **strings;
+	char **fresh;
+	pthread_t thread;
+};
+
+/* Atom_string() from several threads at once, mostly on strings
+ * that are already atoms, as sessions parsing input would */
+static void
+bench_atoms_threaded(int thread_count)
+{
+	struct intern_work *work = malloc(thread_count*sizeof(*work));
+	double best = 0.0;
+	char buf[64];
+	int rep, t, i;
+
+	for (rep = 0; rep < REPEATS; ++rep)
+	{
+		double start;
+
+		for (t = 0; t < thread_count; ++t)
+		{
+			work[t].strings = malloc(THREAD_OPS*sizeof(*work[t].strings));
+			work[t].fresh = malloc(THREAD_OPS*sizeof(*work[t].fresh));
+			for (i = 0; i < THREAD_OPS; ++i)
+			{
+				work[t].fresh[i] = NULL;
+				if (random_below(100) < NEW_PERCENT)
+				{
+					sprintf(buf, "t%d_%d_%d_%d", thread_count, rep, t, i);
+					work[t].fresh[i] = strdup(buf);
+					work[t].strings[i] = work[t].fresh[i];
+				} else
+					work[t].strings[i] = keys[random_below(KEY_COUNT)];
+			}
+		}
+
+		start = now_ns();
+		for (t = 0; t < thread_count; ++t)
+			pthread_create(&work[t].thread, NULL, intern_worker, &work[t]);
+		for (t = 0; t < thread_count; ++t)
+			pthread_join(work[t].thread, NULL);
+		start = now_ns() - start;
+		if (0 == rep || start < best) best = start;
+
+		for (t = 0; t < thread_count; ++t)
+		{
+			for (i = 0; i < THREAD_OPS; ++i)
+				free(work[t].fresh[i]);
+			free(work[t].fresh);
+			free(work[t].strings);
+		}
+	}
+
+	free(work);
+
+	printf("bench=atom_intern_threaded threads=%d ops=%ld ns_per_op=%.1f\n",
+		thread_count, (long)thread_count*THREAD_OPS, best/((double)thread_count*THREAD_OPS));
+}
+
+static void *
+intern_worker(void *arg)
+{
+	struct intern_work *w = arg;
+	int i;
+
+	for (i = 0; i < THREAD_OPS; ++i)
+		(void)Atom_string(w->strings[i]);
+
+	return NULL;
+}
+
+/* insert_data() and lookup_key() on a table that grows to KEY_COUNT */
+static void
+bench_hashtable(void)
+{
+	double best_insert = 0.0, best_lookup = 0.0;
+	int rep, i;
+
+	for (rep = 0; rep < REPEATS; ++rep)
+	{
+		struct hashtable *h = new_hashtable(NULL);
+		double start;
+		long found = 0;
+
+		start = now_ns();
+		for (i = 0; i < KEY_COUNT; ++i)
+			(void)insert_data(h, keys[i], &keys[i]);
+		start = now_ns() - start;
+		if (0 == rep || start < best_insert) best_insert = start;
+
+		start = now_ns();
+		for (i = 0; i < KEY_COUNT; ++i)
+			if (lookup_key(h, keys[(i*7919) % KEY_COUNT])) ++found;
+		start = now_ns() - start;
+		if (0 == rep || start < best_lookup) best_lookup = start;
+
+		if (found != KEY_COUNT)
+			fprintf(stderr, "hashtable lost keys: %ld of %d found\n", found, KEY_COUNT);
+
+		free_hashtable(h);
+	}
+
+	report("hashtable_insert", NULL, 0, KEY_COUNT, best_insert);
+	report("hashtable_lookup", NULL, 0, KEY_COUNT, best_lookup);
+}
+
+/* The life cycle of a small hashtable in find_free_vars(): create,
+ * fill with a few variables, look them up, take them out, free. */
+static void
+bench_small_hashtable(void)
+{
+	double best[4];
+	const char *names[] = { "small_init_free", "small_insert", "small_find", "small_remove" };
+	long ops = 20000;
+	int rep, i, j;
+
+	for (rep = 0; rep < REPEATS; ++rep)
+	{
+		double t[6];
+		double start;
+
+		t[0] = t[1] = t[2] = t[3] = 0.0;
+
+		for (i = 0; i < ops; ++i)
+		{
+			struct small_hashtable *h;
+
+			start = now_ns();
+			h = init_small_hashtable(ctx, 16);
+			t[0] += now_ns() - start;
+
+			start = now_ns();
+			for (j = 0; j < POOL_SIZE; ++j)
+				(void)insert_value(ctx, h, bound_pool[j], free_pool[j]);
+			t[1] += now_ns() - start;
+
+			start = now_ns();
+			for (j = 0; j < POOL_SIZE; ++j)
+				(void)find_node(h, bound_pool[(j*5) % POOL_SIZE]);
+			t[2] += now_ns() - start;
+
+			start = now_ns();
+			for (j = 0; j < POOL_SIZE; ++j)
+				(void)remove_key(ctx, h, bound_pool[j]);
+			t[3] += now_ns() - start;
+
+			start = now_ns();
+			free_small_hashtable(ctx, h);
+			t[0] += now_ns() - start;
+		}
+
+		for (j = 0; j < 4; ++j)
+			if (0 == rep || t[j] < best[j]) best[j] = t[j];
+	}
+
+	/* clock_gettime() calls cost about as much as small table
+	 * operations: time POOL_SIZE of them together. */
+	report(names[0], NULL, 0, ops, best[0]);
+	for (j = 1; j < 4; ++j)
+		report(names[j], NULL, 0, ops*POOL_SIZE, best[j]);
+}
+
+/* new_node() and free_expression() through the free list */
+static void
+bench_nodes(void)
+{
+	double best = 0.0;
+	long nodes = 100000;
+	int rep;
+
+	for (rep = 0; rep < REPEATS; ++rep)
+	{
+		struct lambda_expression *e;
+		double start = now_ns();
+		long i;
+
+		e = new_variable(ctx, free_pool[0]);
+		for (i = 1; i < nodes; i += 2)
+			e = new_application(ctx, e, new_variable(ctx, free_pool[i % POOL_SIZE]));
+		free_expression(ctx, e);
+
+		start = now_ns() - start;
+		if (0 == rep || start < best) best = start;
+	}
+
+	report("node_alloc_free", NULL, 0, nodes, best);
+}
+
+/* The walks over whole terms, on one term of a given shape and size */
+static void
+bench_terms(enum shape shape, long size, long ops)
+{
+	struct lambda_expression *term = make_term(shape, size);
+	struct lambda_expression *copy = copy_expression(ctx, term);
+	struct lambda_expression *encoded = goedelize(ctx, term);
+	long nodes = count_nodes(term);
+	double best[6];
+	const char *names[] = { "copy_expression", "find_free_vars",
+		"alpha_equivalent_graphs", "buffer_expression",
+		"goedelize", "ungodelize" };
+	int rep, j;
+	long i;
+
+	for (rep = 0; rep < REPEATS; ++rep)
+	{
+		double t[6];
+		double start;
+		struct buffer *b = new_buffer(256);
+
+		start = now_ns();
+		for (i = 0; i < ops; ++i)
+			free_expression(ctx, copy_expression(ctx, term));
+		t[0] = now_ns() - start;
+
+		start = now_ns();
+		for (i = 0; i < ops; ++i)
+		{
+			struct small_hashtable *bound = init_small_hashtable(ctx, 16);
+			struct small_hashtable *free_vars = init_small_hashtable(ctx, 16);
+			find_free_vars(ctx, term, bound, free_vars);
+			free_small_hashtable(ctx, free_vars);
+			free_small_hashtable(ctx, bound);
+		}
+		t[1] = now_ns() - start;
+
+		start = now_ns();
+		for (i = 0; i < ops; ++i)
+			if (!alpha_equivalent_graphs(ctx, term, copy))
+				fprintf(stderr, "copy of %s term not alpha equivalent\n", shape_names[shape]);
+		t[2] = now_ns() - start;
+
+		start = now_ns();
+		for (i = 0; i < ops; ++i)
+		{
+			b->offset = 0;
+			buffer_expression(term, b);
+		}
+		t[3] = now_ns() - start;
+
+		start = now_ns();
+		for (i = 0; i < ops; ++i)
+			free_expression(ctx, goedelize(ctx, term));
+		t[4] = now_ns() - start;
+
+		start = now_ns();
+		for (i = 0; i < ops; ++i)
+			free_expression(ctx, ungodelize(ctx, encoded));
+		t[5] = now_ns() - start;
+
+		delete_buffer(b);
+
+		for (j = 0; j < 6; ++j)
+			if (0 == rep || t[j] < best[j]) best[j] = t[j];
+	}
+
+	for (j = 0; j < 6; ++j)
+		report(names[j], shape_names[shape], nodes, ops, best[j]);
+
+	free_expression(ctx, encoded);
+	free_expression(ctx, copy);
+	free_expression(ctx, term);
+}
+
+/* Terms of about the given number of nodes:
+ * balanced - random applications and abstractions, depth about log(nodes)
+ * spine    - one long left-associated application, like "f a b c ..."
+ * deep     - abstractions nested all the way down, like Church numerals
+ */
+static struct lambda_expression *
+make_term(enum shape shape, long nodes)
+{
+	struct lambda_expression *e = NULL;
+	long i;
+
+	switch (shape)
+	{
+	case BALANCED:
+		e = balanced_term(nodes, 0);
+		break;
+	case SPINE:
+		e = new_variable(ctx, free_pool[0]);
+		for (i = 1; i < nodes; i += 2)
+			e = new_application(ctx, e, new_variable(ctx,
+				random_below(2)? free_pool[random_below(POOL_SIZE)]
+					: bound_pool[random_below(POOL_SIZE)]));
+		break;
+	case DEEP:
+		e = new_application(ctx, new_variable(ctx, bound_pool[0]), new_variable(ctx, free_pool[0]));
+		for (i = 3; i < nodes; ++i)
+			e = new_abstraction(ctx, bound_pool[i % POOL_SIZE], e);
+		break;
+	}
+
+	return e;
+}
+
+static struct lambda_expression *
+balanced_term(long nodes, int depth)
+{
+	if (nodes <= 1)
+	{
+		/* Bound variables only show up inside abstractions */
+		if (depth > 0 && random_below(3))
+			return new_variable(ctx, bound_pool[random_below(depth < POOL_SIZE? depth: POOL_SIZE)]);
+		return new_variable(ctx, free_pool[random_below(POOL_SIZE)]);
+	}
+
+	if (0 == random_below(4) && depth < POOL_SIZE)
+		return new_abstraction(ctx, bound_pool[depth], balanced_term(nodes - 1, depth + 1));
+
+	return new_application(ctx,
+		balanced_term((nodes - 1)/2, depth),
+		balanced_term(nodes - 1 - (nodes - 1)/2, depth)
+	);
+}
+
+static long
+count_nodes(struct lambda_expression *e)
+{
+	long n = 0;
+
+	while (e)
+	{
+		++n;
+		switch (e->typ)
+		{
+		case APPLICATION:
+			n += count_nodes(e->rand);
+			e = e->rator;
+			break;
+		case ABSTRACTION:
+			e = e->body;
+			break;
+		case VARIABLE:
+		case ABBREVIATION:
+			e = NULL;
+			break;
+		}
+	}
+
+	return n;
+}
+
+/* xorshift64*, as in lcr.c */
+static unsigned int
+random_below(unsigned int n)
+{
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return (unsigned int)(((rng_state * 0x2545F4914F6CDD1DULL) >> 32) % n);
+}
+
+static double
+now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec*1.0e9 + ts.tv_nsec;
+}
+
+static void
+report(const char *bench, const char *shape, long nodes, long ops, double best_ns)
+{
+	printf("bench=%s", bench);
+	if (shape)
+		printf(" shape=%s nodes=%ld", shape, nodes);
+	printf(" ops=%ld ns_per_op=%.1f\n", ops, best_ns/ops);
+}
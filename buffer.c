@@ -31,7 +31,7 @@
 
 #include <stdlib.h>   /* malloc(), free(), realloc() */
 #include <string.h>   /* memcpy() */
-#include <stdio.h>    /* fprintf() */
+#include <stdio.h>    /* fprintf(), fwrite() */
 
 #include <buffer.h>
 
@@ -52,15 +52,45 @@ new_buffer(int desired_size)
 	r->buffer = malloc(desired_size);
 	r->size = desired_size;
 	r->offset = 0;
+	r->drain = NULL;
+	r->sink = NULL;
 	return r;
 }
 
+static void
+drain_to_stream(struct buffer *b)
+{
+	fwrite(b->buffer, 1, b->offset, (FILE *)b->sink);
+	b->offset = 0;
+	b->buffer[0] = '\0';
+}
+
+/* A buffer of fixed size that writes to sink whenever it fills up,
+ * so that output of any length only needs chunk_size bytes. */
+struct buffer *
+new_stream_buffer(FILE *sink, int chunk_size)
+{
+	struct buffer *r = new_buffer(chunk_size);
+	r->drain = drain_to_stream;
+	r->sink = sink;
+	return r;
+}
+
+void
+flush_buffer(struct buffer *b)
+{
+	if (b->drain && b->offset > 0)
+		b->drain(b);
+}
+
 void
 delete_buffer(struct buffer *b)
 {
 	free(b->buffer);
 	b->buffer = NULL;
 	b->offset = b->size = 0;
+	b->drain = NULL;
+	b->sink = NULL;
 	free(b);
 	b = NULL;
 }
@@ -73,11 +103,16 @@ resize_buffer(struct buffer *b, int increment)
 	b->buffer = realloc(b->buffer, b->size);
 }
 
+/* Growing by at least the current size keeps the number of
+ * realloc() calls logarithmic in the final size. */
 void
 buffer_append(struct buffer *b, const char *bytes, int length)
 {
+	if (length >= (b->size - b->offset - 1) && b->drain)
+		b->drain(b);
+
 	if (length >= (b->size - b->offset - 1))
-		resize_buffer(b, length);
+		resize_buffer(b, length >= b->size? length + 1: b->size);
 
 	memcpy(&b->buffer[b->offset], bytes, length);
 	b->offset += length;
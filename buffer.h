@@ -24,9 +24,16 @@ struct buffer {
 	char *buffer;
 	int   size;
 	int   offset;  /* end of data in buffer */
+
+	/* Optional: instead of growing, a full buffer calls drain(),
+	 * which empties it out to wherever sink says. */
+	void (*drain)(struct buffer *b);
+	void *sink;
 };
 
 struct buffer *new_buffer(int desired_size);
+struct buffer *new_stream_buffer(FILE *sink, int chunk_size);
 void           resize_buffer(struct buffer *b, int increment);
 void           buffer_append(struct buffer *b, const char *bytes, int length);
+void           flush_buffer(struct buffer *b);
 void           delete_buffer(struct buffer *b);
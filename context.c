@@ -0,0 +1,77 @@
+/*
+	Copyright (C) 2006-2011, Bruce Ediger
+
+    This file is part of lc.
+
+    lc is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    lc is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with lc; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/*
+ * Making and unmaking interpreter sessions.  See context.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>    /* calloc(), free() */
+#include <signal.h>    /* sig_atomic_t */
+
+#include <context.h>
+#include <hashtable.h>
+#include <small_hashtable.h>
+#include <buffer.h>
+#include <lambda_expression.h>
+#include <abbreviations.h>
+#include <typed.h>
+
+/* A session with no abbreviations and the default settings,
+ * writing output to stdout.  Everything not set here starts
+ * out zero or NULL, suspended_state included. */
+struct lc_context *
+new_context(void)
+{
+	struct lc_context *ctx = calloc(1, sizeof(*ctx));
+
+	ctx->abbr_table = new_hashtable(NULL);
+
+	ctx->prompting = 1;
+	ctx->eta_reduction = 1;
+	ctx->prenormalize_budget = 1000;
+	ctx->out = stdout;
+
+	return ctx;
+}
+
+/* Frees every node, table and abbreviation the session has, and
+ * complains about any that something else still held.  Closing a
+ * trace, reporting a profile, finishing the writer and closing the
+ * scanner come first. */
+void
+free_context(struct lc_context *ctx)
+{
+	if (ctx->previous_result)
+		free_expression(ctx, ctx->previous_result);
+	ctx->previous_result = NULL;
+	if (ctx->suspended)
+		free_expression(ctx, ctx->suspended);
+	ctx->suspended = NULL;
+
+	free_abbreviation_table(ctx);
+	free_all_small_hashtable(ctx);
+	free_alpha_state(ctx);
+	free_typing_state(ctx);
+	free_all(ctx);
+
+	free(ctx);
+}
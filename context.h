@@ -0,0 +1,151 @@
+/*
+	Copyright (C) 2006-2011, Bruce Ediger
+
+    This file is part of lc.
+
+    lc is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    lc is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with lc; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/* Settings for, and results of, one call to normal_order_reduction() */
+struct reduction_state {
+	long step_limit;   /* stop after this many beta and eta steps, 0: no limit */
+	long beta_steps;
+	long eta_steps;
+	int  limited;      /* stopped short of a normal form: 1 at step_limit,
+	                    * 2 at the session's node_limit, 3 back at a term
+	                    * it had before, 4 growing around copies of itself */
+	long period;       /* steps in the cycle, or between the copies */
+	int  interrupted;  /* stopped by interrupt_requested, its value,
+	                    * or 2 at the session's deadline */
+	int  top_level;    /* a reduction "checkpoint" applies to */
+};
+
+/* Everything one interpreter session keeps between statements, in one
+ * place.  Functions that allocate, free or look up anything take the
+ * session's struct lc_context as their first argument, so that any
+ * number of sessions can live in one process, on separate threads,
+ * without seeing each other.  The atom table is the one thing sessions
+ * share: an atom means the same string everywhere.
+ *
+ * Uses FILE from <stdio.h> and sig_atomic_t from <signal.h>.
+ * Other headers' prototypes use struct lc_context, so this
+ * comes first.
+ */
+struct lc_context {
+	/* lambda_expression.c: nodes come off free_list, or out of slabs */
+	struct lambda_expression *free_list;
+	struct node_slab *slabs;
+	int slab_used;
+	long alloc_cnt;
+	long free_cnt;
+	long malloc_cnt;
+	long in_use_peak;          /* since mark_nodes_peak() */
+
+	/* small_hashtable.c: tables and nodes not currently in use */
+	struct small_hashnode *free_hashnode_list;
+	struct small_hashtable *free_hashtable_list;
+	int hashtables_allocated;
+	int hashnodes_allocated;
+
+	/* abbreviations.c: the table, and every living struct
+	 * abbreviation, whether or not the table still holds it */
+	struct hashtable *abbr_table;
+	struct abbreviation *oldest;
+	struct abbreviation *newest;
+	unsigned int next_seq;
+
+	/* Settings */
+	int prompting;
+	int perform_timing;
+	int reduction_timeout;     /* seconds, 0: no limit */
+	long step_limit;           /* beta and eta steps in one reduction, 0: no limit */
+	int eta_reduction;
+	int trace_eval;
+	int single_step;
+	int prenormalize;
+	long prenormalize_budget;  /* reduction steps */
+	int use_compiled_files;
+	int asynchronous_output;   /* "print > file" hands writing to a thread */
+	int profiling;             /* profile_charge() calls wanted */
+	int binary_trace;          /* trace_record() calls wanted */
+	long checkpoint_every;     /* steps between checkpoints, 0: none */
+	int detect_divergence;     /* divergence_check() calls wanted */
+	int typed_evaluation;      /* typed_normal_form() first, for typable terms */
+	const char *checkpoint_file;
+
+	/* Budgets every reduction shares, set per request by serve.c:
+	 * a CLOCK_MONOTONIC time to stop by, and the most nodes that
+	 * may be in use at once.  0: no limit. */
+	double deadline;
+	long node_limit;
+
+	/* Where output goes */
+	FILE *out;
+
+	/* $$, and a reduction stopped early, kept for "continue" */
+	struct lambda_expression *previous_result;
+	struct lambda_expression *suspended;
+	struct reduction_state suspended_state;
+
+	/* Set asynchronously, checked between reduction steps:
+	 * 1 for Control-C, 2 for a timeout */
+	volatile sig_atomic_t interrupt_requested;
+
+	/* Every reduction's steps, for -s */
+	long total_beta_steps;
+	long total_eta_steps;
+	long typed_reductions;     /* reductions of terms with a simple type, */
+	long fast_paths;           /* and of those, ones the machine finished */
+
+	/* What statements in a file do, so as to know whether an
+	 * image of the abbreviations it defined can stand in for it */
+	int output_statements;
+	int settings_made;
+
+	/* grammar.y and lex.l: the scanner of the current input
+	 * stream, its state, and the files that "load" stacked up */
+	void *scanner;
+	int looking_for_filename;
+	int found_binary_command;
+	struct stream_node *file_stack;
+	int lineno;                /* of the latest token */
+	int newline_pending;
+	const char *current_input_stream;
+
+	/* liblc.c: parse one term into request instead of evaluating
+	 * statements, and keep syntax errors in error[] rather than
+	 * printing them.  parse_request goes from 1 to 2 once the
+	 * scanner starts on the term. */
+	int embedded;
+	int parse_request;
+	struct lambda_expression *request;
+	char error[256];
+
+	/* trace.c, profile.c, json.c and writer.c keep their state behind these */
+	struct trace_state *trace;
+	struct profile_state *profile;
+	struct json_state *json;
+	struct writer_state *writer;
+
+	/* lambda_expression.c: alpha_equivalent_graphs()'s scratch space */
+	struct alpha_state *alpha;
+
+	/* typed.c: type inference's scratch space */
+	struct typing_state *typing;
+};
+
+struct lc_context *new_context(void);
+void free_context(struct lc_context *ctx);
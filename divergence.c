@@ -0,0 +1,337 @@
+/*
+	Copyright (C) 2006-2011, Bruce Ediger
+
+    This file is part of lc.
+
+    lc is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    lc is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with lc; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+
+/*
+ * Divergence detection.  A term's canonical form numbers bound
+ * variables by the depth of their abstractions, so alpha-equivalent
+ * terms hash alike, unless one has a repeated application folded up
+ * where the other has it spelled out.  Comparing two canonical forms
+ * word for word confirms a match.  Beta steps rewrite the term in
+ * place, so rather than maintain a hash through every substitution,
+ * this encodes the whole term at samples spaced out enough that
+ * encoding costs no more than DIVERGENCE_WORDS_PER_STEP words per step.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>     /* memcmp(), memcpy() */
+#include <stdint.h>
+#include <signal.h>     /* sig_atomic_t */
+
+#include <context.h>
+#include <buffer.h>
+#include <lambda_expression.h>
+#include <divergence.h>
+
+#define DIVERGENCE_WORDS_PER_STEP 256
+#define GROWTH_HISTORY 8   /* samples a growing term gets compared with */
+#define GROWTH_SAMPLES 8   /* samples in a row to find holding copies */
+
+/* A sampled canonical form */
+struct sample {
+	unsigned int *words;
+	size_t length;
+	size_t size;
+	long steps;
+};
+
+/* Where each subterm of a canonical form starts, for finding copies:
+ * how many abstractions enclose it, and how many words it takes up */
+struct layout_frame {
+	size_t start;
+	int left;          /* subterms still to come */
+};
+
+struct divergence_state {
+	struct lc_context *ctx;
+	long stride;       /* beta steps between samples */
+	long countdown;    /* beta steps to the next sample */
+	int refining;      /* found a cycle between samples, now looking
+	                    * for its exact period step by step */
+
+	/* Brent's algorithm: the term saved at a power of two samples,
+	 * and how many samples since */
+	struct sample saved;
+	uint64_t saved_hash;
+	long power;
+	long lambda;
+
+	/* The last few samples, and how many in a row held a copy
+	 * of an earlier one */
+	struct sample history[GROWTH_HISTORY];
+	int next;
+	int growing;
+
+	/* scratch for find_copy() */
+	unsigned int *depth;
+	size_t *extent;
+	struct layout_frame *frames;
+	size_t scratch_size;
+};
+
+static void keep_sample(struct sample *s, const unsigned int *words, size_t length, long steps);
+static int  grows(struct divergence_state *d, const unsigned int *words, size_t length, long steps, long *period);
+static void lay_out(struct divergence_state *d, const unsigned int *words, size_t length);
+static int  find_copy(struct divergence_state *d, const unsigned int *words, size_t length, const struct sample *old);
+
+struct divergence_state *
+divergence_start(struct lc_context *ctx)
+{
+	struct divergence_state *d = calloc(1, sizeof(*d));
+
+	d->ctx = ctx;
+	d->stride = d->countdown = 1;
+	d->power = d->lambda = 1;
+
+	return d;
+}
+
+void
+divergence_end(struct divergence_state *d)
+{
+	int i;
+
+	if (!d)
+		return;
+
+	free(d->saved.words);
+	for (i = 0; i < GROWTH_HISTORY; ++i)
+		free(d->history[i].words);
+	free(d->depth);
+	free(d->extent);
+	free(d->frames);
+	free(d);
+}
+
+enum divergence
+divergence_check(struct divergence_state *d, struct lambda_expression *e, long steps, long *period)
+{
+	const unsigned int *words;
+	size_t length;
+	uint64_t hash;
+
+	if (--d->countdown > 0)
+		return DIVERGENCE_NONE;
+	d->countdown = d->stride;
+
+	words = canonical_form(d->ctx, e, 1, &length);
+	hash = hash_words(words, length);
+
+	if (hash == d->saved_hash && length == d->saved.length
+		&& !memcmp(words, d->saved.words, length*sizeof(words[0])))
+	{
+		if (1 == d->stride)
+		{
+			*period = steps - d->saved.steps;
+			return DIVERGENCE_CYCLE;
+		}
+		/* The period divides the steps between the two samples:
+		 * sample every step from here to the next repeat. */
+		d->refining = 1;
+		d->stride = d->countdown = 1;
+		d->saved.steps = steps;
+		return DIVERGENCE_NONE;
+	}
+
+	if (d->refining)
+		return DIVERGENCE_NONE;
+
+	if (length > d->stride*DIVERGENCE_WORDS_PER_STEP)
+	{
+		/* Sample less often, and start Brent's algorithm over,
+		 * as samples have to be evenly spaced */
+		while (length > d->stride*DIVERGENCE_WORDS_PER_STEP)
+			d->stride *= 2;
+		d->countdown = d->stride;
+		d->power = d->lambda = 1;
+	}
+
+	if (d->power == d->lambda)
+	{
+		keep_sample(&d->saved, words, length, steps);
+		d->saved_hash = hash;
+		d->power *= 2;
+		d->lambda = 0;
+	}
+	++d->lambda;
+
+	return grows(d, words, length, steps, period)? DIVERGENCE_GROWTH: DIVERGENCE_NONE;
+}
+
+/* FNV-1a, a word at a time */
+uint64_t
+hash_words(const unsigned int *words, size_t length)
+{
+	uint64_t h = 14695981039346656037ULL;
+	size_t i;
+
+	for (i = 0; i < length; ++i)
+	{
+		h ^= words[i];
+		h *= 1099511628211ULL;
+	}
+
+	return h;
+}
+
+static void
+keep_sample(struct sample *s, const unsigned int *words, size_t length, long steps)
+{
+	if (length > s->size)
+	{
+		s->size = length;
+		s->words = realloc(s->words, s->size*sizeof(s->words[0]));
+	}
+	memcpy(s->words, words, length*sizeof(words[0]));
+	s->length = length;
+	s->steps = steps;
+}
+
+/* Return 1 if the last GROWTH_SAMPLES samples, this one included, each
+ * held a copy of a smaller sample from shortly before.  Y f reduces to
+ * f (Y' f), then to f (f (Y' f)), and so on: every term the reduction
+ * passes through turns up again inside a later one. */
+static int
+grows(struct divergence_state *d, const unsigned int *words, size_t length, long steps, long *period)
+{
+	int i, laid_out = 0;
+
+	for (i = 1; i <= GROWTH_HISTORY; ++i)
+	{
+		struct sample *old = &d->history[(d->next + GROWTH_HISTORY - i) % GROWTH_HISTORY];
+
+		if (0 == old->length || old->length >= length)
+			continue;
+
+		if (!laid_out)
+		{
+			lay_out(d, words, length);
+			laid_out = 1;
+		}
+
+		if (find_copy(d, words, length, old))
+		{
+			*period = steps - old->steps;
+			break;
+		}
+	}
+
+	d->growing = (i <= GROWTH_HISTORY)? d->growing + 1: 0;
+
+	keep_sample(&d->history[d->next], words, length, steps);
+	d->next = (d->next + 1) % GROWTH_HISTORY;
+
+	return d->growing >= GROWTH_SAMPLES;
+}
+
+/* Fill in d->depth[] and d->extent[] for each word of a canonical
+ * form: applications have two subterms after them, abstractions one,
+ * and variables end subterms.  A repeated application's count words
+ * start no subterm. */
+static void
+lay_out(struct divergence_state *d, const unsigned int *words, size_t length)
+{
+	size_t k, top = 0;
+	unsigned int depth = 0;
+
+	if (length > d->scratch_size)
+	{
+		d->scratch_size = length + length/2;
+		d->depth = realloc(d->depth, d->scratch_size*sizeof(d->depth[0]));
+		d->extent = realloc(d->extent, d->scratch_size*sizeof(d->extent[0]));
+		d->frames = realloc(d->frames, d->scratch_size*sizeof(d->frames[0]));
+	}
+
+	for (k = 0; k < length; ++k)
+	{
+		d->depth[k] = depth;
+
+		if (CANONICAL_REPEAT == words[k])
+		{
+			d->frames[top].start = k;
+			d->frames[top++].left = 2;
+			d->depth[k + 1] = d->depth[k + 2] = depth;
+			d->extent[k + 1] = d->extent[k + 2] = 0;
+			k += 2;
+			continue;
+		}
+
+		if (words[k] < 2)
+		{
+			d->frames[top].start = k;
+			d->frames[top++].left = words[k]? 1: 2;
+			if (words[k])
+				++depth;
+			continue;
+		}
+
+		d->extent[k] = 1;
+		while (top > 0 && 0 == --d->frames[top - 1].left)
+		{
+			size_t start = d->frames[--top].start;
+			d->extent[start] = k - start + 1;
+			if (1 == words[start])
+				--depth;
+		}
+	}
+}
+
+/* Return 1 if a subterm of words alpha-equates to the whole of old.
+ * Bound variables' words count abstractions from the top of the term,
+ * so inside a subterm under n abstractions they come out 2*n more;
+ * repeat counts stay as they are.  Subterms of the same length can't overlap, so this looks at each
+ * word at most once. */
+static int
+find_copy(struct divergence_state *d, const unsigned int *words, size_t length, const struct sample *old)
+{
+	size_t o, k;
+
+	for (o = 0; o + old->length <= length; ++o)
+	{
+		unsigned int shift = 2*d->depth[o];
+
+		if (d->extent[o] != old->length || words[o] != old->words[0])
+			continue;
+
+		for (k = 0; k < old->length; ++k)
+		{
+			unsigned int w = old->words[k];
+
+			if (CANONICAL_REPEAT == w)
+			{
+				if (memcmp(&words[o + k], &old->words[k], 3*sizeof(w)))
+					break;
+				k += 2;
+				continue;
+			}
+			if (w >= 2 && 0 == (w & 1))
+				w += shift;
+			if (words[o + k] != w)
+				break;
+		}
+
+		if (k == old->length)
+			return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,44 @@
+/*
+	Copyright (C) 2006-2011, Bruce Ediger
+
+    This file is part of lc.
+
+    lc is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    lc is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with lc; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+
+/* Spotting reductions that can't reach a normal form, for "divergence
+ * on" and -d.  normal_order_reduction() hands divergence_check() the
+ * term before every beta step.  It samples the term's canonical form
+ * (canonical_form() in lambda_expression.c), every step for small terms
+ * and more rarely for big ones, and stops a reduction that comes back
+ * to a term it reduced before, found by Brent's cycle detection on
+ * hashes of the canonical forms, or that keeps growing around copies
+ * of the terms it had a few samples before, as Y f and
+ * (\x.x x x)(\x.x x x) do.
+ */
+
+enum divergence { DIVERGENCE_NONE, DIVERGENCE_CYCLE, DIVERGENCE_GROWTH };
+
+struct divergence_state *divergence_start(struct lc_context *ctx);
+/* steps counts beta and eta steps so far.  A cycle's period, or the
+ * steps between the copies of a growing term, go in *period. */
+enum divergence divergence_check(struct divergence_state *d, struct lambda_expression *e, long steps, long *period);
+void divergence_end(struct divergence_state *d);
+
+/* A hash of canonical_form()'s words, so alpha-equivalent terms share
+ * it.  json.c uses it too.  Needs uint64_t, from <stdint.h>. */
+uint64_t hash_words(const unsigned int *words, size_t length);
@@ -26,33 +26,52 @@
  */
 
 #include <stdio.h>  /* NULL definition */
+#include <signal.h> /* sig_atomic_t */
+#include <stdint.h>
+#include <time.h>   /* clock_gettime() */
+#include <sys/types.h>
+#include <sys/stat.h> /* struct stat, for image.h */
+#include <context.h>
 #include <small_hashtable.h>
 #include <buffer.h>
 #include <lambda_expression.h>
 #include <evaluation.h>
 #include <hashtable.h>
 #include <atom.h>
+#include <abbreviations.h>
+#include <image.h>
+#include <trace.h>
+#include <profile.h>
+#include <divergence.h>
+#include <typed.h>
+#include <probes.h>
 
 
-enum RedexType {BETA_REDEX, ETA_REDEX};
+/* UNFOLDING: no room to unfold a repeated application */
+enum RedexType {BETA_REDEX, ETA_REDEX, UNFOLDING};
 
 struct application_data {
 	int found;
 	enum RedexType typ;
 	struct lambda_expression **parent;
 	struct lambda_expression *application;
+	int depth;      /* where the redex is, for binary traces */
+	uint64_t path;
 };
 
 struct application_data find_redex(
+	struct lc_context *ctx,
 	struct lambda_expression *expression,
-	struct lambda_expression **expression_holder
+	struct lambda_expression **expression_holder,
+	int depth,
+	uint64_t path
 );
 
-/* these live in grammar.y */
-extern int trace_eval;
-extern int single_step;
-extern int eta_reduction;
+/* Path to the child in direction dir (TRACE_RATOR etc) of a node at depth */
+#define PATH_TO(path, depth, dir) \
+	((depth) < TRACE_PATH_EDGES? (path) | ((uint64_t)(dir) << 2*(depth)): (path))
 
+static struct lambda_expression *delta_reduce(struct lc_context *ctx, struct lambda_expression *ref);
 
 /* substitute() and real_substitute() exist so as to have the
  * ability to "single step" and "trace" substitutions.
@@ -64,6 +83,7 @@ extern int eta_reduction;
 */
 
 struct lambda_expression *substitute(
+	struct lc_context *ctx,
 	struct lambda_expression *term,
 	const char *for_bound_variable,
 	struct lambda_expression *in_expression
@@ -71,6 +91,7 @@ struct lambda_expression *substitute(
 
 struct lambda_expression *
 real_substitute(
+	struct lc_context *ctx,
 	struct lambda_expression *term,
 	const char               *for_variable,
 	struct lambda_expression *in_expression
@@ -82,6 +103,7 @@ real_substitute(
 
 struct lambda_expression *
 abstraction_substitution(
+	struct lc_context *ctx,
 	struct lambda_expression *term,
 	const char               *for_variable,
 	struct lambda_expression *in_abstraction
@@ -91,36 +113,37 @@ void read_line(void);
 
 struct lambda_expression *
 substitute(
+	struct lc_context *ctx,
 	struct lambda_expression *term,
 	const char *bound_variable,
 	struct lambda_expression *exp
 )
 {
 	struct lambda_expression *r = NULL;
-	if (trace_eval)
+	if (ctx->trace_eval)
 	{
 		struct buffer *a = new_buffer(128);
 		struct buffer *b = new_buffer(128);
 		buffer_expression(term, a);
 		buffer_expression(exp, b);
-		printf("Substitute (%s) for %s in (%s)\n", a->buffer, bound_variable, b->buffer);
+		fprintf(ctx->out, "Substitute (%s) for %s in (%s)\n", a->buffer, bound_variable, b->buffer);
 		delete_buffer(a);
 		delete_buffer(b);
 		a = b = NULL;
 	}
-	if (single_step) read_line();
+	if (ctx->single_step) read_line();
 
-	r = real_substitute(term, bound_variable, exp);
+	r = real_substitute(ctx, term, bound_variable, exp);
 
-	if (trace_eval)
+	if (ctx->trace_eval)
 	{
 		struct buffer *a = new_buffer(128);
 		buffer_expression(r, a);
-		printf("Substitution: %s\n", a->buffer);
+		fprintf(ctx->out, "Substitution: %s\n", a->buffer);
 		delete_buffer(a);
 		a = NULL;
 	}
-	if (single_step) read_line();
+	if (ctx->single_step) read_line();
 
 	return r;
 }
@@ -132,6 +155,7 @@ substitute(
  */
 struct lambda_expression *
 real_substitute(
+	struct lc_context *ctx,
 	struct lambda_expression *term,
 	const char *variable,
 	struct lambda_expression *exp
@@ -142,18 +166,32 @@ real_substitute(
 	{
 	case VARIABLE:
 		if (exp->variable == variable)
-			r = copy_expression(term);
-		else
-			r = new_variable(exp->variable);
+			r = copy_expression(ctx, term);
+		else {
+			r = new_variable(ctx, exp->variable);
+			r->origin = exp->origin;
+		}
 		break;
 	case APPLICATION:
-		r = new_application(
-			real_substitute(term, variable, exp->rator),
-			real_substitute(term, variable, exp->rand)
+		r = new_application(ctx,
+			real_substitute(ctx, term, variable, exp->rator),
+			real_substitute(ctx, term, variable, exp->rand)
 		);
+		r->repeat = exp->repeat;
+		r->origin = exp->origin;
 		break;
 	case ABSTRACTION:
-		r = abstraction_substitution(term, variable, exp);
+		r = abstraction_substitution(ctx, term, variable, exp);
+		break;
+	case ABBREVIATION:
+		/* Only expand the abbreviation if the variable
+		 * appears free in its definition. */
+		if (abbreviation_has_free(exp->abbreviation, variable))
+		{
+			r = real_substitute(ctx, term, variable, exp->abbreviation->expression);
+			if (exp->parameterized) r->parameterized = 1;
+		} else
+			r = copy_expression(ctx, exp);
 		break;
 	}
 	return r;
@@ -162,6 +200,7 @@ real_substitute(
 /* The "case ABSTRACTION:" branch from real_substitute() */
 struct lambda_expression *
 abstraction_substitution(
+	struct lc_context *ctx,
 	struct lambda_expression *term,
 	const char *bound_variable,
 	struct lambda_expression *abstr
@@ -171,89 +210,214 @@ abstraction_substitution(
 
 	if (abstr->bound_variable == bound_variable)
 		/* bound variable of abstraction "abstr" shadows bound_variable */
-		r = copy_expression(abstr);
+		r = copy_expression(ctx, abstr);
 	else {
-		struct small_hashtable *term_free_vars = init_small_hashtable(16);
-		struct small_hashtable *bnd_vrs = init_small_hashtable(16);
-		find_free_vars(term, bnd_vrs, term_free_vars);
+		struct small_hashtable *term_free_vars = init_small_hashtable(ctx, 16);
+		struct small_hashtable *bnd_vrs = init_small_hashtable(ctx, 16);
+		find_free_vars(ctx, term, bnd_vrs, term_free_vars);
 		if (NULL == find_value(term_free_vars, abstr->bound_variable))
 		{
-			r = new_abstraction(
+			r = new_abstraction(ctx,
 				abstr->bound_variable,
-				real_substitute(
+				real_substitute(ctx,
 					term,
 					bound_variable,
 					abstr->body
 				)
 			);
+			r->origin = abstr->origin;
 		} else {
 			struct lambda_expression *new_body = NULL, *new_bound_var;
 			struct lambda_expression *new_abst = NULL;
 			const char *new_bound_var_name = NULL;
-			find_free_vars(abstr->body, bnd_vrs, term_free_vars);
+			find_free_vars(ctx, abstr->body, bnd_vrs, term_free_vars);
 			new_bound_var_name = find_nonfree_var(term_free_vars);
-			new_bound_var = new_variable(new_bound_var_name);
-			new_body = real_substitute(
+			LC_PROBE_RENAME(nodes_allocated(ctx), abstr->bound_variable, new_bound_var_name);
+			new_bound_var = new_variable(ctx, new_bound_var_name);
+			new_body = real_substitute(ctx,
 				new_bound_var,
 				abstr->bound_variable,
 				abstr->body
 			);
-			new_abst = new_abstraction(new_bound_var_name, new_body);
+			new_abst = new_abstraction(ctx, new_bound_var_name, new_body);
+			new_abst->origin = abstr->origin;
 
-			r = real_substitute(term, bound_variable, new_abst);
-			free_expression(new_bound_var);
-			free_expression(new_abst);
+			r = real_substitute(ctx, term, bound_variable, new_abst);
+			free_expression(ctx, new_bound_var);
+			free_expression(ctx, new_abst);
 		}
-		free_small_hashtable(bnd_vrs);
-		free_small_hashtable(term_free_vars);
+		free_small_hashtable(ctx, bnd_vrs);
+		free_small_hashtable(ctx, term_free_vars);
 	}
 	return r;
 }
 
+/* Seconds on a clock that only goes forward, for deadlines */
+double
+monotonic_seconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (double)ts.tv_sec + 1.0E-9*(double)ts.tv_nsec;
+}
+
+void
+init_reduction_state(struct reduction_state *rs, long step_limit)
+{
+	rs->step_limit = step_limit;
+	rs->beta_steps = 0;
+	rs->eta_steps = 0;
+	rs->limited = 0;
+	rs->interrupted = 0;
+	rs->period = 0;
+	rs->top_level = 0;
+}
+
 struct lambda_expression *
-normal_order_reduction(struct lambda_expression *e)
+normal_order_reduction(struct lc_context *ctx, struct lambda_expression *e, struct reduction_state *rs)
 {
 	int found_reduction = 0;
+	long checkpointed_at = rs->beta_steps + rs->eta_steps;
+	struct divergence_state *divergence = NULL;
+
+	/* A typable term can go straight to its beta normal form, leaving
+	 * eta steps it didn't take, if any, to the loop below.  Traces, profiles and
+	 * single stepping want to see each step, so they keep to it. */
+	if (ctx->typed_evaluation && !ctx->trace_eval && !ctx->single_step
+		&& !ctx->binary_trace && !ctx->profiling)
+	{
+		struct lambda_expression *r = typed_normal_form(ctx, e, rs);
+		if (r)
+			e = r;
+	}
+
+	if (ctx->detect_divergence)
+		divergence = divergence_start(ctx);
+	if (ctx->binary_trace)
+		trace_record(ctx, TRACE_START, 0, NULL, 0, 0, 0);
+	if (ctx->profiling)
+		profile_start(ctx);
 
 	do {
 		struct application_data ad;
 		struct lambda_expression *parent = NULL;
 
+		/* Signal handlers only set a flag: stopping here, between
+		 * steps, leaves e a complete term that can be reduced further. */
+		if (ctx->interrupt_requested)
+		{
+			rs->interrupted = ctx->interrupt_requested;
+			break;
+		}
+
+		if (ctx->checkpoint_every && rs->top_level
+			&& rs->beta_steps + rs->eta_steps - checkpointed_at >= ctx->checkpoint_every)
+		{
+			checkpoint(ctx, e, rs);
+			checkpointed_at = rs->beta_steps + rs->eta_steps;
+		}
+
+		while (ABBREVIATION == e->typ)
+			e = delta_reduce(ctx, e);
+
 		ad.found = 0;
 		ad.parent = NULL;
 		ad.application = NULL;
 
-		ad = find_redex(e, &parent);
+		ad = find_redex(ctx, e, &parent, 0, 0);
+
+		if (ad.found && rs->step_limit
+			&& rs->beta_steps + rs->eta_steps >= rs->step_limit)
+		{
+			rs->limited = 1;
+			break;
+		}
+
+		if (ad.found && ctx->node_limit
+			&& nodes_allocated(ctx) - nodes_freed(ctx) > ctx->node_limit)
+		{
+			rs->limited = 2;
+			break;
+		}
+
+		/* Reading the clock every step would cost more than the step */
+		if (ad.found && ctx->deadline
+			&& 0 == ((rs->beta_steps + rs->eta_steps) & 63)
+			&& monotonic_seconds() >= ctx->deadline)
+		{
+			rs->interrupted = 2;
+			break;
+		}
+
+		if (divergence && ad.found && BETA_REDEX == ad.typ)
+		{
+			enum divergence d = divergence_check(divergence, e,
+				rs->beta_steps + rs->eta_steps, &rs->period);
+			if (DIVERGENCE_NONE != d)
+			{
+				rs->limited = (DIVERGENCE_CYCLE == d)? 3: 4;
+				break;
+			}
+		}
 
 		if (ad.found)
 		{
 			if (BETA_REDEX == ad.typ)
 			{
+				const char *bound_variable = ad.application->rator->bound_variable;
+				const char *origin = ad.application->rator->origin;
+
 				/* substitute the rand for the body of the abstraction */
-				struct lambda_expression *r = substitute(
+				struct lambda_expression *r = substitute(ctx,
 					ad.application->rand,
 					ad.application->rator->bound_variable,
 					ad.application->rator->body
 				);
 
 				/* free the old application */
-				free_expression(ad.application);
+				free_expression(ctx, ad.application);
 
 				/* put the substituted-for abstraction body in for the old application */
 				if (ad.parent == &parent)
 					e = r;
 				else
 					*(ad.parent) = r;
+
+				++rs->beta_steps;
+				LC_PROBE_BETA(rs->beta_steps + rs->eta_steps, ad.depth, nodes_allocated(ctx), bound_variable);
+
+				if (ctx->binary_trace)
+					trace_record(ctx, TRACE_BETA, rs->beta_steps + rs->eta_steps,
+						bound_variable, ad.depth, ad.path, 0);
+				if (ctx->profiling)
+					profile_charge(ctx, PROFILE_BETA, origin);
 			}
 			if (ETA_REDEX == ad.typ)
 			{
-				if (*ad.parent) free_expression(*ad.parent);
+				/* detach the eta-reduced term from the abstraction */
+				struct lambda_expression *abstr = (ad.parent == &parent)? e: *ad.parent;
+				const char *bound_variable = abstr->bound_variable;
+				const char *origin = abstr->origin;
+				abstr->body->rator = NULL;
+
+				if (*ad.parent) free_expression(ctx, *ad.parent);
 				if (ad.parent == &parent)
 				{
-					free_expression(e);
+					free_expression(ctx, e);
 					e = ad.application;
 				} else
 					*(ad.parent) = ad.application;
+
+				++rs->eta_steps;
+				LC_PROBE_ETA(rs->beta_steps + rs->eta_steps, ad.depth, nodes_allocated(ctx), bound_variable);
+
+				if (ctx->binary_trace)
+					trace_record(ctx, TRACE_ETA, rs->beta_steps + rs->eta_steps,
+						bound_variable, ad.depth, ad.path, 0);
+				if (ctx->profiling)
+					profile_charge(ctx, PROFILE_ETA, origin);
 			}
 
 			found_reduction = 1;
@@ -262,9 +426,30 @@ normal_order_reduction(struct lambda_expression *e)
 
 	} while (found_reduction);
 
+	divergence_end(divergence);
+
+	if (ctx->binary_trace)
+		trace_record(ctx, TRACE_END, rs->beta_steps + rs->eta_steps, NULL, 0, 0,
+			rs->limited? TRACE_LIMITED: 0);
+
 	return e;
 }
 
+/* Delta-reduction during normal_order_reduction(), noted in traces
+ * and profiles */
+static struct lambda_expression *
+delta_reduce(struct lc_context *ctx, struct lambda_expression *ref)
+{
+	const char *name = ref->abbreviation->name;
+	struct lambda_expression *r = expand_abbreviation(ctx, ref);
+	LC_PROBE_EXPAND(nodes_allocated(ctx), name);
+	if (ctx->binary_trace)
+		trace_record(ctx, TRACE_DELTA, 0, name, 0, 0, 0);
+	if (ctx->profiling)
+		profile_charge(ctx, PROFILE_EXPANSION, name);
+	return r;
+}
+
 void read_line(void)
 {
 	char buf[128];
@@ -274,66 +459,107 @@ void read_line(void)
 /* Depth-first traversal of a binary tree of structs lambda_expression,
  * which represents the current state of the term undergoing reductions.
  * Find a Beta or Eta reduction, and fill in a struct application_data
- * appropriately.
+ * appropriately.  Abstraction bodies and rands come last, so descending
+ * into them loops instead of recursing: a long chain like a big Church
+ * numeral's doesn't use up the C stack.
  */
 struct application_data
 find_redex(
+	struct lc_context *ctx,
 	struct lambda_expression *e,
-	struct lambda_expression **holder
+	struct lambda_expression **holder,
+	int depth,
+	uint64_t path
 )
 {
 	struct application_data r;
-	r.found = 0;
-	r.parent = NULL;
-	switch (e->typ)
+
+	for (;;)
 	{
-	case VARIABLE:
 		r.found = 0;
 		r.application = NULL;
 		r.parent = NULL;
-		break;
+		r.depth = depth;
+		r.path = path;
 
-	case ABSTRACTION:
-		if (eta_reduction)
+		switch (e->typ)
 		{
-			if (APPLICATION == e->body->typ)
+		case VARIABLE:
+			return r;
+
+		case ABSTRACTION:
+			while (ABBREVIATION == e->body->typ)
+				e->body = delta_reduce(ctx, e->body);
+			/* A repeated application's real rand is an application */
+			if (ctx->eta_reduction && APPLICATION == e->body->typ && !e->body->repeat)
 			{
-				if (VARIABLE == e->body->rand->typ && e->body->rand->variable == e->bound_variable)
+				struct lambda_expression *rand = abbreviation_definition(e->body->rand);
+				if (VARIABLE == rand->typ && rand->variable == e->bound_variable)
 				{
-					struct small_hashtable *my_free_vars = init_small_hashtable(16);
-					struct small_hashtable *my_bound_vars = init_small_hashtable(16);
-					find_free_vars(e->body->rator, my_bound_vars, my_free_vars);
+					struct small_hashtable *my_free_vars = init_small_hashtable(ctx, 16);
+					struct small_hashtable *my_bound_vars = init_small_hashtable(ctx, 16);
+					find_free_vars(ctx, e->body->rator, my_bound_vars, my_free_vars);
 					if (NULL == find_node(my_free_vars, e->bound_variable))
 					{
 						r.found = 1;
 						r.typ = ETA_REDEX;
 						r.application = e->body->rator;
-						e->body->rator = NULL;
 						r.parent = holder;
 					}
-					free_small_hashtable(my_free_vars);
-					free_small_hashtable(my_bound_vars);
+					free_small_hashtable(ctx, my_free_vars);
+					free_small_hashtable(ctx, my_bound_vars);
 				}
 			}
+			/* Should a complimentary beta_reduction variable and choice exist? */
+			if (r.found)
+				return r;
+			holder = &e->body;
+			path = PATH_TO(path, depth, TRACE_BODY);
+			++depth;
+			e = e->body;
+			break;
+
+		case APPLICATION:
+			/* Reduction has got to a repeated application: unfolding
+			 * it takes nodes, so it stops at the session's node_limit
+			 * like a step would. */
+			if (e->repeat)
+			{
+				if (ctx->node_limit
+					&& nodes_allocated(ctx) - nodes_freed(ctx) > ctx->node_limit)
+				{
+					r.found = 1;
+					r.typ = UNFOLDING;
+					return r;
+				}
+				unfold_application(ctx, e);
+			}
+			/* Delta-reduce an abbreviation in the head position: that's
+			 * the only time its definition gets copied in. */
+			while (ABBREVIATION == e->rator->typ)
+				e->rator = delta_reduce(ctx, e->rator);
+			if (ABSTRACTION == e->rator->typ)
+			{
+				r.found = 1;
+				r.typ = BETA_REDEX;
+				r.application = e;
+				r.parent = holder;
+				return r;
+			}
+			r = find_redex(ctx, e->rator, &e->rator, depth + 1, PATH_TO(path, depth, TRACE_RATOR));
+			if (r.found)
+				return r;
+			while (ABBREVIATION == e->rand->typ)
+				e->rand = delta_reduce(ctx, e->rand);
+			holder = &e->rand;
+			path = PATH_TO(path, depth, TRACE_RAND);
+			++depth;
+			e = e->rand;
+			break;
+
+		case ABBREVIATION:
+			/* Parent expands these before descending */
+			return r;
 		}
-		/* Should a complimentary beta_reduction variable and choice exist? */
-		if (!r.found) 
-			r = find_redex(e->body, &e->body);
-		break;
-
-	case APPLICATION:
-		if (ABSTRACTION == e->rator->typ)
-		{
-			r.found = 1;
-			r.typ = BETA_REDEX;
-			r.application = e;
-			r.parent = holder;
-		} else {
-			r = find_redex(e->rator, &e->rator);
-			if (!r.found)
-				r = find_redex(e->rand, &e->rand);
-		}
-		break;
 	}
-	return r;
 }
@@ -20,4 +20,12 @@
 */
 /* $Id: evaluation.h,v 1.11 2011/11/12 17:30:35 bediger Exp $ */
 
-struct lambda_expression *normal_order_reduction(struct lambda_expression *e);
+/* struct reduction_state lives in context.h, as sessions keep one */
+
+double monotonic_seconds(void);
+void init_reduction_state(struct reduction_state *rs, long step_limit);
+struct lambda_expression *normal_order_reduction(
+	struct lc_context *ctx,
+	struct lambda_expression *e,
+	struct reduction_state *rs
+);
@@ -39,15 +39,18 @@
  */
 
 #include <stdio.h>
-#include <stdlib.h>    /* atoi() */
-#include <unistd.h>    /* getopt() */
+#include <stdlib.h>    /* malloc(), free() */
+#include <unistd.h>    /* alarm() */
 #include <errno.h>     /* errno manifest constant */
 #include <string.h>    /* strerror() */
 #include <sys/time.h>  /* gettimeofday() */
 #include <signal.h>    /* signal(), etc */
-#include <setjmp.h>    /* setjmp(), longjmp(), jmp_buf */
+#include <sys/types.h>
+#include <sys/stat.h>  /* stat() */
+#include <stdint.h>    /* uint64_t, for trace.h */
 
 
+#include <context.h>
 #include <parser.h>    /* shared type between lex.l, grammar.y */
 #include <buffer.h>
 #include <small_hashtable.h>
@@ -56,69 +59,83 @@
 #include <atom.h>
 #include <evaluation.h>
 #include <abbreviations.h>
+#include <image.h>
+#include <writer.h>
+#include <trace.h>
+#include <profile.h>
+#include <json.h>
+#include <typed.h>
+#include <probes.h>
 
-void usage(char *progname);
-void top_level_cleanup(void);
+/* The parser's stack lives on the heap and grows as needed.  The
+ * usual 10000-entry limit is too small for machine-generated terms,
+ * which can nest parentheses and abstractions millions deep. */
+#define YYMAXDEPTH 100000000
+
+void top_level_cleanup(struct lc_context *ctx);
 
-void start_clock(void);
-void stop_clock(void);
 float elapsed_time(struct timeval before, struct timeval after);
-void free_lambda_expression(void *data);
 
 enum expressionEvaluationResults {NORMAL_FORM, INTERRUPT, TIMEOUT, REDUCTION_LIMIT};
-struct lambda_expression *reduce_expression(struct lambda_expression *e, enum expressionEvaluationResults *eer);
-
-struct lambda_expression *abstraction_from_list(struct lambda_expression * list, struct lambda_expression *body);
-
-extern void push_and_open(const char *filename);
-
-int prompting = 1;
-int looking_for_filename = 0;
-int found_binary_command = 0;
-
-int perform_timing = 0;
-int reduction_timeout = 0;   /* how long to let a graph reduction run, seconds */
-int eta_reduction = 1;
-int trace_eval = 0;
-int single_step = 0;
-
-static struct timeval before, after;
+struct lambda_expression *reduce_expression(
+	struct lc_context *ctx,
+	struct lambda_expression *e,
+	struct reduction_state *rs,
+	enum expressionEvaluationResults *eer
+);
+void finish_reduction(
+	struct lc_context *ctx,
+	struct lambda_expression *e,
+	struct reduction_state *rs,
+	enum expressionEvaluationResults eer,
+	float seconds
+);
+void continue_reduction(struct lc_context *ctx);
+void prenormalize_abbreviation(struct lc_context *ctx, struct abbreviation *a);
+char *compiled_name(const char *filename);
+int interpret_line(struct lc_context *ctx, const char *line, int length, int lineno);
+int load_file(struct lc_context *ctx, const char *filename);
+void take_signals(struct lc_context *ctx);
+void print_to_file(struct lc_context *ctx, const char *filename, struct lambda_expression *e);
+
+struct lambda_expression *abstraction_from_list(struct lc_context *ctx, struct lambda_expression * list, struct lambda_expression *body);
+
+extern void push_and_open(struct lc_context *ctx, const char *filename);
 
 /* from lex.l */
-extern void set_yyin_stdin(void);
-extern void set_yyin(const char *filename);
-extern void reset_yyin(void);
+extern void set_yyin_stdin(struct lc_context *ctx);
+extern void set_yyin_stream(struct lc_context *ctx, FILE *fin, const char *name);
+extern void reset_yyin(struct lc_context *ctx);
 
 /* keep compilers from complaining */
-extern int yylex(void);
-int yyerror(const char *s1);
-extern int yyparse(void);
-extern char *optarg;
-
-struct filename_node {
-	const char *filename;
-	struct filename_node *next;
-};
-
-struct lambda_expression *previous_result = NULL;
+int yyerror(struct lc_context *ctx, void *scanner, const char *s1);
 
 #ifdef YYBISON
 #define YYERROR_VERBOSE
 #endif
 
-/* Signal handling.
+/* Signal handling.  Signals belong to the whole process, so only one
+ * session, the one lc.c's main() runs, takes Control-C and the -t timeout.
+ * The handler only sets that session's interrupt_requested, which
+ * normal_order_reduction() checks between steps.
  */
 void sigint_handler(int signo);
-sigjmp_buf in_reduce_expression;
-int interpreter_interrupted = 0;  /* communicate with free_all() */
+static struct lc_context *volatile signalled_context = NULL;
 %}
 
+/* No globals: the parser and the scanner keep their state in the
+ * session's struct lc_context, and in the scanner it holds. */
+%define api.pure
+%parse-param {struct lc_context *ctx}
+%parse-param {void *scanner}
+%lex-param {void *scanner}
+
 %union{
 	const char *string_constant;
 	const char *identifier;
 	struct lambda_expression *term;
 	enum ModifiableCommands cmd;
-	int number;
+	long number;
 }
 
 
@@ -126,11 +143,14 @@ int interpreter_interrupted = 0;  /* communicate with free_all() */
 %token TK_LBRACE TK_RBRACE 
 %token <identifier> TK_IDENTIFIER TK_RESULT
 %token <string_constant> FILE_NAME
-%token TK_LAMBDA TK_DOT TK_STAR
+%token TK_LAMBDA TK_DOT TK_STAR TK_REDIRECT
 %token TK_EOL
-%token TK_DEF TK_NORMALIZE TK_FREE TK_BOUND TK_LOAD
-%token TK_TIMER TK_TRACE TK_STEP TK_ETA
-%token TK_GOEDELIZE TK_LEXICALLY_EQUIVALENT TK_ALPHA_EQUIVALENT
+%token TK_REQUEST
+%token TK_DEF TK_NORMALIZE TK_FREE TK_BOUND TK_LOAD TK_SAVE
+%token TK_CONTINUE TK_SUSPENDED TK_CHECKPOINT TK_RESUME
+%token TK_TIMER TK_TRACE TK_STEP TK_ETA TK_PRENORMALIZE TK_PROFILE TK_DIVERGENCE
+%token TK_TYPED TK_TYPE
+%token TK_GOEDELIZE TK_UNGOEDELIZE TK_LEXICALLY_EQUIVALENT TK_ALPHA_EQUIVALENT
 %token <term> TK_PRINT TK_LAST_RESULT
 %token <string_constant> BINARY_MODIFIER
 %token <number> NUMBER
@@ -140,13 +160,30 @@ int interpreter_interrupted = 0;  /* communicate with free_all() */
 %type <term> interpreter_command
 %type <cmd> modifiable_command
 
+%code {
+/* from lex.l, generated with "%option reentrant bison-bridge" */
+extern int yylex(YYSTYPE *yylval, void *scanner);
+}
+
 %%
 
+/* Input is statements, except that liblc.c can have the scanner hand
+ * out TK_REQUEST first.  Then it's one expression, parsed but not
+ * evaluated, and nothing after it, not even after a syntax error,
+ * gets parsed as a statement. */
+input
+	: program
+	| TK_REQUEST expression { ctx->request = $2; }
+	| TK_REQUEST expression TK_EOL { ctx->request = $2; }
+	| TK_REQUEST error { YYABORT; }
+	;
+
 /* "Loop" part of read-eval-print loop. */
 program
-	: stmnt { top_level_cleanup(); }
-	| program stmnt  { top_level_cleanup(); }
+	: stmnt { top_level_cleanup(ctx); }
+	| program stmnt  { top_level_cleanup(ctx); }
 	| error  /* magic token - yacc unwinds to here on most syntax errors */
+		{ if (ctx->parse_request) YYABORT; }
 	;
 
 stmnt
@@ -154,118 +191,274 @@ stmnt
 			/* Eval and print parts of read-eval-print loop. */
 			struct lambda_expression *p = NULL;
 			enum expressionEvaluationResults eer = NORMAL_FORM;
-			start_clock();
-			p = reduce_expression($1, &eer);
-			stop_clock();
-			if (INTERRUPT != eer)
-			{
-				print_expression(p);
-				if (previous_result)
-					free_expression(previous_result);
-				previous_result = p;
-			} else
-				free_expression(p); /* previous_result remains the same */
-			if (perform_timing)
-				printf("Elapsed: %.3f seconds\n", elapsed_time(before, after));
+			struct reduction_state rs;
+			struct timeval before, after;
+			init_reduction_state(&rs, ctx->step_limit);
+			rs.top_level = 1;
+			gettimeofday(&before, NULL);
+			p = reduce_expression(ctx, $1, &rs, &eer);
+			gettimeofday(&after, NULL);
+			++ctx->output_statements;
+			finish_reduction(ctx, p, &rs, eer, elapsed_time(before, after));
 		}
 	| TK_DEF TK_IDENTIFIER expression TK_EOL
 		{
-			struct lambda_expression *prev = abbreviation_add($2, $3);
-			if (prev) free_expression(prev);
+			struct abbreviation *a = abbreviation_add(ctx, $2, $3);
+			if (ctx->prenormalize) prenormalize_abbreviation(ctx, a);
 		}
 	| TK_DEF TK_IDENTIFIER TK_LBRACE TK_STAR TK_RBRACE expression TK_EOL
 		{
-			struct lambda_expression *prev = abbreviation_add($2, $6);
-			if (prev) free_expression(prev);
+			(void)abbreviation_add(ctx, $2, $6);
 		}
 	| TK_EOL  { $$ = NULL; } /* allow empty line(s) following non-empty-line stmnt */
-	| interpreter_command
+	| interpreter_command { ++ctx->output_statements; }
 	;
 
 interpreter_command
 	: modifiable_command BINARY_MODIFIER TK_EOL {
 			int command = (($2 == Atom_string("on"))? 1: 0);
-			found_binary_command = 0;
+			ctx->found_binary_command = 0;
 
 			switch ($1)
 			{
-			case CMD_TIMER: perform_timing = command; break;
-			case CMD_TRACE: trace_eval     = command; break;
-			case CMD_STEP:  single_step    = command; break;
-			case CMD_ETA:   eta_reduction  = command; break;
+			case CMD_TIMER: ctx->perform_timing = command; break;
+			case CMD_TRACE:
+				ctx->trace_eval = command;
+				if (!command) trace_close(ctx);
+				break;
+			case CMD_STEP:  ctx->single_step    = command; break;
+			case CMD_PROFILE: ctx->profiling    = command; break;
+			case CMD_ETA:
+				ctx->eta_reduction  = command;
+				ctx->settings_made |= IMAGE_ETA;
+				--ctx->output_statements;
+				break;
+			case CMD_PRENORMALIZE:
+				ctx->prenormalize = command;
+				ctx->settings_made |= IMAGE_PRENORMALIZE;
+				--ctx->output_statements;
+				break;
+			case CMD_CHECKPOINT:
+				if (command)
+					statement_error(ctx, "Use \"checkpoint N > filename\"");
+				else
+					ctx->checkpoint_every = 0;
+				break;
+			case CMD_DIVERGENCE:
+				ctx->detect_divergence = command;
+				ctx->settings_made |= IMAGE_DIVERGENCE;
+				--ctx->output_statements;
+				break;
+			case CMD_TYPED:
+				ctx->typed_evaluation = command;
+				ctx->settings_made |= IMAGE_TYPED;
+				--ctx->output_statements;
+				break;
 			}
 		}
+	| modifiable_command NUMBER TK_EOL {
+			ctx->found_binary_command = 0;
+			if (CMD_PRENORMALIZE == $1)
+			{
+				ctx->prenormalize_budget = $2;
+				ctx->prenormalize = 1;
+				ctx->settings_made |= IMAGE_PRENORMALIZE;
+				--ctx->output_statements;
+			} else if (CMD_CHECKPOINT == $1) {
+				if (ctx->checkpoint_file)
+					ctx->checkpoint_every = $2;
+				else
+					statement_error(ctx, "Use \"checkpoint N > filename\"");
+			} else
+				statement_error(ctx, "Use \"on\" or \"off\", not a number");
+		}
+	| modifiable_command TK_REDIRECT {ctx->looking_for_filename = 1;} FILE_NAME TK_EOL {
+			ctx->found_binary_command = 0;
+			ctx->looking_for_filename = 0;
+			if (CMD_TRACE == $1)
+				(void)trace_open(ctx, $4);
+			else
+				statement_error(ctx, "Only \"trace\" output can go to a file");
+		}
+	| modifiable_command NUMBER TK_REDIRECT {ctx->looking_for_filename = 1;} FILE_NAME TK_EOL {
+			ctx->found_binary_command = 0;
+			ctx->looking_for_filename = 0;
+			if (CMD_CHECKPOINT == $1)
+			{
+				ctx->checkpoint_every = $2;
+				ctx->checkpoint_file = $5;
+			} else
+				statement_error(ctx, "Only \"checkpoint\" takes a number and a file");
+		}
 	| modifiable_command TK_EOL {
 			const char *phrase = "boojum snark";
 			const char *state = "unset";
-			found_binary_command = 0;
+			ctx->found_binary_command = 0;
 			switch ($1)
 			{
 			case CMD_TIMER: 
 				phrase = "Evaluation timing";
-				state = perform_timing? "on": "off";
+				state = ctx->perform_timing? "on": "off";
 				break;
 			case CMD_TRACE:
 				phrase = "Evaluation tracing";
-				state = trace_eval? "on": "off";
+				state = ctx->trace_eval? "on": "off";
+				if (ctx->binary_trace) state = "binary, to a file";
 				break;
 			case CMD_STEP:
 				phrase = "Single stepping";
-				state = single_step? "on": "off";
+				state = ctx->single_step? "on": "off";
+				break;
+			case CMD_PROFILE:
+				phrase = "Profiling";
+				state = ctx->profiling? "on": "off";
 				break;
 			case CMD_ETA:
 				phrase = "Eta reduction";
-				state = eta_reduction? "on": "off";
+				state = ctx->eta_reduction? "on": "off";
+				break;
+			case CMD_PRENORMALIZE:
+				phrase = "Prenormalizing abbreviations";
+				state = ctx->prenormalize? "on": "off";
+				break;
+			case CMD_CHECKPOINT:
+				phrase = "Checkpointing";
+				state = ctx->checkpoint_every? ctx->checkpoint_file: "off";
+				break;
+			case CMD_DIVERGENCE:
+				phrase = "Divergence detection";
+				state = ctx->detect_divergence? "on": "off";
+				break;
+			case CMD_TYPED:
+				phrase = "Typed evaluation";
+				state = ctx->typed_evaluation? "on": "off";
 				break;
 			}
 
-			printf("%s: %s\n", phrase, state);
+			fprintf(ctx->out, "%s: %s\n", phrase, state);
+			if (CMD_PRENORMALIZE == $1 && ctx->prenormalize)
+				fprintf(ctx->out, "Budget: %ld steps\n", ctx->prenormalize_budget);
+			if (CMD_CHECKPOINT == $1 && ctx->checkpoint_every)
+				fprintf(ctx->out, "Every: %ld steps\n", ctx->checkpoint_every);
+			if (CMD_TYPED == $1)
+				fprintf(ctx->out, "Fast path: %ld of %ld typable reductions\n",
+					ctx->fast_paths, ctx->typed_reductions);
+		}
+	| TK_LOAD {ctx->looking_for_filename = 1;} FILE_NAME TK_EOL
+		{
+			ctx->looking_for_filename = 0;
+			if (!load_compiled(ctx, $3))
+				push_and_open(ctx, $3);
+		}
+	| TK_SAVE {ctx->looking_for_filename = 1;} FILE_NAME TK_EOL
+		{
+			ctx->looking_for_filename = 0;
+			(void)write_image(ctx, $3, 0, ctx->previous_result, ctx->suspended, &ctx->suspended_state,
+				NULL, IMAGE_ALL_SETTINGS);
+		}
+	| TK_RESUME {ctx->looking_for_filename = 1;} FILE_NAME TK_EOL
+		{
+			ctx->looking_for_filename = 0;
+			if (ctx->suspended)
+				free_expression(ctx, ctx->suspended);
+			ctx->suspended = NULL;
+			if (0 == read_image(ctx, $3, &ctx->previous_result, &ctx->suspended, &ctx->suspended_state, NULL))
+			{
+				if (ctx->suspended)
+					continue_reduction(ctx);
+				else
+					fprintf(ctx->out, "No reduction in \"%s\"\n", $3);
+			}
+		}
+	| TK_CONTINUE TK_EOL
+		{
+			if (ctx->suspended)
+				continue_reduction(ctx);
+			else
+				fprintf(ctx->out, "No reduction to continue\n");
+		}
+	| TK_SUSPENDED TK_EOL
+		{
+			if (ctx->suspended)
+			{
+				fprintf(ctx->out, "Suspended after %ld steps:\n",
+					ctx->suspended_state.beta_steps + ctx->suspended_state.eta_steps);
+				print_expression(ctx, ctx->suspended);
+			} else
+				fprintf(ctx->out, "No reduction suspended\n");
+		}
+	| TK_PRINT expression TK_EOL { print_expression(ctx, $2); free_expression(ctx, $2); }
+	| TK_PRINT TK_REDIRECT {ctx->looking_for_filename = 1;} FILE_NAME {ctx->looking_for_filename = 0;} expression TK_EOL
+		{
+			print_to_file(ctx, $4, $6);
+			free_expression(ctx, $6);
+		}
+	| TK_TYPE expression TK_EOL
+		{
+			struct buffer *b = new_buffer(128);
+			switch (type_of(ctx, $2, b))
+			{
+			case TYPE_FOUND:
+				fprintf(ctx->out, "%s\n", b->buffer);
+				break;
+			case TYPE_NONE:
+				fprintf(ctx->out, "No simple type\n");
+				break;
+			case TYPE_UNKNOWN:
+				fprintf(ctx->out, "Type too big to work out\n");
+				break;
+			}
+			delete_buffer(b);
+			free_expression(ctx, $2);
 		}
-	| TK_LOAD {looking_for_filename = 1;} FILE_NAME TK_EOL { looking_for_filename = 0; push_and_open($3); }
-	| TK_PRINT expression TK_EOL { print_expression($2); free_expression($2); }
 	| TK_FREE TK_IDENTIFIER TK_EOL
 		{
-			struct lambda_expression *e = abbreviation_lookup($2);
+			struct lambda_expression *e = abbreviation_lookup(ctx, $2);
 			if (!e)
-				e = new_variable($2);
-			free_vars(e);
-			free_expression(e);
+				e = new_variable(ctx, $2);
+			free_vars(ctx, e);
+			free_expression(ctx, e);
 		}
 	| TK_BOUND TK_IDENTIFIER TK_EOL
 		{
-			struct lambda_expression *e = abbreviation_lookup($2);
+			struct lambda_expression *e = abbreviation_lookup(ctx, $2);
 			if (!e)
-				e = new_variable($2);
-			bound_vars(e);
-			free_expression(e);
+				e = new_variable(ctx, $2);
+			bound_vars(ctx, e);
+			free_expression(ctx, e);
 		}
 	| expression TK_LEXICALLY_EQUIVALENT expression TK_EOL
 		{
 			if (equivalent_graphs($1, $3))
-				printf("Equivalent\n");
+				fprintf(ctx->out, "Equivalent\n");
 			else
-				printf("Not equivalent\n");
-			free_expression($1);
-			free_expression($3);
+				fprintf(ctx->out, "Not equivalent\n");
+			free_expression(ctx, $1);
+			free_expression(ctx, $3);
 			$1 = $3 = NULL;
 		}
 	| expression TK_ALPHA_EQUIVALENT expression TK_EOL
 		{
-			if (alpha_equivalent_graphs($1, $3))
-				printf("Alpha Equivalent\n");
+			if (alpha_equivalent_graphs(ctx, $1, $3))
+				fprintf(ctx->out, "Alpha Equivalent\n");
 			else
-				printf("Not alpha equivalent\n");
-			free_expression($1);
-			free_expression($3);
+				fprintf(ctx->out, "Not alpha equivalent\n");
+			free_expression(ctx, $1);
+			free_expression(ctx, $3);
 			$1 = $3 = NULL;
 		}
 	;
 
 modifiable_command
-	: TK_TIMER { found_binary_command = 1; $$ = CMD_TIMER;}
-	| TK_TRACE { found_binary_command = 1; $$ = CMD_TRACE;}
-	| TK_STEP  { found_binary_command = 1; $$ = CMD_STEP; }
-	| TK_ETA   { found_binary_command = 1; $$ = CMD_ETA; }
+	: TK_TIMER { ctx->found_binary_command = 1; $$ = CMD_TIMER;}
+	| TK_TRACE { ctx->found_binary_command = 1; $$ = CMD_TRACE;}
+	| TK_STEP  { ctx->found_binary_command = 1; $$ = CMD_STEP; }
+	| TK_ETA   { ctx->found_binary_command = 1; $$ = CMD_ETA; }
+	| TK_PRENORMALIZE { ctx->found_binary_command = 1; $$ = CMD_PRENORMALIZE; }
+	| TK_PROFILE { ctx->found_binary_command = 1; $$ = CMD_PROFILE; }
+	| TK_CHECKPOINT { ctx->found_binary_command = 1; $$ = CMD_CHECKPOINT; }
+	| TK_DIVERGENCE { ctx->found_binary_command = 1; $$ = CMD_DIVERGENCE; }
+	| TK_TYPED { ctx->found_binary_command = 1; $$ = CMD_TYPED; }
 	;
 
 expression
@@ -274,23 +467,35 @@ expression
 	| TK_NORMALIZE expression
 		{
 			enum expressionEvaluationResults eer;
-			$$ = reduce_expression($2, &eer);
+			struct reduction_state rs;
+			init_reduction_state(&rs, ctx->step_limit);
+			$$ = reduce_expression(ctx, $2, &rs, &eer);
 		}
 	| TK_GOEDELIZE expression
-		{ $$ = goedelize($2); free_expression($2); }
+		{ $$ = goedelize(ctx, $2); free_expression(ctx, $2); }
+	| TK_UNGOEDELIZE expression
+		{
+			$$ = ungodelize(ctx, $2);
+			free_expression(ctx, $2);
+			if (NULL == $$)
+			{
+				statement_error(ctx, "Not a godelized term");
+				YYERROR;
+			}
+		}
 	;
 
 abstraction
 	: TK_LAMBDA list error
 		{
 			/* More or less empirically discovered that this can leak. */
-			free_expression($2);
+			free_expression(ctx, $2);
 			YYERROR;
 		}
 	| TK_LAMBDA list TK_DOT expression
 		{
-			$$ = abstraction_from_list($2, $4);
-			free_expression($2);
+			$$ = abstraction_from_list(ctx, $2, $4);
+			free_expression(ctx, $2);
 			if (NULL == $$) YYERROR;
 		}
 	| TK_STAR abstraction
@@ -302,16 +507,16 @@ abstraction
 
 list
 	: item      { $$ = $1; }
-	| list item { $$ = new_application($1, $2); }
-	| list abstraction { $$ = new_application($1, $2); }
+	| list item { $$ = new_application(ctx, $1, $2); }
+	| list abstraction { $$ = new_application(ctx, $1, $2); }
 	;
 
 item
 	: TK_IDENTIFIER
 		{
-			$$ = abbreviation_lookup($1);
+			$$ = abbreviation_reference(ctx, $1);
 			if (!$$)
-				$$ = new_variable($1);
+				$$ = new_variable(ctx, $1);
 		}
 	| TK_STAR item 
 		{
@@ -320,17 +525,17 @@ item
 		}
 	| TK_IDENTIFIER TK_LBRACE NUMBER TK_RBRACE
 		{
-			struct lambda_expression *p = abbreviation_lookup($1);
+			struct lambda_expression *p = abbreviation_lookup(ctx, $1);
 			if (!p)
-				$$ = new_variable($1);
+				$$ = new_variable(ctx, $1);
 			else {
-				$$ = deparameterize(p, $3);
+				$$ = deparameterize(ctx, p, $3);
 			}
 		}
 	| TK_RESULT
 		{
-			if (previous_result)
-				$$ = copy_expression(previous_result);
+			if (ctx->previous_result)
+				$$ = copy_expression(ctx, ctx->previous_result);
 			else
 				YYERROR;
 		}
@@ -341,245 +546,436 @@ item
 %%
 
 void
-usage(char *progname)
+top_level_cleanup(struct lc_context *ctx)
 {
-	fprintf(stderr, "%s: lambda calculater\n", progname);
-	fprintf(stderr, "Flags:\n");
-	fprintf(stderr, "  -L <filename>   read and evaluate filename before accepting user input.\n");
-	fprintf(stderr, "  -p              don't do any prompting.\n");
+	ctx->interrupt_requested = 0;
+	profile_report(ctx);
+	if (ctx->json) json_statement_end(ctx);
+	if (ctx->prompting) fprintf(ctx->out, "LC> ");
 }
 
-void
-top_level_cleanup(void)
+int
+yyerror(struct lc_context *ctx, void *scanner, const char *s1)
 {
-	if (prompting) printf("LC> ");
+	(void)scanner;
+	if (ctx->embedded)
+		snprintf(ctx->error, sizeof(ctx->error), "%s", s1);
+	else
+		fprintf(stderr, "%s\n", s1);
+	if (ctx->json)
+		json_error(ctx, s1);
+	++ctx->output_statements;
+	ctx->interrupt_requested = 0;
+
+    return 0;
 }
 
+float
+elapsed_time(struct timeval b4, struct timeval aftr)
+{
+	float r = 0.0;
+
+    if (b4.tv_usec > aftr.tv_usec)
+	{
+		aftr.tv_usec += 1000000;
+		--aftr.tv_sec;
+	}
+
+	r = (float)(aftr.tv_sec - b4.tv_sec)
+		+ (1.0E-6)*(float)(aftr.tv_usec - b4.tv_usec);
+
+	return r;
+}
+
+/* Parse and evaluate the statements of a file, or read its compiled
+ * image.  Returns 0, or 1 if the file couldn't be read or had a
+ * syntax error bad enough to stop parsing. */
 int
-main(int ac, char **av)
+load_file(struct lc_context *ctx, const char *filename)
 {
-	int r, c;
-	struct hashtable *h = new_hashtable(free_lambda_expression);
-	struct filename_node *p;
-	struct filename_node *load_files = NULL, *load_tail = NULL;
+	FILE *fin;
+	struct loading loading;
+	int r;
 
-	/* "Atoms" and abbreviations kept in the same struct hashtable. */
-	setup_atom_table(h);
-	setup_abbreviation_table(h);
+	if (load_compiled(ctx, filename))
+		return 0;
 
-	while (-1 != (c = getopt(ac, av, "L:p")))
+	if (!(fin = fopen(filename, "r")))
 	{
-		switch (c)
-		{
-		case 'L':
-			p = malloc(sizeof(*p));
-			p->filename = Atom_string(optarg);
-			p->next = NULL;
-			if (load_tail)
-				load_tail->next = p;
-			load_tail = p;
-			if (!load_files)
-				load_files = p;
-			break;
-		case 'p':
-			prompting = 0;
-			break;
-		default:
-			usage(av[0]);
-			exit(1);
-			break;
-		}
+		statement_error(ctx, "Problem reading \"%s\": %s",
+			filename, strerror(errno));
+		return 1;
 	}
 
-	if (load_files)
-	{
-		struct filename_node *t, *z;
-		for (z = load_files; z; z = t)
-		{
-			FILE *fin;
+	set_yyin_stream(ctx, fin, filename);
 
-			t = z->next;
+	start_loading(ctx, &loading);
 
-			printf("load file named \"%s\"\n",
-				z->filename);
+	r = yyparse(ctx, ctx->scanner);
 
-			if (!(fin = fopen(z->filename, "r")))
-			{
-				fprintf(stderr, "Problem reading \"%s\": %s\n",
-					z->filename, strerror(errno));
-				continue;
-			}
+	reset_yyin(ctx);
 
-			set_yyin(z->filename);
+	if (r)
+		fprintf(ctx->out, "Problem with file \"%s\"\n", filename);
+	else
+		finish_loading(ctx, filename, &loading);
 
-			r = yyparse();
+	return r? 1: 0;
+}
 
-			reset_yyin();
+/* ctx gets Control-C and the -t timeout */
+void
+take_signals(struct lc_context *ctx)
+{
+	signalled_context = ctx;
+}
 
-			if (r)
-				printf("Problem with file \"%s\"\n", z->filename);
+/* Parse and evaluate statements from a string instead of a file.
+ * Batch mode runs each line of input through this, in a worker
+ * process or, for "define" and the like, in the parent.  lineno
+ * is the line the string starts on. */
+int
+interpret_line(struct lc_context *ctx, const char *line, int length, int lineno)
+{
+	int r;
+	/* fmemopen() doesn't write a buffer opened "r", but takes it non-const */
+	union { const char *text; void *buffer; } in;
+	FILE *fin;
 
-			free(z);
-			fin = NULL;
-		}
+	in.text = line;
+	fin = fmemopen(in.buffer, length, "r");
+
+	if (!fin)
+	{
+		fprintf(stderr, "Problem reading statement: %s\n", strerror(errno));
+		return 1;
 	}
 
-	set_yyin_stdin();
+	set_yyin_stream(ctx, fin, "stdin");
+	ctx->lineno = lineno;
 
 	do {
-		if (prompting) printf("LC> ");
-		r =  yyparse();
+		r = yyparse(ctx, ctx->scanner);
 	} while (r);
-	if (prompting) printf("\n");
-
-	if (previous_result) free_expression(previous_result);
-
-	free_hashtable(h);
-	free_all_small_hashtable();
-	free_all();
 
-	reset_yyin();
+	reset_yyin(ctx);
 
 	return r;
 }
 
-int
-yyerror(const char *s1)
+/* "print > filename expression".  Text of the expression goes out a
+ * chunk at a time, to the file or to the writer thread, and never has
+ * to fit in memory all at once. */
+void
+print_to_file(struct lc_context *ctx, const char *filename, struct lambda_expression *e)
 {
-    fprintf(stderr, "%s\n", s1);
+	struct buffer *b;
+	FILE *fp = NULL;
 
-    return 0;
+	if (ctx->asynchronous_output)
+	{
+		writer_open(ctx, filename);
+		b = new_buffer(PRINT_CHUNK_SIZE);
+		b->drain = drain_to_writer;
+		b->sink = ctx;
+	} else {
+		if (NULL == (fp = fopen(filename, "w")))
+		{
+			statement_error(ctx, "Could not open \"%s\" for write: %s",
+				filename, strerror(errno));
+			return;
+		}
+		b = new_stream_buffer(fp, PRINT_CHUNK_SIZE);
+	}
+
+	buffer_expression(e, b);
+	buffer_append(b, "\n", 1);
+	flush_buffer(b);
+	delete_buffer(b);
+
+	if (fp)
+		fclose(fp);
+	else
+		writer_close(ctx);
 }
 
-void
-start_clock(void)
+/*
+ * A wrapper around normal_order_reduction() that, for the session that
+ * takes signals, sets and unsets signal handlers and starts a timer.  Control-C, the timer running out, or
+ * the step limit stop the reduction between two steps, and the term
+ * it returns is as far as reduction got.
+ */
+struct lambda_expression *
+reduce_expression(
+	struct lc_context *ctx,
+	struct lambda_expression *e,
+	struct reduction_state *rs,
+	enum expressionEvaluationResults *eer
+)
 {
-	gettimeofday(&before, NULL);
+	struct lambda_expression *r = NULL;
+	long beta_steps = rs->beta_steps, eta_steps = rs->eta_steps;
+
+	void (*old_sigint_handler)(int) = NULL;
+	void (*old_sigalm_handler)(int) = NULL;
+	int handle_signals = (ctx == signalled_context);
+
+	*eer = NORMAL_FORM;
+
+	if (handle_signals)
+	{
+		old_sigint_handler = signal(SIGINT, sigint_handler);
+		old_sigalm_handler = signal(SIGALRM, sigint_handler);
+		alarm(ctx->reduction_timeout);
+	}
+
+	LC_PROBE_REDUCE_START(nodes_allocated(ctx), nodes_freed(ctx));
+
+	r = normal_order_reduction(ctx, e, rs);
+
+	if (handle_signals)
+	{
+		alarm(0);
+		signal(SIGINT, old_sigint_handler);
+		signal(SIGALRM, old_sigalm_handler);
+	}
+
+	switch (rs->interrupted)
+	{
+	case 0:
+		if (rs->limited)
+			*eer = REDUCTION_LIMIT;
+		break;
+	case 1:
+		*eer = INTERRUPT;
+		fprintf(ctx->out, "Interrupt\n");
+		break;
+	default:
+		*eer = TIMEOUT;
+		fprintf(ctx->out, "Timeout\n");
+		break;
+	}
+
+	ctx->total_beta_steps += rs->beta_steps - beta_steps;
+	ctx->total_eta_steps += rs->eta_steps - eta_steps;
+
+	LC_PROBE_REDUCE_END(rs->beta_steps, rs->eta_steps,
+		nodes_allocated(ctx), nodes_freed(ctx), (int)*eer);
+
+	return r;
 }
 
 void
-stop_clock(void)
+sigint_handler(int signo)
 {
-	gettimeofday(&after, NULL);
+	if (signalled_context)
+		signalled_context->interrupt_requested = (SIGINT == signo)? 1: 2;
 }
 
-float
-elapsed_time(struct timeval b4, struct timeval aftr)
+/* Print a normal form and make it $$, or keep a reduction that
+ * got stopped early for "continue".  With -J, the normal form goes
+ * in the statement's JSON object instead. */
+void
+finish_reduction(
+	struct lc_context *ctx,
+	struct lambda_expression *e,
+	struct reduction_state *rs,
+	enum expressionEvaluationResults eer,
+	float seconds
+)
 {
-	float r = 0.0;
+	if (ctx->json)
+	{
+		static const char *limits[] = {
+			"step_limit", "step_limit", "node_limit", "cycle", "growth"
+		};
+		const char *result = "normal";
+		switch (eer)
+		{
+		case NORMAL_FORM:     result = "normal"; break;
+		case INTERRUPT:       result = "interrupted"; break;
+		case TIMEOUT:         result = "timeout"; break;
+		case REDUCTION_LIMIT: result = limits[rs->limited]; break;
+		}
+		json_reduction(ctx, e, rs, result, seconds);
+	}
 
-    if (b4.tv_usec > aftr.tv_usec)
+	if (NORMAL_FORM == eer)
 	{
-		aftr.tv_usec += 1000000;
-		--aftr.tv_sec;
+		if (!ctx->json)
+			print_expression(ctx, e);
+		if (ctx->previous_result)
+			free_expression(ctx, ctx->previous_result);
+		ctx->previous_result = e;
+	} else {
+		if (REDUCTION_LIMIT == eer)
+			switch (rs->limited)
+			{
+			case 3:
+				fprintf(ctx->out, "Cycles with period %ld\n", rs->period);
+				break;
+			case 4:
+				fprintf(ctx->out, "Grows without bound, around a copy of itself every %ld steps\n", rs->period);
+				break;
+			default:
+				fprintf(ctx->out, "%s limit\n", (2 == rs->limited)? "Node": "Step");
+				break;
+			}
+		if (ctx->suspended)
+			free_expression(ctx, ctx->suspended);
+		ctx->suspended = e;
+		ctx->suspended_state = *rs;
+		fprintf(ctx->out, "Suspended after %ld steps, \"continue\" resumes\n",
+			rs->beta_steps + rs->eta_steps);
 	}
 
-	r = (float)(aftr.tv_sec - b4.tv_sec)
-		+ (1.0E-6)*(float)(aftr.tv_usec - b4.tv_usec);
+	if (ctx->perform_timing)
+		fprintf(ctx->out, "Elapsed: %.3f seconds\n", seconds);
+}
 
-	return r;
+/* Carry on with the suspended reduction, for "continue", "resume"
+ * and -R. */
+void
+continue_reduction(struct lc_context *ctx)
+{
+	struct lambda_expression *p = ctx->suspended;
+	enum expressionEvaluationResults eer = NORMAL_FORM;
+	struct reduction_state rs = ctx->suspended_state;
+	struct timeval before, after;
+
+	ctx->suspended = NULL;
+	/* A fresh step limit, counting from here */
+	rs.step_limit = ctx->step_limit? rs.beta_steps + rs.eta_steps + ctx->step_limit: 0;
+	rs.limited = 0;
+	rs.interrupted = 0;
+	rs.top_level = 1;
+	gettimeofday(&before, NULL);
+	p = reduce_expression(ctx, p, &rs, &eer);
+	gettimeofday(&after, NULL);
+	finish_reduction(ctx, p, &rs, eer, elapsed_time(before, after));
 }
 
-/*
- * A wrapper around normal_order_reduction() that sets and unset signal
- * handlers, starts a timer, and handles and longjmps that come back
- * from interrupted or timed-out evaluations.
+/* Work out the normal form of an abbreviation's definition now,
+ * within a budget of reduction steps, so that every later use of
+ * the abbreviation starts from it.  Definitions that don't reach
+ * a normal form within budget (Y, for one) get used as written.
  */
-struct lambda_expression *
-reduce_expression(struct lambda_expression *e, enum expressionEvaluationResults *eer)
+void
+prenormalize_abbreviation(struct lc_context *ctx, struct abbreviation *a)
 {
-	struct lambda_expression *r = NULL;
-	int cc;
+	enum expressionEvaluationResults eer = NORMAL_FORM;
+	struct reduction_state rs;
+	struct lambda_expression *nf;
 
-	*eer = NORMAL_FORM;
+	init_reduction_state(&rs, ctx->prenormalize_budget);
 
-	void (*old_sigint_handler)(int);
-	void (*old_sigalm_handler)(int);
+	nf = reduce_expression(ctx, copy_expression(ctx, a->expression), &rs, &eer);
 
-	old_sigint_handler = signal(SIGINT, sigint_handler);
-	old_sigalm_handler = signal(SIGALRM, sigint_handler);
+	if (NORMAL_FORM == eer && rs.beta_steps + rs.eta_steps > 0)
+		abbreviation_set_normal_form(ctx, a, nf);
+	else if (nf)
+		free_expression(ctx, nf);
+}
 
-	if (!(cc = sigsetjmp(in_reduce_expression, 1)))
-	{
-		alarm(reduction_timeout);
-		r = normal_order_reduction(e);
-		alarm(0);
-	} else {
-		const char *phrase = "Unset";
-		alarm(0);
-		switch (cc)
-		{
-		case 1:
-			phrase = "Interrupt";
-			*eer = INTERRUPT;
-			break;
-		case 2:
-			phrase = "Timeout";
-			*eer = TIMEOUT;
-			break;
-		default:
-			phrase = "Unknown";
-			*eer = INTERRUPT;
-			break;
-		}
-		++interpreter_interrupted;
-		printf("%s\n", phrase);
-	}
+/* Compiled image of file "x" lives in "x.lci" */
+char *
+compiled_name(const char *filename)
+{
+	char *r = malloc(strlen(filename) + 5);
+	sprintf(r, "%s.lci", filename);
+	return r;
+}
 
-	signal(SIGINT, old_sigint_handler);
-	signal(SIGALRM, old_sigalm_handler);
+/* With -C, read the compiled image of a file, rather than
+ * parsing the file, if the image is current.
+ * Returns 1 if it read an image. */
+int
+load_compiled(struct lc_context *ctx, const char *filename)
+{
+	struct stat st;
+	char *image_name;
+	int r = 0;
+
+	if (!ctx->use_compiled_files || stat(filename, &st))
+		return 0;
+
+	image_name = compiled_name(filename);
+	r = (0 == read_image(ctx, image_name, NULL, NULL, NULL, &st));
+	free(image_name);
 
 	return r;
 }
 
 void
-sigint_handler(int signo)
+start_loading(struct lc_context *ctx, struct loading *l)
 {
-	siglongjmp(in_reduce_expression, signo == SIGINT? 1: 2);
+	l->first_seq = abbreviation_sequence(ctx);
+	l->output_statements = ctx->output_statements;
+	l->settings_made = ctx->settings_made;
+	ctx->settings_made = 0;
 }
 
-/*
- * Passed in to the hashtable create & init function, adapts the
- * data type kept in hashtable to the data type of an abstract syntax
- * tree.
+/* With -C, a file that only defines abbreviations and changes
+ * settings gets an image of what it did written out next to it.
+ * A file that prints something, or loads another file, doesn't:
+ * reading its image wouldn't do the same thing.
  */
 void
-free_lambda_expression(void *data)
+finish_loading(struct lc_context *ctx, const char *filename, struct loading *l)
 {
-	free_expression((struct lambda_expression *)data);
+	struct stat st;
+
+	if (ctx->use_compiled_files && ctx->output_statements == l->output_statements
+		&& !stat(filename, &st))
+	{
+		char *image_name = compiled_name(filename);
+		(void)write_image(ctx, image_name, l->first_seq, NULL, NULL, NULL,
+			&st, ctx->settings_made);
+		free(image_name);
+	}
+
+	ctx->settings_made |= l->settings_made;
 }
 
-/* Based on a list of bound variables, recursively make abstract-syntax
+/* Based on a list of bound variables, make abstract-syntax
  * abstractions out of a body, and the bound variables.  One complication:
  * the "list" is really a binary tree of structs lambda_exptression *,
  * so you have to do a little bit of work.  The innermost bound variables
- * occupy right-most leaves on the binary tree.
+ * occupy right-most leaves on the binary tree, so walking down the
+ * left spine wraps the body from the inside out, without recursion.
  */
 struct lambda_expression *
-abstraction_from_list(struct lambda_expression * list, struct lambda_expression *body)
+abstraction_from_list(struct lc_context *ctx, struct lambda_expression * list, struct lambda_expression *body)
 {
-	struct lambda_expression *r = NULL;
-	switch (list->typ)
+	while (body)
 	{
-	case VARIABLE:
-		r = new_abstraction(list->variable , body);
-		break;
-	case APPLICATION:
-		if (VARIABLE != list->rand->typ)
+		switch (list->typ)
 		{
-			fprintf(stderr, "Bound variable list incorrect\n");
-			free_expression(body);
-		} else
-			r = abstraction_from_list(
-				list->rator,
-				new_abstraction(list->rand->variable, body)
-			);
-		break;
-	case ABSTRACTION:
-		/* egregious error */
-		fprintf(stderr, "Abstraction appearing in bound variable list\n");
-		free_expression(body);
-		break;
+		case VARIABLE:
+			return new_abstraction(ctx, list->variable , body);
+		case APPLICATION:
+			if (list->repeat || VARIABLE != abbreviation_definition(list->rand)->typ)
+			{
+				statement_error(ctx, "Bound variable list incorrect");
+				free_expression(ctx, body);
+				body = NULL;
+			} else {
+				body = new_abstraction(ctx, abbreviation_definition(list->rand)->variable, body);
+				list = list->rator;
+			}
+			break;
+		case ABBREVIATION:
+			/* An abbreviation's name used as a bound variable means
+			 * whatever its definition would. */
+			list = abbreviation_definition(list);
+			break;
+		case ABSTRACTION:
+			/* egregious error */
+			statement_error(ctx, "Abstraction appearing in bound variable list");
+			free_expression(ctx, body);
+			body = NULL;
+			break;
+		}
 	}
-	return r;
+	return NULL;
 }
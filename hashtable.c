@@ -222,8 +222,12 @@ insert_data(struct hashtable *h, const char *key, void *data)
 
 	hn = node_lookup(h, key, &hv, &seg, &mseg);
 
-	/* key already exists in hashtable. */
-	r = hn->data;
+	if (hn)
+		r = hn->data;  /* key already exists in hashtable. */
+	else {
+		hn = new_hashnode(hv, key, NULL);
+		insert_node(h, hn, hv, seg, mseg);
+	}
 
 	hn->data = data;
 
@@ -0,0 +1,700 @@
+/*
+	Copyright (C) 2006-2011, Bruce Ediger
+
+    This file is part of lc.
+
+    lc is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    lc is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with lc; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+/*
+ * Binary images of the atom table, the abbreviations, $$ and a
+ * reduction in progress.
+ *
+ * An image file consists of a fixed-size header, then four sections,
+ * each starting on an 8-byte boundary:
+ *   (1) an array of offsets into (2), one per atom, in atom ID order
+ *   (2) the atoms' strings, ASCII-Nul terminated
+ *   (3) an array of 32-bit "cells", the lambda terms in prefix order
+ *   (4) one struct image_record per abbreviation, in order of definition.
+ * The sections get used in place from a read-only mmap() of the file:
+ * atom strings get interned straight from the mapping, and terms get
+ * rebuilt from the cells in one pass.  Nothing gets parsed.
+ *
+ * Cells go out through stdio as they get made, so writing an image
+ * takes no memory in proportion to the terms in it.  The header,
+ * which holds the cell count, gets written again at the end.
+ *
+ * An abbreviation used in a term is a cell holding the index of
+ * its record.  Abbreviations defined before the ones in the image
+ * (the image of a library file that uses some other library) appear
+ * as "import" cells holding the name, looked up again on reading.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>     /* malloc(), realloc(), free() */
+#include <string.h>     /* memcmp(), strerror() */
+#include <errno.h>
+#include <limits.h>     /* LONG_MAX */
+#include <stdint.h>
+#include <unistd.h>     /* close(), fsync() */
+#include <fcntl.h>      /* open() */
+#include <sys/types.h>
+#include <sys/stat.h>   /* fstat() */
+#include <sys/mman.h>   /* mmap(), munmap() */
+#include <signal.h>     /* sig_atomic_t */
+
+#include <context.h>
+#include <hashtable.h>
+#include <atom.h>
+#include <small_hashtable.h>
+#include <buffer.h>
+#include <lambda_expression.h>
+#include <abbreviations.h>
+#include <evaluation.h>
+#include <json.h>
+#include <image.h>
+
+#define IMAGE_MAGIC "lcimage"
+#define IMAGE_VERSION 5
+#define BYTE_ORDER_MARK 0x01020304U
+
+#define CELL_VARIABLE      0U
+#define CELL_APPLICATION   1U
+#define CELL_ABSTRACTION   2U
+#define CELL_ABBREVIATION  3U
+#define CELL_TYPE(c)       ((c) & 3U)
+#define CELL_PARAMETERIZED 4U
+#define CELL_IMPORT        8U  /* abbreviation cell holds name, not index */
+#define CELL_PAYLOAD(c)    ((c) >> 4)
+#define MAKE_CELL(t, p)    ((t) | ((uint32_t)(p) << 4))
+#define NO_CELL            0xffffffffU
+
+/* An application cell's payload is its repeat count, or LONG_REPEAT
+ * for a count in the two cells after it, low 32 bits first */
+#define LONG_REPEAT        0x0fffffffU
+
+#define CELL_BUFFER        8192  /* cells per fwrite() */
+
+#define ALIGN8(x)          ((((x) + 7)/8)*8)
+
+struct image_header {
+	char     magic[8];
+	uint32_t byte_order;
+	uint32_t version;
+	uint64_t source_mtime;
+	uint64_t source_size;
+	uint64_t atoms_offset;
+	uint64_t strings_offset;
+	uint64_t records_offset;
+	uint64_t cells_offset;
+	uint32_t atom_count;
+	uint32_t string_bytes;
+	uint32_t record_count;
+	uint32_t cell_count;
+	uint32_t result;           /* cell index of $$, or NO_CELL */
+	int32_t  settings;         /* which of the following to restore */
+	int32_t  eta_reduction;    /* settings when image got written */
+	int32_t  prenormalize;
+	int32_t  prenormalize_budget;
+	int32_t  detect_divergence;
+	int32_t  typed_evaluation;
+	uint32_t in_progress;      /* cell index of a stopped reduction, or NO_CELL */
+	uint64_t beta_steps;       /* the stopped reduction's counts */
+	uint64_t eta_steps;
+};
+
+struct image_record {
+	uint32_t name;             /* atom index */
+	uint32_t expression;       /* cell index */
+	uint32_t normal_form;      /* cell index, or NO_CELL */
+	uint32_t normal_form_eta;
+};
+
+struct image_writer {
+	FILE     *fout;
+	uint32_t  cells[CELL_BUFFER];
+	uint32_t  buffered;        /* cells not yet handed to fwrite() */
+	uint32_t  cell_count;
+	struct abbreviation **saved;  /* sorted by seq */
+	uint32_t  saved_count;
+	unsigned int first_seq;
+	struct lambda_expression **stack;  /* encode_expression()'s */
+	size_t    stack_size;
+};
+
+struct image_reader {
+	const char *filename;
+	const struct image_header *hdr;
+	const struct image_record *records;
+	const uint32_t *cells;
+	const char **atoms;           /* interned, indexed like the image's */
+	struct abbreviation **made;   /* abbreviations read in so far */
+	uint32_t made_count;
+	struct lambda_expression **stack;  /* decode_expression()'s */
+	size_t stack_size;
+};
+
+static void add_cell(struct image_writer *iw, uint32_t cell);
+static int  saved_index(struct image_writer *iw, struct abbreviation *a);
+static uint32_t encode_expression(struct image_writer *iw, struct lambda_expression *e);
+static void fill_hole(struct lambda_expression *p, struct lambda_expression *e);
+static struct lambda_expression *decode_expression(struct lc_context *ctx, struct image_reader *ir, uint32_t pos);
+
+static void
+add_cell(struct image_writer *iw, uint32_t cell)
+{
+	iw->cells[iw->buffered++] = cell;
+	++iw->cell_count;
+	if (CELL_BUFFER == iw->buffered)
+	{
+		fwrite(iw->cells, sizeof(uint32_t), iw->buffered, iw->fout);
+		iw->buffered = 0;
+	}
+}
+
+/* Binary search of the saved abbreviations by sequence number.
+ * Returns -1 for an abbreviation that isn't in the image. */
+static int
+saved_index(struct image_writer *iw, struct abbreviation *a)
+{
+	int lo = 0, hi = (int)iw->saved_count - 1;
+
+	while (lo <= hi)
+	{
+		int mid = lo + (hi - lo)/2;
+		if (iw->saved[mid]->seq == a->seq)
+			return mid;
+		if (iw->saved[mid]->seq < a->seq)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+
+	return -1;
+}
+
+/* Cells for e, in prefix order.  An explicit stack of subterms
+ * still to go keeps deep terms off the C stack.  Returns the index
+ * of e's first cell. */
+static uint32_t
+encode_expression(struct image_writer *iw, struct lambda_expression *e)
+{
+	uint32_t first = iw->cell_count;
+	size_t depth = 0;
+
+	iw->stack[depth++] = e;
+
+	while (depth > 0)
+	{
+		uint32_t param;
+		int idx;
+
+		e = iw->stack[--depth];
+		param = e->parameterized? CELL_PARAMETERIZED: 0;
+
+		if (depth + 2 > iw->stack_size)
+		{
+			iw->stack_size *= 2;
+			iw->stack = realloc(iw->stack, iw->stack_size*sizeof(*iw->stack));
+		}
+
+		switch (e->typ)
+		{
+		case VARIABLE:
+			add_cell(iw, MAKE_CELL(CELL_VARIABLE|param, Atom_id(e->variable)));
+			break;
+		case APPLICATION:
+			if ((unsigned long)e->repeat < LONG_REPEAT)
+				add_cell(iw, MAKE_CELL(CELL_APPLICATION|param, e->repeat));
+			else {
+				add_cell(iw, MAKE_CELL(CELL_APPLICATION|param, LONG_REPEAT));
+				add_cell(iw, (uint32_t)((uint64_t)e->repeat & 0xffffffffU));
+				add_cell(iw, (uint32_t)((uint64_t)e->repeat >> 32));
+			}
+			iw->stack[depth++] = e->rand;
+			iw->stack[depth++] = e->rator;
+			break;
+		case ABSTRACTION:
+			add_cell(iw, MAKE_CELL(CELL_ABSTRACTION|param, Atom_id(e->bound_variable)));
+			iw->stack[depth++] = e->body;
+			break;
+		case ABBREVIATION:
+			if (0 <= (idx = saved_index(iw, e->abbreviation)))
+				add_cell(iw, MAKE_CELL(CELL_ABBREVIATION|param, idx));
+			else
+				add_cell(iw, MAKE_CELL(CELL_ABBREVIATION|CELL_IMPORT|param,
+					Atom_id(e->abbreviation->name)));
+			break;
+		}
+	}
+
+	return first;
+}
+
+/* Write an image of all the atoms, the abbreviations defined
+ * at or after sequence number first_seq, result, a reduction in
+ * progress and the interpreter settings flagged in "settings".
+ * Writes to a temporary file and renames it, so that a reader never
+ * sees a partially-written image.  Returns 0 on success.
+ */
+int
+write_image(
+	struct lc_context *ctx,
+	const char *filename,
+	unsigned int first_seq,
+	struct lambda_expression *result,
+	struct lambda_expression *in_progress,
+	const struct reduction_state *rs,
+	const struct stat *source,
+	int settings
+)
+{
+	struct image_writer iw;
+	struct image_header hdr;
+	struct image_record *records = NULL;
+	struct abbreviation *a;
+	uint32_t *atom_offsets = NULL;
+	uint32_t i, n_atoms = Atom_count(), string_bytes = 0;
+	static const char zeros[8] = {0};
+	char *tmpname = NULL;
+	int r = -1;
+
+	tmpname = malloc(strlen(filename) + 32);
+	sprintf(tmpname, "%s.%ld.tmp", filename, (long)getpid());
+
+	if (NULL == (iw.fout = fopen(tmpname, "w")))
+	{
+		statement_error(ctx, "Could not open \"%s\" for write: %s",
+			tmpname, strerror(errno));
+		free(tmpname);
+		return -1;
+	}
+
+	iw.buffered = iw.cell_count = 0;
+	iw.saved_count = 0;
+	iw.first_seq = first_seq;
+	iw.stack_size = 1024;
+	iw.stack = malloc(iw.stack_size*sizeof(*iw.stack));
+
+	for (a = abbreviation_list(ctx); a; a = a->next)
+		if (a->seq >= first_seq)
+			++iw.saved_count;
+	iw.saved = malloc((iw.saved_count + 1)*sizeof(*iw.saved));
+	records = malloc((iw.saved_count + 1)*sizeof(*records));
+	i = 0;
+	for (a = abbreviation_list(ctx); a; a = a->next)
+		if (a->seq >= first_seq)
+			iw.saved[i++] = a;
+
+	atom_offsets = malloc((n_atoms + 1)*sizeof(*atom_offsets));
+	for (i = 0; i < n_atoms; ++i)
+	{
+		atom_offsets[i] = string_bytes;
+		string_bytes += Atom_length(Atom_from_id(i)) + 1;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, IMAGE_MAGIC, sizeof(hdr.magic));
+	hdr.byte_order = BYTE_ORDER_MARK;
+	hdr.version = IMAGE_VERSION;
+	if (source)
+	{
+		hdr.source_mtime = source->st_mtime;
+		hdr.source_size = source->st_size;
+	}
+	hdr.atom_count = n_atoms;
+	hdr.string_bytes = string_bytes;
+	hdr.record_count = iw.saved_count;
+	hdr.settings = settings;
+	hdr.eta_reduction = ctx->eta_reduction;
+	hdr.prenormalize = ctx->prenormalize;
+	hdr.prenormalize_budget = ctx->prenormalize_budget;
+	hdr.detect_divergence = ctx->detect_divergence;
+	hdr.typed_evaluation = ctx->typed_evaluation;
+	hdr.atoms_offset = ALIGN8(sizeof(hdr));
+	hdr.strings_offset = ALIGN8(hdr.atoms_offset + n_atoms*sizeof(uint32_t));
+	hdr.cells_offset = ALIGN8(hdr.strings_offset + string_bytes);
+
+	/* A placeholder header: the counts of cells aren't known yet */
+	fwrite(&hdr, sizeof(hdr), 1, iw.fout);
+	fwrite(zeros, hdr.atoms_offset - sizeof(hdr), 1, iw.fout);
+	fwrite(atom_offsets, sizeof(uint32_t), n_atoms, iw.fout);
+	fwrite(zeros, hdr.strings_offset - (hdr.atoms_offset + n_atoms*sizeof(uint32_t)), 1, iw.fout);
+	for (i = 0; i < n_atoms; ++i)
+	{
+		const char *s = Atom_from_id(i);
+		fwrite(s, Atom_length(s) + 1, 1, iw.fout);
+	}
+	fwrite(zeros, hdr.cells_offset - (hdr.strings_offset + string_bytes), 1, iw.fout);
+
+	for (i = 0; i < iw.saved_count; ++i)
+	{
+		a = iw.saved[i];
+		records[i].name = Atom_id(a->name);
+		records[i].expression = encode_expression(&iw, a->expression);
+		records[i].normal_form = NO_CELL;
+		records[i].normal_form_eta = a->normal_form_eta;
+		if (a->normal_form)
+			records[i].normal_form = encode_expression(&iw, a->normal_form);
+	}
+
+	hdr.result = result? encode_expression(&iw, result): NO_CELL;
+
+	hdr.in_progress = NO_CELL;
+	if (in_progress)
+	{
+		hdr.in_progress = encode_expression(&iw, in_progress);
+		hdr.beta_steps = rs->beta_steps;
+		hdr.eta_steps = rs->eta_steps;
+	}
+
+	fwrite(iw.cells, sizeof(uint32_t), iw.buffered, iw.fout);
+
+	hdr.cell_count = iw.cell_count;
+	hdr.records_offset = ALIGN8(hdr.cells_offset + (uint64_t)iw.cell_count*sizeof(uint32_t));
+	fwrite(zeros, hdr.records_offset - (hdr.cells_offset + (uint64_t)iw.cell_count*sizeof(uint32_t)), 1, iw.fout);
+	fwrite(records, sizeof(*records), iw.saved_count, iw.fout);
+
+	if (0 == fseek(iw.fout, 0L, SEEK_SET))
+		fwrite(&hdr, sizeof(hdr), 1, iw.fout);
+
+	/* Checkpoints have to survive the machine going down */
+	if (0 == fflush(iw.fout))
+		fsync(fileno(iw.fout));
+
+	if (ferror(iw.fout) | fclose(iw.fout))
+	{
+		statement_error(ctx, "Problem writing \"%s\": %s", tmpname, strerror(errno));
+		remove(tmpname);
+	} else if (rename(tmpname, filename)) {
+		statement_error(ctx, "Could not rename \"%s\" to \"%s\": %s",
+			tmpname, filename, strerror(errno));
+		remove(tmpname);
+	} else
+		r = 0;
+
+	free(tmpname);
+	free(atom_offsets);
+	free(records);
+	free(iw.saved);
+	free(iw.stack);
+
+	return r;
+}
+
+/* Called from normal_order_reduction() every checkpoint_every
+ * steps of a top-level reduction: the whole session, with e as
+ * the reduction in progress, goes to checkpoint_file. */
+void
+checkpoint(struct lc_context *ctx, struct lambda_expression *e, const struct reduction_state *rs)
+{
+	(void)write_image(ctx, ctx->checkpoint_file, 0, ctx->previous_result, e, rs,
+		NULL, IMAGE_ALL_SETTINGS);
+}
+
+/* Put e in the next empty child of p: an application's rator, then
+ * its rand, or an abstraction's body. */
+static void
+fill_hole(struct lambda_expression *p, struct lambda_expression *e)
+{
+	if (APPLICATION == p->typ && !p->rator)
+		p->rator = e;
+	else if (APPLICATION == p->typ)
+		p->rand = e;
+	else
+		p->body = e;
+}
+
+/* Rebuild a term from cells, starting at pos.  Applications and
+ * abstractions wait on a stack for their subterms, so that deep
+ * terms don't use up the C stack. Returns NULL for a corrupt image.
+ */
+static struct lambda_expression *
+decode_expression(struct lc_context *ctx, struct image_reader *ir, uint32_t pos)
+{
+	size_t depth = 0;
+
+	while (pos < ir->hdr->cell_count)
+	{
+		struct lambda_expression *r = NULL;
+		uint32_t cell = ir->cells[pos++];
+		uint32_t payload = CELL_PAYLOAD(cell);
+
+		switch (CELL_TYPE(cell))
+		{
+		case CELL_VARIABLE:
+			if (payload < ir->hdr->atom_count)
+				r = new_variable(ctx, ir->atoms[payload]);
+			break;
+		case CELL_APPLICATION: {
+			uint64_t repeat = payload;
+			if (LONG_REPEAT == payload)
+			{
+				if (pos + 2 > ir->hdr->cell_count)
+					break;
+				repeat = ir->cells[pos] | (uint64_t)ir->cells[pos + 1] << 32;
+				pos += 2;
+			}
+			if (1 == repeat || repeat > (uint64_t)LONG_MAX)
+				break;
+			r = new_application(ctx, NULL, NULL);
+			r->repeat = (long)repeat;
+			}
+			break;
+		case CELL_ABSTRACTION:
+			if (payload < ir->hdr->atom_count)
+				r = new_abstraction(ctx, ir->atoms[payload], NULL);
+			break;
+		case CELL_ABBREVIATION:
+			if (cell & CELL_IMPORT)
+			{
+				if (payload < ir->hdr->atom_count)
+				{
+					r = abbreviation_reference(ctx, ir->atoms[payload]);
+					if (!r)
+						r = new_variable(ctx, ir->atoms[payload]);
+				}
+			} else if (payload < ir->made_count)
+				r = new_abbreviation_reference(ctx, ir->made[payload]);
+			break;
+		}
+
+		if (!r)
+			break;
+
+		if (cell & CELL_PARAMETERIZED)
+			r->parameterized = 1;
+
+		if (APPLICATION == r->typ || ABSTRACTION == r->typ)
+		{
+			if (depth >= ir->stack_size)
+			{
+				ir->stack_size = ir->stack_size? 2*ir->stack_size: 1024;
+				ir->stack = realloc(ir->stack, ir->stack_size*sizeof(*ir->stack));
+			}
+			ir->stack[depth++] = r;
+			continue;
+		}
+
+		/* r is complete: it fills in the next hole, which
+		 * may complete its parent, and so on up. */
+		while (depth > 0)
+		{
+			struct lambda_expression *parent = ir->stack[depth - 1];
+			fill_hole(parent, r);
+			if (APPLICATION == parent->typ && !parent->rand)
+			{
+				r = NULL;
+				break;
+			}
+			r = parent;
+			--depth;
+		}
+
+		if (r)
+			return r;
+	}
+
+	/* Corrupt: fill in the holes in unfinished terms, and hang each
+	 * on its parent, so that the whole thing can get freed. */
+	while (depth > 0)
+	{
+		struct lambda_expression *p = ir->stack[--depth];
+
+		while (!(APPLICATION == p->typ? p->rand: p->body))
+			fill_hole(p, new_variable(ctx, Atom_string("x")));
+
+		if (depth > 0)
+			fill_hole(ir->stack[depth - 1], p);
+		else
+			free_expression(ctx, p);
+	}
+
+	return NULL;
+}
+
+/* Read an image, defining its abbreviations in order, putting
+ * its copy of $$ (if any) in *result, and any reduction in progress
+ * in *in_progress, with its counts in *rs.  For an image
+ * with a non-NULL source, quietly returns -1 unless the image
+ * was compiled from a file with the same modification time and
+ * size.  Returns 0 on success.
+ */
+int
+read_image(
+	struct lc_context *ctx,
+	const char *filename,
+	struct lambda_expression **result,
+	struct lambda_expression **in_progress,
+	struct reduction_state *rs,
+	const struct stat *source
+)
+{
+	struct image_reader ir;
+	struct stat st;
+	void *map = NULL;
+	const char *base = NULL;
+	const uint32_t *atom_offsets;
+	const char *strings;
+	uint32_t i;
+	int fd, r = -1;
+
+	ir.filename = filename;
+	ir.atoms = NULL;
+	ir.made = NULL;
+	ir.made_count = 0;
+	ir.stack = NULL;
+	ir.stack_size = 0;
+
+	if (0 > (fd = open(filename, O_RDONLY)))
+	{
+		if (!source)
+			statement_error(ctx, "Could not open \"%s\" for read: %s",
+				filename, strerror(errno));
+		return -1;
+	}
+
+	if (fstat(fd, &st) || st.st_size < (off_t)sizeof(struct image_header))
+	{
+		statement_error(ctx, "\"%s\" isn't an image", filename);
+		close(fd);
+		return -1;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (MAP_FAILED == map)
+	{
+		statement_error(ctx, "Could not map \"%s\": %s", filename, strerror(errno));
+		return -1;
+	}
+	base = map;
+
+	ir.hdr = (const struct image_header *)base;
+
+	if (memcmp(ir.hdr->magic, IMAGE_MAGIC, sizeof(ir.hdr->magic))
+		|| BYTE_ORDER_MARK != ir.hdr->byte_order
+		|| IMAGE_VERSION != ir.hdr->version
+		|| ir.hdr->records_offset + (uint64_t)ir.hdr->record_count*sizeof(struct image_record) > (uint64_t)st.st_size
+		|| ir.hdr->cells_offset + (uint64_t)ir.hdr->cell_count*sizeof(uint32_t) > ir.hdr->records_offset
+		|| ir.hdr->strings_offset + ir.hdr->string_bytes > ir.hdr->cells_offset
+		|| ir.hdr->atoms_offset + (uint64_t)ir.hdr->atom_count*sizeof(uint32_t) > ir.hdr->strings_offset)
+	{
+		statement_error(ctx, "\"%s\" isn't an image lc can read", filename);
+		goto done;
+	}
+	if (source && ((uint64_t)source->st_mtime != ir.hdr->source_mtime
+		|| (uint64_t)source->st_size != ir.hdr->source_size))
+		goto done;  /* stale compiled image, no complaint */
+
+	atom_offsets = (const uint32_t *)(base + ir.hdr->atoms_offset);
+	strings = base + ir.hdr->strings_offset;
+	ir.records = (const struct image_record *)(base + ir.hdr->records_offset);
+	ir.cells = (const uint32_t *)(base + ir.hdr->cells_offset);
+
+	if (ir.hdr->string_bytes && '\0' != strings[ir.hdr->string_bytes - 1])
+	{
+		statement_error(ctx, "\"%s\" has a corrupt string table", filename);
+		goto done;
+	}
+
+	ir.atoms = malloc((ir.hdr->atom_count + 1)*sizeof(*ir.atoms));
+	for (i = 0; i < ir.hdr->atom_count; ++i)
+	{
+		if (atom_offsets[i] >= ir.hdr->string_bytes)
+		{
+			statement_error(ctx, "\"%s\" has a corrupt atom table", filename);
+			goto done;
+		}
+		ir.atoms[i] = Atom_string(strings + atom_offsets[i]);
+	}
+
+	ir.made = malloc((ir.hdr->record_count + 1)*sizeof(*ir.made));
+	for (i = 0; i < ir.hdr->record_count; ++i)
+	{
+		const struct image_record *rec = &ir.records[i];
+		struct lambda_expression *e;
+		struct abbreviation *a;
+
+		if (rec->name >= ir.hdr->atom_count
+			|| NULL == (e = decode_expression(ctx, &ir, rec->expression)))
+		{
+			statement_error(ctx, "\"%s\" has a corrupt abbreviation", filename);
+			goto done;
+		}
+
+		a = abbreviation_add(ctx, ir.atoms[rec->name], e);
+
+		if (NO_CELL != rec->normal_form
+			&& NULL != (e = decode_expression(ctx, &ir, rec->normal_form)))
+		{
+			abbreviation_set_normal_form(ctx, a, e);
+			a->normal_form_eta = rec->normal_form_eta;
+		}
+
+		/* Hold it, in case a later record redefines the same name */
+		++a->refcount;
+		ir.made[ir.made_count++] = a;
+	}
+
+	if (NO_CELL != ir.hdr->result && result)
+	{
+		struct lambda_expression *e = decode_expression(ctx, &ir, ir.hdr->result);
+		if (e)
+		{
+			if (*result)
+				free_expression(ctx, *result);
+			*result = e;
+		}
+	}
+
+	if (NO_CELL != ir.hdr->in_progress && in_progress)
+	{
+		struct lambda_expression *e = decode_expression(ctx, &ir, ir.hdr->in_progress);
+		if (e)
+		{
+			if (*in_progress)
+				free_expression(ctx, *in_progress);
+			*in_progress = e;
+			init_reduction_state(rs, 0);
+			rs->beta_steps = ir.hdr->beta_steps;
+			rs->eta_steps = ir.hdr->eta_steps;
+		}
+	}
+
+	if (ir.hdr->settings & IMAGE_ETA)
+		ctx->eta_reduction = ir.hdr->eta_reduction;
+	if (ir.hdr->settings & IMAGE_PRENORMALIZE)
+	{
+		ctx->prenormalize = ir.hdr->prenormalize;
+		ctx->prenormalize_budget = ir.hdr->prenormalize_budget;
+	}
+	if (ir.hdr->settings & IMAGE_DIVERGENCE)
+		ctx->detect_divergence = ir.hdr->detect_divergence;
+	if (ir.hdr->settings & IMAGE_TYPED)
+		ctx->typed_evaluation = ir.hdr->typed_evaluation;
+
+	r = 0;
+
+done:
+	for (i = 0; i < ir.made_count; ++i)
+		abbreviation_release(ctx, ir.made[i]);
+	free(ir.atoms);
+	free(ir.made);
+	free(ir.stack);
+	munmap(map, st.st_size);
+
+	return r;
+}
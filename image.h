@@ -0,0 +1,58 @@
+/*
+	Copyright (C) 2006-2011, Bruce Ediger
+
+    This file is part of lc.
+
+    lc is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    lc is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with lc; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/* Binary images of interpreter state: atoms, abbreviations,
+ * $$ and a stopped or checkpointed reduction.  Uses struct
+ * reduction_state from evaluation.h.  The "source" argument, if non-NULL, ties an image
+ * to the modification time and size of the file it got compiled
+ * from. Images of whole sessions have a NULL source.
+ */
+
+/* Interpreter settings an image can carry along */
+#define IMAGE_ETA          1
+#define IMAGE_PRENORMALIZE 2
+#define IMAGE_DIVERGENCE   4
+#define IMAGE_TYPED        8
+#define IMAGE_ALL_SETTINGS (IMAGE_ETA|IMAGE_PRENORMALIZE|IMAGE_DIVERGENCE|IMAGE_TYPED)
+
+int write_image(
+	struct lc_context *ctx,
+	const char *filename,
+	unsigned int first_seq,            /* abbreviations defined since */
+	struct lambda_expression *result,  /* $$, can be NULL */
+	struct lambda_expression *in_progress,  /* can be NULL */
+	const struct reduction_state *rs,  /* in_progress's counts */
+	const struct stat *source,
+	int settings                       /* which settings to restore on reading */
+);
+int read_image(
+	struct lc_context *ctx,
+	const char *filename,
+	struct lambda_expression **result,
+	struct lambda_expression **in_progress,
+	struct reduction_state *rs,
+	const struct stat *source
+);
+
+/* "checkpoint N > file": normal_order_reduction() calls checkpoint()
+ * every ctx->checkpoint_every steps of a top-level reduction, and it
+ * writes an image of the whole session to ctx->checkpoint_file. */
+void checkpoint(struct lc_context *ctx, struct lambda_expression *e, const struct reduction_state *rs);
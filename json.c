@@ -0,0 +1,263 @@
+/*
+	Copyright (C) 2006-2011, Bruce Ediger
+
+    This file is part of lc.
+
+    lc is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    lc is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with lc; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+
+/*
+ * JSON Lines output.  While a statement runs, ctx->out is a memory
+ * stream, so that whatever the statement prints can go in its object
+ * as a string.  A normal form's text goes straight out, escaped a
+ * chunk at a time, so it never has to fit in memory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>     /* strlen(), snprintf() */
+#include <stdint.h>
+#include <signal.h>     /* sig_atomic_t */
+
+#include <context.h>
+#include <buffer.h>
+#include <lambda_expression.h>
+#include <divergence.h>
+#include <json.h>
+
+struct json_state {
+	FILE *out;             /* where objects go */
+	char *text;            /* what the statement printed */
+	size_t length;
+
+	/* the statement's reduction */
+	int reduced;
+	const char *result;
+	long beta_steps;
+	long eta_steps;
+	double seconds;
+	struct lambda_expression *normal_form;  /* $$ when it gets written */
+	uint64_t hash;
+
+	char error[256];
+};
+
+static void capture(struct lc_context *ctx, struct json_state *s);
+static void write_object(struct lc_context *ctx, struct json_state *s);
+static void write_string(FILE *out, const char *text, size_t length);
+static void write_escaped(FILE *out, const char *text, size_t length);
+static void drain_escaped(struct buffer *b);
+
+void
+json_start(struct lc_context *ctx)
+{
+	struct json_state *s = calloc(1, sizeof(*s));
+
+	s->out = ctx->out;
+	ctx->json = s;
+	capture(ctx, s);
+}
+
+void
+json_reduction(
+	struct lc_context *ctx,
+	struct lambda_expression *e,
+	const struct reduction_state *rs,
+	const char *result,
+	double seconds
+)
+{
+	struct json_state *s = ctx->json;
+
+	s->reduced = 1;
+	s->result = result;
+	s->beta_steps = rs->beta_steps;
+	s->eta_steps = rs->eta_steps;
+	s->seconds = seconds;
+
+	if (!strcmp(result, "normal"))
+	{
+		size_t length;
+		const unsigned int *words = canonical_form(ctx, e, 0, &length);
+
+		s->hash = hash_words(words, length);
+		s->normal_form = e;
+	}
+}
+
+/* A syntax error ends the statement where it is */
+void
+json_error(struct lc_context *ctx, const char *message)
+{
+	snprintf(ctx->json->error, sizeof(ctx->json->error), "%s", message);
+	json_statement_end(ctx);
+}
+
+/* Any other failure prints its message, and the statement's object
+ * gets it as its error when the statement ends.  format gets no
+ * newline, and the first error in a statement is the one kept. */
+void
+statement_error(struct lc_context *ctx, const char *format, ...)
+{
+	va_list ap;
+
+	va_start(ap, format);
+	vfprintf(stderr, format, ap);
+	va_end(ap);
+	fputc('\n', stderr);
+
+	if (ctx->json && '\0' == ctx->json->error[0])
+	{
+		va_start(ap, format);
+		vsnprintf(ctx->json->error, sizeof(ctx->json->error), format, ap);
+		va_end(ap);
+	}
+}
+
+void
+json_statement_end(struct lc_context *ctx)
+{
+	struct json_state *s = ctx->json;
+
+	if (ctx->out != s->out)
+		fclose(ctx->out);
+
+	if (s->length > 0 || s->reduced || '\0' != s->error[0])
+		write_object(ctx, s);
+
+	capture(ctx, s);
+}
+
+/* Whatever got printed after the last statement, as by -R, gets an
+ * object of its own, then output goes back to where it was. */
+void
+json_stop(struct lc_context *ctx)
+{
+	struct json_state *s = ctx->json;
+
+	if (!s)
+		return;
+
+	if (ctx->out != s->out)
+		fclose(ctx->out);
+	if (s->length > 0 || s->reduced)
+		write_object(ctx, s);
+
+	ctx->out = s->out;
+	ctx->json = NULL;
+	free(s->text);
+	free(s);
+}
+
+/* A fresh memory stream for the next statement to print into, or
+ * without the memory for one, ctx->out as it was. */
+static void
+capture(struct lc_context *ctx, struct json_state *s)
+{
+	free(s->text);
+	s->text = NULL;
+	s->length = 0;
+	if (NULL == (ctx->out = open_memstream(&s->text, &s->length)))
+		ctx->out = s->out;
+
+	s->reduced = 0;
+	s->normal_form = NULL;
+	s->error[0] = '\0';
+	mark_nodes_peak(ctx);
+}
+
+static void
+write_object(struct lc_context *ctx, struct json_state *s)
+{
+	const char *file = ctx->current_input_stream? ctx->current_input_stream: "";
+
+	fputs("{\"file\":", s->out);
+	write_string(s->out, file, strlen(file));
+	fprintf(s->out, ",\"line\":%d", ctx->lineno);
+
+	if (s->reduced)
+		fprintf(s->out, ",\"result\":\"%s\",\"beta\":%ld,\"eta\":%ld,\"seconds\":%.3f,\"peak_nodes\":%ld",
+			s->result, s->beta_steps, s->eta_steps, s->seconds,
+			nodes_peak_since_mark(ctx));
+	if (s->normal_form)
+		fprintf(s->out, ",\"hash\":\"%016llx\"", (unsigned long long)s->hash);
+	if ('\0' != s->error[0])
+	{
+		fputs(",\"error\":", s->out);
+		write_string(s->out, s->error, strlen(s->error));
+	}
+
+	fputs(",\"output\":", s->out);
+	write_string(s->out, s->text, s->length);
+
+	if (s->normal_form)
+	{
+		struct buffer *b = new_buffer(PRINT_CHUNK_SIZE);
+		b->drain = drain_escaped;
+		b->sink = s->out;
+		fputs(",\"normal_form\":\"", s->out);
+		buffer_expression(s->normal_form, b);
+		flush_buffer(b);
+		delete_buffer(b);
+		fputc('"', s->out);
+	}
+
+	fputs("}\n", s->out);
+	fflush(s->out);
+}
+
+static void
+write_string(FILE *out, const char *text, size_t length)
+{
+	fputc('"', out);
+	write_escaped(out, text, length);
+	fputc('"', out);
+}
+
+static void
+write_escaped(FILE *out, const char *text, size_t length)
+{
+	size_t i;
+
+	for (i = 0; i < length; ++i)
+	{
+		unsigned char c = text[i];
+
+		switch (c)
+		{
+		case '"':  fputs("\\\"", out); break;
+		case '\\': fputs("\\\\", out); break;
+		case '\n': fputs("\\n", out); break;
+		case '\t': fputs("\\t", out); break;
+		case '\r': fputs("\\r", out); break;
+		default:
+			if (c < 0x20)
+				fprintf(out, "\\u%04x", c);
+			else
+				fputc(c, out);
+			break;
+		}
+	}
+}
+
+static void
+drain_escaped(struct buffer *b)
+{
+	write_escaped((FILE *)b->sink, b->buffer, b->offset);
+	b->offset = 0;
+}
@@ -0,0 +1,53 @@
+/*
+	Copyright (C) 2006-2011, Bruce Ediger
+
+    This file is part of lc.
+
+    lc is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    lc is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with lc; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+
+/* JSON Lines output, for -J.  Each statement that prints something or
+ * reduces a term comes out as one JSON object, on a line of its own,
+ * flushed at once, for programs reading lc's output as it comes:
+ *
+ * {"file":"stdin","line":3,"result":"normal","beta":6,"eta":0,
+ *  "seconds":0.000,"peak_nodes":310,"hash":"5a0d...","output":"",
+ *  "normal_form":"%n.%a.n (n (n (n a)))"}
+ *
+ * file and line say where the statement was.  A reduction adds its
+ * result, as lc --serve names them, step counts, time, and the most
+ * nodes in use at once during the statement.  A normal form adds its
+ * text and a hash that alpha-equivalent terms share.  output holds
+ * whatever else the statement printed, and a syntax error, or a
+ * failure reported by statement_error(), gets an error member.  Statements that print nothing, like definitions,
+ * get no object.
+ *
+ * Uses FILE from <stdio.h>, and struct reduction_state from context.h.
+ */
+
+void json_start(struct lc_context *ctx);
+void json_reduction(
+	struct lc_context *ctx,
+	struct lambda_expression *e,
+	const struct reduction_state *rs,
+	const char *result,
+	double seconds
+);
+void json_error(struct lc_context *ctx, const char *message);
+void statement_error(struct lc_context *ctx, const char *format, ...);
+void json_statement_end(struct lc_context *ctx);
+void json_stop(struct lc_context *ctx);
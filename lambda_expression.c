@@ -27,42 +27,76 @@
  */
 
 #include <stdio.h>    /* printf() */
+#include <signal.h>   /* sig_atomic_t */
 #include <stdlib.h>   /* malloc(), free() */
-#include <string.h>   /* strlen() */
+#include <string.h>   /* strlen(), memcpy() */
+#include <stdint.h>   /* uint64_t */
 
+#include <context.h>
 #include <small_hashtable.h>
 #include <buffer.h>
 #include <lambda_expression.h>
 #include <hashtable.h>
 #include <atom.h>
+#include <abbreviations.h>
+#include <probes.h>
 
-struct lambda_expression *new_node(void);
+struct lambda_expression *new_node(struct lc_context *ctx);
 void find_bound_vars(
+	struct lc_context *ctx,
 	struct lambda_expression *term,
 	struct small_hashtable *bindings
 );
 
-int real_alpha_equivalent_graphs(
-	struct lambda_expression *node1,
-	struct small_hashtable *currently_bound_vars1,
-	struct lambda_expression *node2,
-	struct small_hashtable *currently_bound_vars2,
-	int abstraction_count
-);
-
-const char *determine_binding(const char *bound_var, int abstraction_count);
-
-/* Communicate with sigint_handler() */
-extern int interpreter_interrupted;
-
-/* new_node() and free_expression() use file-scope variable
+/* Scratch space alpha_equivalent_graphs() keeps from one call to the
+ * next, so that comparing terms doesn't allocate once it warms up.
+ * Entries of binding[side] go by Atom_id(): 1 + the de Bruijn level
+ * of the innermost abstraction binding that variable, on that side,
+ * or 0 for a free variable.  Abstractions put back the entries they
+ * change on the way out, so they're all 0 between calls.
+ */
+struct alpha_state {
+	int *binding[2];
+	unsigned int atoms;     /* entries in each of binding[] */
+	long budget;            /* nodes the walk may still visit */
+
+	/* terms flattened by encode_term() */
+	unsigned int *code[2];
+	size_t code_size[2];
+	struct alpha_frame *stack;
+	size_t stack_size;
+};
+
+/* encode_term()'s explicit stack: a node to encode, or, with
+ * node NULL, an abstraction's scope to leave.  A repeated
+ * application with repeat applications left comes back as itself. */
+struct alpha_frame {
+	struct lambda_expression *node;
+	long repeat;
+	unsigned int id;
+	int saved;
+};
+
+/* Terms bigger than this get flattened and compared with memcmp() */
+#define ALPHA_WALK_NODES 4096
+
+static struct alpha_state *alpha_state(struct lc_context *ctx);
+static int alpha_walk(struct alpha_state *s, struct lambda_expression *node1, struct lambda_expression *node2, int depth);
+static int alpha_applications(struct alpha_state *s, struct lambda_expression *node1, long count1, struct lambda_expression *node2, long count2, int depth);
+static size_t encode_term(struct alpha_state *s, int side, struct lambda_expression *term, int compact);
+
+/* new_node() and free_expression() use the session's
  * free_list to keep a plain ol' stack of structs lambda_expression,
- * so as to avoid calling malloc/free a lot.
+ * so as to avoid calling malloc/free a lot.  Fresh nodes get carved
+ * out of slabs, which saves a malloc() header on every node of a
+ * multi-megabyte term.
  */
-static int free_cnt = 0;
-static int alloc_cnt = 0;
-static int malloc_cnt = 0;
-static struct lambda_expression *free_list = NULL;
+#define NODES_PER_SLAB 1024
+struct node_slab {
+	struct node_slab *next;
+	struct lambda_expression nodes[NODES_PER_SLAB];
+};
+
 
 /* Default ASCII-character used for lambda, and the string used
  * between binding site and body of an abstraction. */
@@ -70,113 +104,351 @@ char lambda_character = '%';
 const char *abstraction_delimiter = ".";
 
 struct lambda_expression *
-new_node(void)
+new_node(struct lc_context *ctx)
 {
 	struct lambda_expression *r = NULL;
 
-	++alloc_cnt;
+	++ctx->alloc_cnt;
+	if (ctx->alloc_cnt - ctx->free_cnt > ctx->in_use_peak)
+		ctx->in_use_peak = ctx->alloc_cnt - ctx->free_cnt;
 
-	if (free_list)
+	if (ctx->free_list)
 	{
-		r = free_list;
-		free_list = free_list->next_free;
+		r = ctx->free_list;
+		ctx->free_list = ctx->free_list->next_free;
 	} else {
-		++malloc_cnt;
-		r = malloc(sizeof(*r));
+		if (NULL == ctx->slabs || NODES_PER_SLAB == ctx->slab_used)
+		{
+			struct node_slab *slab = malloc(sizeof(*slab));
+			LC_PROBE_SLAB_REFILL(ctx->malloc_cnt + NODES_PER_SLAB, sizeof(*slab));
+			slab->next = ctx->slabs;
+			ctx->slabs = slab;
+			ctx->slab_used = 0;
+		}
+		++ctx->malloc_cnt;
+		r = &ctx->slabs->nodes[ctx->slab_used++];
 		r->variable = NULL;
 		r->bound_variable = NULL;
 		r->body = NULL;
 		r->rator = NULL;
 		r->rand = NULL;
+		r->abbreviation = NULL;
 	}
 
 	r->next_free = NULL;
 	r->parameterized = 0;
+	r->repeat = 0;
+	r->origin = NULL;
 
 	return r;
 }
 
+/* Running totals, for tracing */
+long
+nodes_allocated(struct lc_context *ctx)
+{
+	return ctx->alloc_cnt;
+}
+
+long
+nodes_freed(struct lc_context *ctx)
+{
+	return ctx->free_cnt;
+}
+
+/* Most nodes ever in use at once: new_node() only takes a node
+ * out of a slab when the free list is empty. */
+long
+nodes_peak(struct lc_context *ctx)
+{
+	return ctx->malloc_cnt;
+}
+
+/* Most nodes in use at once since the last mark_nodes_peak() */
+long
+nodes_peak_since_mark(struct lc_context *ctx)
+{
+	return ctx->in_use_peak;
+}
+
+void
+mark_nodes_peak(struct lc_context *ctx)
+{
+	ctx->in_use_peak = ctx->alloc_cnt - ctx->free_cnt;
+}
+
 struct lambda_expression *
-new_variable(const char *identifier)
+new_variable(struct lc_context *ctx, const char *identifier)
 {
-	struct lambda_expression *r = new_node();
+	struct lambda_expression *r = new_node(ctx);
 	r->typ = VARIABLE;
 	r->variable = identifier;
 	return r;
 }
 
+struct lambda_expression *
+new_abbreviation_reference(struct lc_context *ctx, struct abbreviation *a)
+{
+	struct lambda_expression *r = new_node(ctx);
+	r->typ = ABBREVIATION;
+	r->abbreviation = a;
+	++a->refcount;
+	return r;
+}
+
+/* Nodes waiting to get freed are threaded through next_free,
+ * so freeing a term takes no stack, however deep the term is. */
+#define PEND(n) do { \
+		if (n) { (n)->next_free = pending; pending = (n); } \
+		else { ++ctx->free_cnt; fprintf(stderr, "Freeing a NULL expression node\n"); } \
+	} while (0)
+
 void
-free_expression(struct lambda_expression *expression)
+free_expression(struct lc_context *ctx, struct lambda_expression *expression)
 {
-	++free_cnt;
-	if (expression)
+	struct lambda_expression *pending = NULL;
+
+	PEND(expression);
+
+	while (pending)
 	{
+		expression = pending;
+		pending = pending->next_free;
+		++ctx->free_cnt;
+
 		switch (expression->typ)
 		{
 		case VARIABLE:
 			expression->variable = NULL;
 			break;
 		case APPLICATION:
-			if (expression->rator) free_expression(expression->rator);
+			if (expression->rator) PEND(expression->rator);
 			expression->rator = NULL;
-			free_expression(expression->rand);
+			PEND(expression->rand);
 			expression->rand = NULL;
 			break;
 		case ABSTRACTION:
 			expression->bound_variable = NULL;
-			free_expression(expression->body);
+			PEND(expression->body);
 			expression->body = NULL;
 			break;
+		case ABBREVIATION:
+			abbreviation_release(ctx, expression->abbreviation);
+			expression->abbreviation = NULL;
+			break;
 		}
-		expression->next_free = free_list;
-		free_list = expression;
-	} else
-		fprintf(stderr, "Freeing a NULL expression node\n");
+		expression->next_free = ctx->free_list;
+		ctx->free_list = expression;
+	}
+}
+#undef PEND
+
+/* Explicit stack for walking a term without recursion, so that huge,
+ * machine-generated terms can't overflow the C stack. Only terms
+ * nested deeper than WALK_INITIAL call malloc(). */
+#define WALK_INITIAL 32
+enum walk_action { WALK_VISIT, WALK_UNBIND, WALK_LEAVE, WALK_EMIT };
+struct walk_frame {
+	struct lambda_expression *term;
+	enum walk_action action;
+	char text;  /* WALK_EMIT: output this character */
+	long repeat;  /* WALK_VISIT: if not 0, how many of term's repeated
+	               * applications are left to visit.  WALK_EMIT: how
+	               * many times to output text */
+};
+struct walk_stack {
+	struct walk_frame *frames;
+	int top;
+	int size;
+	struct walk_frame initial[WALK_INITIAL];
+};
+
+static void
+init_walk_stack(struct walk_stack *s)
+{
+	s->frames = s->initial;
+	s->top = 0;
+	s->size = WALK_INITIAL;
+}
+
+static void
+walk_push(struct walk_stack *s, struct lambda_expression *term, enum walk_action action)
+{
+	if (s->top == s->size)
+	{
+		if (s->frames == s->initial)
+		{
+			s->frames = malloc(2*s->size*sizeof(*s->frames));
+			memcpy(s->frames, s->initial, s->size*sizeof(*s->frames));
+		} else
+			s->frames = realloc(s->frames, 2*s->size*sizeof(*s->frames));
+		s->size *= 2;
+	}
+	s->frames[s->top].term = term;
+	s->frames[s->top].action = action;
+	s->frames[s->top].text = '\0';
+	s->frames[s->top].repeat = 0;
+	++s->top;
 }
 
+/* A run of the same character, like the parentheses that close a
+ * repeated application, takes one frame */
+static void
+walk_emit(struct walk_stack *s, char text)
+{
+	if (s->top > 0 && WALK_EMIT == s->frames[s->top - 1].action
+		&& text == s->frames[s->top - 1].text)
+	{
+		++s->frames[s->top - 1].repeat;
+		return;
+	}
+	walk_push(s, NULL, WALK_EMIT);
+	s->frames[s->top - 1].text = text;
+	s->frames[s->top - 1].repeat = 1;
+}
+
+static void
+walk_push_repeat(struct walk_stack *s, struct lambda_expression *application, long repeat)
+{
+	walk_push(s, application, WALK_VISIT);
+	s->frames[s->top - 1].repeat = repeat;
+}
+
+static void
+free_walk_stack(struct walk_stack *s)
+{
+	if (s->frames != s->initial)
+		free(s->frames);
+	s->frames = NULL;
+}
+
+/* Mark every node of a definition as coming from abbreviation origin */
+void
+tag_expression(struct lambda_expression *expression, const char *origin)
+{
+	struct walk_stack stack;
+
+	init_walk_stack(&stack);
+	walk_push(&stack, expression, WALK_VISIT);
+
+	while (stack.top > 0)
+	{
+		struct lambda_expression *e = stack.frames[--stack.top].term;
+		e->origin = origin;
+		switch (e->typ)
+		{
+		case APPLICATION:
+			walk_push(&stack, e->rand, WALK_VISIT);
+			walk_push(&stack, e->rator, WALK_VISIT);
+			break;
+		case ABSTRACTION:
+			walk_push(&stack, e->body, WALK_VISIT);
+			break;
+		case VARIABLE:
+		case ABBREVIATION:
+			break;
+		}
+	}
+
+	free_walk_stack(&stack);
+}
+
+/* Appends the text of expression to b, without recursion: a frame on
+ * the walk stack is either a term still to print, or a parenthesis or
+ * space that goes after terms pushed on top of it. */
 void
 buffer_expression(struct lambda_expression *expression, struct buffer *b)
 {
-	if (expression)
+	struct walk_stack stack;
+
+	init_walk_stack(&stack);
+	walk_push(&stack, expression, WALK_VISIT);
+
+	while (stack.top > 0)
 	{
-		if (expression->parameterized)
+		struct walk_frame *f = &stack.frames[--stack.top];
+		int parameterized;
+		long repeat;
+
+		if (WALK_EMIT == f->action)
+		{
+			for (repeat = 0; repeat < f->repeat; ++repeat)
+				buffer_append(b, &f->text, 1);
+			continue;
+		}
+
+		expression = f->term;
+		repeat = f->repeat;
+
+		if (!expression)
+		{
+			buffer_append(b, "NULL", 4);
+			continue;
+		}
+
+		parameterized = repeat? 0: expression->parameterized;
+		if (!repeat && APPLICATION == expression->typ)
+			repeat = expression->repeat;
+
+		/* An abbreviation prints as its definition, which carries
+		 * its own parameterization marker. */
+		if (ABBREVIATION == expression->typ
+			&& expression->abbreviation->expression->parameterized)
+			parameterized = 0;
+
+		if (parameterized)
+		{
 			buffer_append(b, "*(", 2);
+			walk_emit(&stack, ')');
+		}
 
 		switch (expression->typ)
 		{
 		case VARIABLE:
-			buffer_append(b, expression->variable, strlen(expression->variable));
+			buffer_append(b, expression->variable, Atom_length(expression->variable));
 			break;
-		case APPLICATION:
-			if (ABSTRACTION == expression->rator->typ) buffer_append(b, "(", 1);
-			buffer_expression(expression->rator, b);
-			if (ABSTRACTION == expression->rator->typ) buffer_append(b, ")", 1);
-			buffer_append(b, " ", 1);
-			if (VARIABLE != expression->rand->typ) buffer_append(b, "(", 1);
-			buffer_expression(expression->rand, b);
-			if (VARIABLE != expression->rand->typ) buffer_append(b, ")", 1);
+		case APPLICATION: {
+			enum lambda_expression_type rator_typ
+				= abbreviation_definition(expression->rator)->typ;
+			enum lambda_expression_type rand_typ = (repeat > 1)?
+				APPLICATION: abbreviation_definition(expression->rand)->typ;
+			/* Pushed in reverse of printing order.  A repeated
+			 * application's rand is itself, one application shorter. */
+			if (VARIABLE != rand_typ) walk_emit(&stack, ')');
+			if (repeat > 1)
+				walk_push_repeat(&stack, expression, repeat - 1);
+			else
+				walk_push(&stack, expression->rand, WALK_VISIT);
+			if (VARIABLE != rand_typ) walk_emit(&stack, '(');
+			walk_emit(&stack, ' ');
+			if (ABSTRACTION == rator_typ) walk_emit(&stack, ')');
+			walk_push(&stack, expression->rator, WALK_VISIT);
+			if (ABSTRACTION == rator_typ) buffer_append(b, "(", 1);
+			}
 			break;
 		case ABSTRACTION:
 			buffer_append(b, &lambda_character, 1);
-			buffer_append(b, expression->bound_variable, strlen(expression->bound_variable));
+			buffer_append(b, expression->bound_variable, Atom_length(expression->bound_variable));
 			buffer_append(b, abstraction_delimiter, strlen(abstraction_delimiter));
-			buffer_expression(expression->body, b);
+			walk_push(&stack, expression->body, WALK_VISIT);
+			break;
+		case ABBREVIATION:
+			walk_push(&stack, expression->abbreviation->expression, WALK_VISIT);
 			break;
 		}
+	}
 
-		if (expression->parameterized)
-			buffer_append(b, ")", 1);
-	} else
-		buffer_append(b, "NULL", 4);
+	free_walk_stack(&stack);
 }
 
 struct lambda_expression *
 new_application(
+	struct lc_context *ctx,
 	struct lambda_expression *rator,
 	struct lambda_expression *operand
 )
 {
-	struct lambda_expression *r = new_node();
+	struct lambda_expression *r = new_node(ctx);
 	r->typ = APPLICATION;
 	r->rator = rator;
 	r->rand = operand;
@@ -185,11 +457,12 @@ new_application(
 
 struct lambda_expression *
 new_abstraction(
+	struct lc_context *ctx,
 	const char *bound_variable,
 	struct lambda_expression *body
 )
 {
-	struct lambda_expression *r = new_node();
+	struct lambda_expression *r = new_node(ctx);
 	r->typ = ABSTRACTION;
 	r->bound_variable = bound_variable;
 	r->body = body;
@@ -197,91 +470,190 @@ new_abstraction(
 }
 
 struct lambda_expression *
-copy_expression(struct lambda_expression *e)
+copy_expression(struct lc_context *ctx, struct lambda_expression *e)
 {
 	struct lambda_expression *new_expression = NULL;
 	switch (e->typ)
 	{
 	case VARIABLE:
-		new_expression = new_variable(e->variable);
+		new_expression = new_variable(ctx, e->variable);
 		break;
 	case APPLICATION:
-		new_expression = new_application(
-			copy_expression(e->rator),
-			copy_expression(e->rand)
+		new_expression = new_application(ctx,
+			copy_expression(ctx, e->rator),
+			copy_expression(ctx, e->rand)
 		);
+		new_expression->repeat = e->repeat;
 		break;
 	case ABSTRACTION:
-		new_expression = new_abstraction(
+		new_expression = new_abstraction(ctx,
 			e->bound_variable,
-			copy_expression(e->body)
+			copy_expression(ctx, e->body)
 		);
 		break;
+	case ABBREVIATION:
+		new_expression = new_abbreviation_reference(ctx, e->abbreviation);
+		break;
 	}
 	new_expression->parameterized = e->parameterized;
+	new_expression->origin = e->origin;
+	return new_expression;
+}
+
+/* Like copy_expression(), but the copy has a copy of the definition
+ * everywhere the original has an ABBREVIATION node. */
+struct lambda_expression *
+expand_expression(struct lc_context *ctx, struct lambda_expression *e)
+{
+	struct lambda_expression *new_expression = NULL;
+	int parameterized = e->parameterized;
+	const char *origin = e->origin;
+	switch (e->typ)
+	{
+	case VARIABLE:
+		new_expression = new_variable(ctx, e->variable);
+		break;
+	case APPLICATION:
+		new_expression = new_application(ctx,
+			expand_expression(ctx, e->rator),
+			expand_expression(ctx, e->rand)
+		);
+		new_expression->repeat = e->repeat;
+		break;
+	case ABSTRACTION:
+		new_expression = new_abstraction(ctx,
+			e->bound_variable,
+			expand_expression(ctx, e->body)
+		);
+		break;
+	case ABBREVIATION:
+		new_expression = expand_expression(ctx, e->abbreviation->expression);
+		parameterized |= new_expression->parameterized;
+		origin = new_expression->origin;
+		break;
+	}
+	new_expression->parameterized = parameterized;
+	new_expression->origin = origin;
 	return new_expression;
 }
 
+/* Delta-reduction: replace an ABBREVIATION node with a copy of the
+ * abbreviation's definition, or its normal form. The copy can be an ABBREVIATION node
+ * in its own right, for things like "def B A". */
+struct lambda_expression *
+expand_abbreviation(struct lc_context *ctx, struct lambda_expression *ref)
+{
+	struct lambda_expression *r = copy_expression(ctx, abbreviation_expansion(ctx, ref->abbreviation));
+	if (ref->parameterized)
+		r->parameterized = 1;
+	free_expression(ctx, ref);
+	return r;
+}
+
+/* Look through any ABBREVIATION nodes to the expression
+ * that would replace them. */
+struct lambda_expression *
+abbreviation_definition(struct lambda_expression *e)
+{
+	while (ABBREVIATION == e->typ)
+		e = e->abbreviation->expression;
+	return e;
+}
+
 void
-free_all(void)
+free_all(struct lc_context *ctx)
 {
 	int freed_cnt = 0;
-	while (free_list)
-	{
-		struct lambda_expression *tmp = free_list->next_free;
-		free_list->variable = NULL;
-		free_list->bound_variable = NULL;
-		free_list->body = NULL;
-		free_list->rator = NULL;
-		free_list->rand = NULL;
-		free_list->next_free = NULL;
-		free(free_list);
+	while (ctx->free_list)
+	{
+		struct lambda_expression *tmp = ctx->free_list->next_free;
+		ctx->free_list->variable = NULL;
+		ctx->free_list->bound_variable = NULL;
+		ctx->free_list->body = NULL;
+		ctx->free_list->rator = NULL;
+		ctx->free_list->rand = NULL;
+		ctx->free_list->next_free = NULL;
 		++freed_cnt;
-		free_list = tmp;
+		ctx->free_list = tmp;
 	}
 
-	if (!interpreter_interrupted && freed_cnt != malloc_cnt)
-		printf("malloced %d structs lambda_expression, freed %d\n",
-			malloc_cnt, freed_cnt);
+	while (ctx->slabs)
+	{
+		struct node_slab *tmp = ctx->slabs->next;
+		free(ctx->slabs);
+		ctx->slabs = tmp;
+	}
+	ctx->slab_used = NODES_PER_SLAB;
+
+	if (freed_cnt != ctx->malloc_cnt)
+		fprintf(ctx->out, "malloced %ld structs lambda_expression, freed %d\n",
+			ctx->malloc_cnt, freed_cnt);
 }
 
 void
 find_free_vars(
+	struct lc_context *ctx,
 	struct lambda_expression *term,
 	struct small_hashtable *current_bound_vars,
 	struct small_hashtable *dict
 )
 {
-	const void *p = NULL;
-	int   previously_bound = 0;
+	struct walk_stack stack;
 
-	switch (term->typ)
+	init_walk_stack(&stack);
+	walk_push(&stack, term, WALK_VISIT);
+
+	while (stack.top > 0)
 	{
-	case VARIABLE:
-		if (NULL == find_node(current_bound_vars, term->variable))
-			(void)insert_value(dict, term->variable, term->variable);
-		break;
-	case APPLICATION:
-		find_free_vars(term->rator, current_bound_vars, dict);
-		find_free_vars(term->rand, current_bound_vars, dict);
-		break;
-	case ABSTRACTION:
-		p = insert_value(current_bound_vars, term->bound_variable, term->bound_variable);
-		previously_bound = (p != NULL);
-		find_free_vars(
-			term->body,
-			current_bound_vars,
-			dict
-		);
-		if (!previously_bound)
-			remove_key(current_bound_vars, term->bound_variable);
-		
-		break;
+		struct walk_frame *f = &stack.frames[--stack.top];
+		const void *p = NULL;
+		int i;
+
+		term = f->term;
+
+		if (WALK_VISIT != f->action)
+		{
+			/* Back out of an ABSTRACTION's body */
+			if (WALK_UNBIND == f->action)
+				remove_key(ctx, current_bound_vars, term->bound_variable);
+			continue;
+		}
+
+		switch (term->typ)
+		{
+		case VARIABLE:
+			if (NULL == find_node(current_bound_vars, term->variable))
+				(void)insert_value(ctx, dict, term->variable, term->variable);
+			break;
+		case APPLICATION:
+			/* rator gets popped, so looked at, first */
+			walk_push(&stack, term->rand, WALK_VISIT);
+			walk_push(&stack, term->rator, WALK_VISIT);
+			break;
+		case ABSTRACTION:
+			p = insert_value(ctx, current_bound_vars, term->bound_variable, term->bound_variable);
+			walk_push(&stack, term, (p != NULL)? WALK_LEAVE: WALK_UNBIND);
+			walk_push(&stack, term->body, WALK_VISIT);
+			break;
+		case ABBREVIATION:
+			/* Free variables of the definition got worked out when
+			 * it got defined, but some may be bound here. */
+			for (i = 0; i < term->abbreviation->free_var_count; ++i)
+			{
+				const char *v = term->abbreviation->free_vars[i];
+				if (NULL == find_node(current_bound_vars, v))
+					(void)insert_value(ctx, dict, v, v);
+			}
+			break;
+		}
 	}
+
+	free_walk_stack(&stack);
 }
 
 void
 find_bound_vars(
+	struct lc_context *ctx,
 	struct lambda_expression *term,
 	struct small_hashtable *bindings
 )
@@ -293,27 +665,30 @@ find_bound_vars(
 	case VARIABLE:
 		break;
 	case APPLICATION:
-		find_bound_vars(term->rator, bindings);
-		find_bound_vars(term->rand, bindings);
+		find_bound_vars(ctx, term->rator, bindings);
+		find_bound_vars(ctx, term->rand, bindings);
 		break;
 	case ABSTRACTION:
-		(void)insert_value(bindings, term->bound_variable, term->bound_variable);
-		find_bound_vars(
+		(void)insert_value(ctx, bindings, term->bound_variable, term->bound_variable);
+		find_bound_vars(ctx,
 			term->body,
 			bindings
 		);
 		break;
+	case ABBREVIATION:
+		find_bound_vars(ctx, term->abbreviation->expression, bindings);
+		break;
 	}
 }
 
 void
-free_vars(struct lambda_expression *term)
+free_vars(struct lc_context *ctx, struct lambda_expression *term)
 {
-	struct small_hashtable *free_var_dict = init_small_hashtable(32);
-	struct small_hashtable *bindings = init_small_hashtable(32);
+	struct small_hashtable *free_var_dict = init_small_hashtable(ctx, 32);
+	struct small_hashtable *bindings = init_small_hashtable(ctx, 32);
 	int i;
 
-	find_free_vars(term, bindings, free_var_dict);
+	find_free_vars(ctx, term, bindings, free_var_dict);
 
 	for (i = 0; i < free_var_dict->count; ++i)
 	{
@@ -321,22 +696,22 @@ free_vars(struct lambda_expression *term)
 		while (NULL != chain)
 		{
 			if (chain->key)
-				printf("\"%s\"\n", chain->key);
+				fprintf(ctx->out, "\"%s\"\n", chain->key);
 			chain = chain->next;
 		}
 	}
 	
-	free_small_hashtable(free_var_dict);
-	free_small_hashtable(bindings);  /* should have nothing in it here */
+	free_small_hashtable(ctx, free_var_dict);
+	free_small_hashtable(ctx, bindings);  /* should have nothing in it here */
 }
 
 void
-bound_vars(struct lambda_expression *term)
+bound_vars(struct lc_context *ctx, struct lambda_expression *term)
 {
-	struct small_hashtable *bindings = init_small_hashtable(32);
+	struct small_hashtable *bindings = init_small_hashtable(ctx, 32);
 	int i;
 
-	find_bound_vars(term, bindings);
+	find_bound_vars(ctx, term, bindings);
 
 	for (i = 0; i < bindings->count; ++i)
 	{
@@ -344,35 +719,83 @@ bound_vars(struct lambda_expression *term)
 		while (NULL != chain)
 		{
 			if (chain->key)
-				printf("\"%s\"\n", chain->key);
+				fprintf(ctx->out, "\"%s\"\n", chain->key);
 			chain = chain->next;
 		}
 	}
 	
-	free_small_hashtable(bindings);
+	free_small_hashtable(ctx, bindings);
 }
 
+/* Streams straight to the session's output: a normal form can have tens of
+ * millions of nodes, and its text doesn't need to fit in memory. */
 void
-print_expression(struct lambda_expression *exp)
+print_expression(struct lc_context *ctx, struct lambda_expression *exp)
 {
-	struct buffer *b = new_buffer(256);
+	struct buffer *b = new_stream_buffer(ctx->out, PRINT_CHUNK_SIZE);
 	buffer_expression(exp, b);
-	printf("%s\n", b->buffer);
+	buffer_append(b, "\n", 1);
+	flush_buffer(b);
 	delete_buffer(b);
 }
 
+/* node1's rator applied count1 times to its rand, as a repeated
+ * application stands for, against node2's applied count2 times.
+ * While both have applications of the same rator left, it skips the
+ * ones they have in common, so comparing big numerals costs little. */
+static int
+equivalent_applications(struct lambda_expression *node1, long count1, struct lambda_expression *node2, long count2)
+{
+	for (;;)
+	{
+		if (!equivalent_graphs(node1->rator, node2->rator))
+			return 0;
+
+		if (count1 > 1 && count2 > 1)
+		{
+			long common = ((count1 < count2)? count1: count2) - 1;
+			count1 -= common;
+			count2 -= common;
+		}
+
+		if (1 == count1 && 1 == count2)
+			return equivalent_graphs(node1->rand, node2->rand);
+
+		if (count1 > 1)
+			--count1;
+		else {
+			node1 = abbreviation_definition(node1->rand);
+			if (APPLICATION != node1->typ)
+				return 0;
+			count1 = node1->repeat? node1->repeat: 1;
+		}
+
+		if (count2 > 1)
+			--count2;
+		else {
+			node2 = abbreviation_definition(node2->rand);
+			if (APPLICATION != node2->typ)
+				return 0;
+			count2 = node2->repeat? node2->repeat: 1;
+		}
+	}
+}
+
 int
 equivalent_graphs(struct lambda_expression *node1, struct lambda_expression *node2)
 {
 	int r = 0;
 
+	node1 = abbreviation_definition(node1);
+	node2 = abbreviation_definition(node2);
+
 	if (node1->typ == node2->typ)
 	{
 		switch (node1->typ)
 		{
 		case APPLICATION:
-			r = equivalent_graphs(node1->rator, node2->rator)
-				&& equivalent_graphs(node1->rand, node2->rand);
+			r = equivalent_applications(node1, node1->repeat? node1->repeat: 1,
+				node2, node2->repeat? node2->repeat: 1);
 			break;
 		case VARIABLE:
 			if (node1->variable == node2->variable)
@@ -382,6 +805,8 @@ equivalent_graphs(struct lambda_expression *node1, struct lambda_expression *nod
 			if (node1->bound_variable == node2->bound_variable)
 				r = equivalent_graphs(node1->body, node2->body);
 			break;
+		case ABBREVIATION:  /* looked through above */
+			break;
 		}
 
 	}
@@ -390,34 +815,82 @@ equivalent_graphs(struct lambda_expression *node1, struct lambda_expression *nod
 }
 
 /* Return 1 if node1 and node2 alpha-equate.  Return 0 otherwise.
- * Globally-visible function.  Sets up for and calls
- * real_alpha_equivalent_graphs(), then cleans up afterward.
+ * Globally-visible function.  Walks the two terms side by side, and
+ * gives up on that for big terms, which get flattened to canonical
+ * arrays instead: that takes no recursion, however deep the terms,
+ * and memcmp() compares words as wide as the machine has.
  */
 int
-alpha_equivalent_graphs(struct lambda_expression *node1, struct lambda_expression *node2)
+alpha_equivalent_graphs(struct lc_context *ctx, struct lambda_expression *node1, struct lambda_expression *node2)
 {
-	int r = 0;
-	struct small_hashtable *map1 = init_small_hashtable(128);
-	struct small_hashtable *map2 = init_small_hashtable(128);
-	int abstraction_count = 0;
-	r = real_alpha_equivalent_graphs(node1, map1, node2, map2, abstraction_count);
-	free_small_hashtable(map1);
-	free_small_hashtable(map2);
+	struct alpha_state *s = alpha_state(ctx);
+	size_t length;
+	int r;
+
+	s->budget = ALPHA_WALK_NODES;
+	r = alpha_walk(s, node1, node2, 0);
+
+	if (s->budget < 0)
+	{
+		length = encode_term(s, 0, node1, 0);
+		r = length == encode_term(s, 1, node2, 0)
+			&& !memcmp(s->code[0], s->code[1], length*sizeof(s->code[0][0]));
+	}
+
 	return r;
 }
 
-/* Return 1 if node1 and node2 alpha-equate.  Return 0 otherwise. */
-int
-real_alpha_equivalent_graphs(
-	struct lambda_expression *node1,
-	struct small_hashtable *map1,
-	struct lambda_expression *node2,
-	struct small_hashtable *map2,
-	int abstraction_count
-)
+const unsigned int *
+canonical_form(struct lc_context *ctx, struct lambda_expression *term, int compact, size_t *length)
+{
+	struct alpha_state *s = alpha_state(ctx);
+
+	*length = encode_term(s, 0, term, compact);
+
+	return s->code[0];
+}
+
+/* A session's struct alpha_state, with a binding[] entry for every
+ * atom there is.  The terms being compared can't hold any atom that
+ * didn't exist before they did, so this is enough for one call. */
+static struct alpha_state *
+alpha_state(struct lc_context *ctx)
+{
+	struct alpha_state *s = ctx->alpha;
+	unsigned int atoms = Atom_count();
+
+	if (!s)
+		s = ctx->alpha = calloc(1, sizeof(*s));
+
+	if (atoms > s->atoms)
+	{
+		int side;
+
+		atoms += atoms/2 + 64;
+		for (side = 0; side < 2; ++side)
+		{
+			s->binding[side] = realloc(s->binding[side], atoms*sizeof(int));
+			memset(&s->binding[side][s->atoms], 0, (atoms - s->atoms)*sizeof(int));
+		}
+		s->atoms = atoms;
+	}
+
+	return s;
+}
+
+/* Return 1 if node1 and node2 alpha-equate, 0 otherwise, or 0 with
+ * s->budget below 0 if the terms turn out too big to finish. */
+static int
+alpha_walk(struct alpha_state *s, struct lambda_expression *node1, struct lambda_expression *node2, int depth)
 {
 	int r = 0;
 
+	if (--s->budget < 0)
+		return 0;
+
+	node1 = abbreviation_definition(node1);
+	node2 = abbreviation_definition(node2);
+
 	/* Don't even bother checking unless nodes possess the same type. */
 
 	if (node1->typ == node2->typ)
@@ -425,93 +898,228 @@ real_alpha_equivalent_graphs(
 		switch (node1->typ)
 		{
 		case APPLICATION:
-			r = real_alpha_equivalent_graphs(node1->rator, map1, node2->rator, map2, abstraction_count)
-				&& real_alpha_equivalent_graphs(node1->rand, map1, node2->rand, map2, abstraction_count);
+			r = alpha_applications(s, node1, node1->repeat? node1->repeat: 1,
+				node2, node2->repeat? node2->repeat: 1, depth);
 			break;
 
 		case VARIABLE: {
-			const char *x1 = (const char *)find_value(map1, node1->variable);
-			const char *x2 = (const char *)find_value(map2, node2->variable);
-			if (x1 && x2)
-			{
-				/* both variables currently bound */
-				if (x1 == x2)
-					r = 1;
-			} else if (!x1 && !x2) {
-				/* both variables not  bound */
-				if (node1->variable == node2->variable)
-					r = 1;
-			}
-			/* else one variable is currently bound, the other isn't,
-			 * the expressions don't alpha-equate. */
+			int level1 = s->binding[0][Atom_id(node1->variable)];
+			int level2 = s->binding[1][Atom_id(node2->variable)];
+
+			/* Bound by the same abstraction, counting from the top
+			 * of each term, or the same free variable.  One bound and
+			 * one free don't alpha-equate. */
+			if (level1 || level2)
+				r = level1 == level2;
+			else
+				r = node1->variable == node2->variable;
 			}
 			break;
 
 		case ABSTRACTION: {
-			/* add bound variables to maps, check bodies for alpha-equivalence,
-			 * then dispose of bound variable maps. Don't forget the case of
-			 * re-binding an already bound variable, something like:
-			 * \x y z. z (\x.y) z */
-			const char *mock_bound_var = determine_binding(node1->bound_variable, ++abstraction_count);
-			const char *old_mock_bound_var1 = find_value(map1, node1->bound_variable);
-			const char *old_mock_bound_var2 = find_value(map2, node2->bound_variable);
-
-			if (old_mock_bound_var1)
-			{
-				/* An exterior binding exists.  Rebind to the new "mock" bound variable */
-				remove_key(map1, node1->bound_variable);
-				remove_key(map2, node2->bound_variable);
+			/* Bind, compare bodies, then put back whatever binding
+			 * the body's abstraction shadowed, as in \x y z. z (\x.y) z */
+			int *slot1 = &s->binding[0][Atom_id(node1->bound_variable)];
+			int *slot2 = &s->binding[1][Atom_id(node2->bound_variable)];
+			int saved1 = *slot1, saved2 = *slot2;
+
+			*slot1 = *slot2 = depth + 1;
+			r = alpha_walk(s, node1->body, node2->body, depth + 1);
+			*slot1 = saved1;
+			*slot2 = saved2;
 			}
+			break;
+
+		case ABBREVIATION:  /* looked through above */
+			break;
+		}
+
+	}
+
+	return r;
+}
+
+/* alpha_walk() for applications, repeated count1 and count2 times:
+ * like equivalent_applications(), it skips the repetitions both
+ * have in common. */
+static int
+alpha_applications(struct alpha_state *s, struct lambda_expression *node1, long count1, struct lambda_expression *node2, long count2, int depth)
+{
+	for (;;)
+	{
+		if (!alpha_walk(s, node1->rator, node2->rator, depth))
+			return 0;
+
+		if (count1 > 1 && count2 > 1)
+		{
+			long common = ((count1 < count2)? count1: count2) - 1;
+			count1 -= common;
+			count2 -= common;
+		}
+
+		if (1 == count1 && 1 == count2)
+			return alpha_walk(s, node1->rand, node2->rand, depth);
+
+		if (count1 > 1)
+			--count1;
+		else {
+			node1 = abbreviation_definition(node1->rand);
+			if (APPLICATION != node1->typ)
+				return 0;
+			count1 = node1->repeat? node1->repeat: 1;
+		}
+
+		if (count2 > 1)
+			--count2;
+		else {
+			node2 = abbreviation_definition(node2->rand);
+			if (APPLICATION != node2->typ)
+				return 0;
+			count2 = node2->repeat? node2->repeat: 1;
+		}
+
+		if (--s->budget < 0)
+			return 0;
+	}
+}
+
+/* Flattens term, in prefix order, into s->code[side], and returns
+ * how many words that took.  Alpha-equivalent terms, and only those,
+ * flatten to the same words: 0 for an application, 1 for an
+ * abstraction, 2 + 2*level for a bound variable (the de Bruijn level
+ * of the abstraction binding it) and 3 + 2*Atom_id() for a free one.
+ * compact leaves repeated applications folded up, as CANONICAL_REPEAT,
+ * the count in two words, then the rator and the rand: the same words
+ * still mean alpha-equivalent terms, but not the other way around.
+ */
+static size_t
+encode_term(struct alpha_state *s, int side, struct lambda_expression *term, int compact)
+{
+	size_t length = 0, top = 0;
+	int depth = 0;
+
+	if (s->stack_size < 1)
+	{
+		s->stack_size = 1024;
+		s->stack = malloc(s->stack_size*sizeof(s->stack[0]));
+	}
+	s->stack[top].node = term;
+	s->stack[top++].repeat = 0;
 
-			insert_value(map1, node1->bound_variable, mock_bound_var);
-			insert_value(map2, node2->bound_variable, mock_bound_var);
+	while (top > 0)
+	{
+		struct alpha_frame *f = &s->stack[--top];
+		struct lambda_expression *e = f->node;
+		long repeat = f->repeat;
 
-			r = real_alpha_equivalent_graphs(
-				node1->body, map1,
-    			node2->body, map2,
-				abstraction_count
-			);
+		if (!e)
+		{
+			/* leaving an abstraction */
+			s->binding[side][f->id] = f->saved;
+			--depth;
+			continue;
+		}
+
+		/* Room for this node's words, and the frames it pushes */
+		if (length + 3 > s->code_size[side])
+		{
+			s->code_size[side] = s->code_size[side]? 2*s->code_size[side]: 4096;
+			s->code[side] = realloc(s->code[side], s->code_size[side]*sizeof(s->code[side][0]));
+		}
+		if (top + 2 > s->stack_size)
+		{
+			s->stack_size *= 2;
+			s->stack = realloc(s->stack, s->stack_size*sizeof(s->stack[0]));
+		}
 
-			remove_key(map1, node1->bound_variable);
-			remove_key(map2, node2->bound_variable);
+		e = abbreviation_definition(e);
 
-			if (old_mock_bound_var1)
+		switch (e->typ)
+		{
+		case APPLICATION:
+			if (!repeat)
+				repeat = e->repeat;
+			if (compact && repeat > 1)
 			{
-				/* Replace the now-unbound variables with their old bindings */
-				insert_value(map1, node1->bound_variable, old_mock_bound_var1);
-				insert_value(map2, node2->bound_variable, old_mock_bound_var2);
+				s->code[side][length++] = CANONICAL_REPEAT;
+				s->code[side][length++] = (unsigned int)(repeat & 0xffffffffUL);
+				s->code[side][length++] = (unsigned int)((unsigned long)repeat >> 16 >> 16);
+				s->stack[top].node = e->rand;
+				s->stack[top++].repeat = 0;
+				s->stack[top].node = e->rator;
+				s->stack[top++].repeat = 0;
+				break;
 			}
-			
+			s->code[side][length++] = 0;
+			if (repeat > 1)
+			{
+				s->stack[top].node = e;
+				s->stack[top++].repeat = repeat - 1;
+			} else {
+				s->stack[top].node = e->rand;
+				s->stack[top++].repeat = 0;
+			}
+			s->stack[top].node = e->rator;
+			s->stack[top++].repeat = 0;
+			break;
+
+		case ABSTRACTION: {
+			unsigned int id = Atom_id(e->bound_variable);
+
+			s->code[side][length++] = 1;
+			s->stack[top].node = NULL;
+			s->stack[top].id = id;
+			s->stack[top].saved = s->binding[side][id];
+			++top;
+			s->binding[side][id] = ++depth;
+			s->stack[top].node = e->body;
+			s->stack[top++].repeat = 0;
+			}
+			break;
+
+		case VARIABLE: {
+			unsigned int id = Atom_id(e->variable);
+
+			if (s->binding[side][id])
+				s->code[side][length++] = 2*s->binding[side][id];
+			else
+				s->code[side][length++] = 3 + 2*id;
 			}
 			break;
-		}
 
+		case ABBREVIATION:  /* looked through above */
+			break;
+		}
 	}
 
-	return r;
+	return length;
 }
 
-const char *
-determine_binding(const char *bound_var, int abstraction_count)
+void
+free_alpha_state(struct lc_context *ctx)
 {
-	const char *nm = NULL;
-	size_t len = 1+ strlen(bound_var) + 1 + 11 + 1;
-	char *buf = malloc(len);
-	snprintf(buf, len, ".%s_%d", bound_var, abstraction_count);
-	/* XXX - What if sprintf returns value > len? */
-	nm = Atom_string(buf);
-	free(buf);
-	buf = NULL;
-	return nm;
+	struct alpha_state *s = ctx->alpha;
+
+	if (s)
+	{
+		free(s->binding[0]);
+		free(s->binding[1]);
+		free(s->code[0]);
+		free(s->code[1]);
+		free(s->stack);
+		free(s);
+		ctx->alpha = NULL;
+	}
 }
 
 struct lambda_expression *
-deparameterize(struct lambda_expression *node, int count)
+deparameterize(struct lc_context *ctx, struct lambda_expression *node, long count)
 {
 	struct lambda_expression *r = NULL;
 	switch (node->typ)
 	{
 	case VARIABLE:
+	case ABBREVIATION:
 		/* Flow-of-control can get here for parameterized expressions
 		 * like (x *y).  The right-most variable (free or bound) gets
 		 * duplicated. */
@@ -521,48 +1129,43 @@ deparameterize(struct lambda_expression *node, int count)
 			struct lambda_expression *original_node = node;
 			r->parameterized = 0;
 			while (--count)
-				r = new_application(r, copy_expression(original_node));
+				r = new_application(ctx, r, copy_expression(ctx, original_node));
 		}
 		break;
 	case APPLICATION:
 		r = node;
 		if (r->parameterized)
 		{
-			int cnt = count;
+			long cnt = count;
 			struct lambda_expression *original_application = node;
 			r->parameterized = 0;
 			while (--cnt)
-				r = new_application(r, copy_expression(original_application));
+				r = new_application(ctx, r, copy_expression(ctx, original_application));
 			node = r;
 		}
 		if (node->rator->parameterized)
 		{
-			/* construct rator (rator (rator (... (rator rand)...) */
-			int cnt = count;
-			struct lambda_expression *tree = deparameterize(node->rand, count);
+			/* rator (rator (rator (... (rator rand)...), as one node
+			 * that unfold_application() takes apart when it has to */
+			node->rand = deparameterize(ctx, node->rand, count);
 			node->rator->parameterized = 0;
-			while (--cnt)
-			{
-				struct lambda_expression *n = copy_expression(node->rator);
-				tree = new_application(n, tree);
-			}
-			node->rand = tree;
+			node->repeat = (count > 1)? count: 0;
 			r = node;
 		} else {
 			r = node;
-			r->rand = deparameterize(node->rand, count);
-			r->rator = deparameterize(node->rator, count);
+			r->rand = deparameterize(ctx, node->rand, count);
+			r->rator = deparameterize(ctx, node->rator, count);
 		}
 		break;
 	case ABSTRACTION:
 		r = node;
-		r->body = deparameterize(node->body, count);
+		r->body = deparameterize(ctx, node->body, count);
 		if (r->parameterized)
 		{
 			struct lambda_expression *original_node = r;
 			r->parameterized = 0;
 			while (--count)
-				r = new_application(r, copy_expression(original_node));
+				r = new_application(ctx, r, copy_expression(ctx, original_node));
 		}
 		break;
 	}
@@ -570,82 +1173,321 @@ deparameterize(struct lambda_expression *node, int count)
 	return r;
 }
 
-/* From Torben Mogensen's "Efficient Self Interpretation in Lambda Calculus"
+/* Take the outermost application off a repeated one: it becomes an
+ * ordinary application whose rand is a copy of the rator, applied
+ * one time fewer. */
+void
+unfold_application(struct lc_context *ctx, struct lambda_expression *application)
+{
+	struct lambda_expression *rest = new_application(ctx,
+		copy_expression(ctx, application->rator),
+		application->rand
+	);
+
+	rest->repeat = (application->repeat > 2)? application->repeat - 1: 0;
+	rest->origin = application->origin;
+	application->rand = rest;
+	application->repeat = 0;
+}
+
+/* goedelize() and ungodelize() work from an explicit stack of these,
+ * so deep terms don't use up the C stack.  GODEL_VISIT frames are
+ * subterms still to do (a repeated application, with repeat
+ * applications left, comes back as itself), GODEL_APPLY and
+ * GODEL_ABSTRACT put together what the subterms turned into. */
+enum godel_action { GODEL_VISIT, GODEL_APPLY, GODEL_ABSTRACT };
+struct godel_frame {
+	struct lambda_expression *node;
+	long repeat;
+	enum godel_action action;
+};
+
+/* A subterm's encoding, or decoding, and for goedelize(), which of
+ * the one-letter names a..z, A..Z are free in it, as bits 0 to 51 */
+struct godel_value {
+	struct lambda_expression *term;
+	uint64_t letters;
+};
+
+struct godel_stacks {
+	struct godel_frame *frames;
+	size_t frame_top, frame_size;
+	struct godel_value *values;
+	size_t value_top, value_size;
+};
+
+static void
+godel_push(struct godel_stacks *g, struct lambda_expression *node, long repeat, enum godel_action action)
+{
+	if (g->frame_top == g->frame_size)
+	{
+		g->frame_size = g->frame_size? 2*g->frame_size: 256;
+		g->frames = realloc(g->frames, g->frame_size*sizeof(*g->frames));
+	}
+	g->frames[g->frame_top].node = node;
+	g->frames[g->frame_top].repeat = repeat;
+	g->frames[g->frame_top].action = action;
+	++g->frame_top;
+}
+
+static void
+godel_value(struct godel_stacks *g, struct lambda_expression *term, uint64_t letters)
+{
+	if (g->value_top == g->value_size)
+	{
+		g->value_size = g->value_size? 2*g->value_size: 256;
+		g->values = realloc(g->values, g->value_size*sizeof(*g->values));
+	}
+	g->values[g->value_top].term = term;
+	g->values[g->value_top].letters = letters;
+	++g->value_top;
+}
+
+/* The bit for a one-letter variable name, 0 for any other */
+static uint64_t
+letter_bit(const char *name)
+{
+	if (1 == Atom_length(name))
+	{
+		if ('a' <= name[0] && name[0] <= 'z')
+			return (uint64_t)1 << (name[0] - 'a');
+		if ('A' <= name[0] && name[0] <= 'Z')
+			return (uint64_t)1 << (26 + name[0] - 'A');
+	}
+	return 0;
+}
+
+/* Mogensen's \a b c. body, with a, b and c the names that
+ * find_nonfree_var() would pick, one after the other, for a term
+ * whose free variables (bound variable too, for an abstraction)
+ * include the letters in taken.  Working from the letters alone
+ * keeps goedelize() linear.  Only a term with nearly every letter
+ * free has to have its free variables found the slow way. */
+static struct lambda_expression *
+mogensen_wrapper(
+	struct lc_context *ctx,
+	struct lambda_expression *node,
+	const char *bound_variable,
+	uint64_t taken,
+	int which,
+	struct lambda_expression *inner
+)
+{
+	const char *names[3];
+	int i, n = 0;
+
+	for (i = 0; i < 52 && n < 3; ++i)
+		if (!(taken & ((uint64_t)1 << i)))
+		{
+			char letter[2];
+			letter[0] = (i < 26)? 'a' + i: 'A' + i - 26;
+			letter[1] = '\0';
+			names[n++] = Atom_string(letter);
+		}
+
+	if (n < 3)
+	{
+		struct small_hashtable *free_vars = init_small_hashtable(ctx, 64);
+		struct small_hashtable *bound = init_small_hashtable(ctx, 16);
+		find_free_vars(ctx, node, bound, free_vars);
+		if (bound_variable)
+			insert_value(ctx, free_vars, bound_variable, bound_variable);
+		for (n = 0; n < 3; ++n)
+		{
+			names[n] = find_nonfree_var(free_vars);
+			insert_value(ctx, free_vars, names[n], names[n]);
+		}
+		free_small_hashtable(ctx, bound);
+		free_small_hashtable(ctx, free_vars);
+	}
+
+	/* inner is what goes after the variable that says which kind
+	 * of term this is: a for variables, b, c for abstractions */
+	if (1 == which)
+	{
+		/* b M N: inner is M N, as an application */
+		inner->rator = new_application(ctx, new_variable(ctx, names[1]), inner->rator);
+	} else
+		inner = new_application(ctx, new_variable(ctx, names[which]), inner);
+
+	return new_abstraction(ctx, names[0],
+		new_abstraction(ctx, names[1],
+			new_abstraction(ctx, names[2], inner)));
+}
+
+/* From Torben Mogensen's "Efficient Self Interpretation in Lambda Calculus":
+ *   x      becomes  \a b c. a x
+ *   M N    becomes  \a b c. b M' N'
+ *   \x.M   becomes  \a b c. c (\x.M')
+ * with a, b and c not free in the term.  One pass, children before
+ * parents, finds which letters are free in each subterm as it goes.
  */
 struct lambda_expression *
-goedelize(struct lambda_expression *e)
+goedelize(struct lc_context *ctx, struct lambda_expression *e)
 {
+	struct godel_stacks g;
+	struct lambda_expression *r;
+
+	memset(&g, 0, sizeof(g));
+	godel_push(&g, e, 0, GODEL_VISIT);
+
+	while (g.frame_top > 0)
+	{
+		struct godel_frame f = g.frames[--g.frame_top];
+		struct lambda_expression *n = f.node;
+		struct godel_value *v;
+
+		switch (f.action)
+		{
+		case GODEL_VISIT:
+			n = abbreviation_definition(n);
+			switch (n->typ)
+			{
+			case VARIABLE: {
+				uint64_t bit = letter_bit(n->variable);
+				godel_value(&g, mogensen_wrapper(ctx, n, NULL, bit, 0,
+					new_variable(ctx, n->variable)), bit);
+				}
+				break;
+			case APPLICATION: {
+				long repeat = f.repeat? f.repeat: n->repeat;
+				godel_push(&g, n, 0, GODEL_APPLY);
+				if (repeat > 1)
+					godel_push(&g, n, repeat - 1, GODEL_VISIT);
+				else
+					godel_push(&g, n->rand, 0, GODEL_VISIT);
+				godel_push(&g, n->rator, 0, GODEL_VISIT);
+				}
+				break;
+			case ABSTRACTION:
+				godel_push(&g, n, 0, GODEL_ABSTRACT);
+				godel_push(&g, n->body, 0, GODEL_VISIT);
+				break;
+			case ABBREVIATION:  /* looked through above */
+				break;
+			}
+			break;
+
+		case GODEL_APPLY:
+			/* rator's value, then rand's, on top */
+			v = &g.values[g.value_top - 2];
+			v->letters |= v[1].letters;
+			v->term = mogensen_wrapper(ctx, n, NULL, v->letters, 1,
+				new_application(ctx, v->term, v[1].term));
+			--g.value_top;
+			break;
+
+		case GODEL_ABSTRACT: {
+			uint64_t bit = letter_bit(n->bound_variable);
+			v = &g.values[g.value_top - 1];
+			v->term = mogensen_wrapper(ctx, n, n->bound_variable, v->letters | bit, 2,
+				new_abstraction(ctx, n->bound_variable, v->term));
+			v->letters &= ~bit;
+			}
+			break;
+		}
+	}
+
+	r = g.values[0].term;
+	free(g.frames);
+	free(g.values);
+
+	return r;
+}
+
+/* The three bound variables of what might be \a b c. body, with
+ * body, or 0 if e doesn't look like that. */
+static int
+mogensen_parts(struct lambda_expression *e, const char *names[3], struct lambda_expression **body)
+{
+	int i;
+
+	for (i = 0; i < 3; ++i)
+	{
+		e = abbreviation_definition(e);
+		if (ABSTRACTION != e->typ)
+			return 0;
+		names[i] = e->bound_variable;
+		e = e->body;
+	}
+	*body = abbreviation_definition(e);
+
+	return names[0] != names[1] && names[1] != names[2] && names[0] != names[2]
+		&& APPLICATION == (*body)->typ && !(*body)->repeat;
+}
+
+/* Undoes goedelize(): the term that e, a Mogensen-style encoding in
+ * normal form, encodes, or NULL if e isn't one.  Bound variables can
+ * go by any names, as after reduction, but the shapes have to match:
+ *   \a b c. a x          for the variable x
+ *   \a b c. b M N        for M N
+ *   \a b c. c (\x.M)     for \x.M
+ */
+struct lambda_expression *
+ungodelize(struct lc_context *ctx, struct lambda_expression *e)
+{
+	struct godel_stacks g;
 	struct lambda_expression *r = NULL;
-	struct small_hashtable *term_free_vars = init_small_hashtable(16);
-	struct small_hashtable *bnd_vrs = init_small_hashtable(16);
-	const char *a, *b, *c;
+	int ok = 1;
 
-	find_free_vars(e, bnd_vrs, term_free_vars);
+	memset(&g, 0, sizeof(g));
+	godel_push(&g, e, 0, GODEL_VISIT);
 
-	switch (e->typ)
+	while (ok && g.frame_top > 0)
 	{
-	case VARIABLE:
-		a = find_nonfree_var(term_free_vars);
-		insert_value(term_free_vars, a, a);
-		b = find_nonfree_var(term_free_vars);
-		insert_value(term_free_vars, b, b);
-		c = find_nonfree_var(term_free_vars);
-		r = new_abstraction(Atom_string(a),
-			new_abstraction(Atom_string(b),
-				new_abstraction(Atom_string(c),
-					new_application(
-						new_variable(Atom_string(a)),
-						new_variable(Atom_string(e->variable))
-					)
-				)
-			)
-		);
-		break;
-	case APPLICATION:
-		a = find_nonfree_var(term_free_vars);
-		insert_value(term_free_vars, a, a);
-		b = find_nonfree_var(term_free_vars);
-		insert_value(term_free_vars, b, b);
-		c = find_nonfree_var(term_free_vars);
-		r = new_abstraction(Atom_string(a),
-			new_abstraction(Atom_string(b),
-				new_abstraction(Atom_string(c),
-					new_application(
-						new_application(
-							new_variable(Atom_string(b)),
-							goedelize(e->rator)
-						),
-						goedelize(e->rand)
-					)
-				)
-			)
-		);
-		break;
-	case ABSTRACTION:
-		insert_value(term_free_vars, e->bound_variable, e->bound_variable);
-		a = find_nonfree_var(term_free_vars);
-		insert_value(term_free_vars, a, a);
-		b = find_nonfree_var(term_free_vars);
-		insert_value(term_free_vars, b, b);
-		c = find_nonfree_var(term_free_vars);
-		r = new_abstraction(Atom_string(a),
-			new_abstraction(Atom_string(b),
-				new_abstraction(Atom_string(c),
-					new_application(
-						new_variable(Atom_string(c)),
-						new_abstraction(
-							e->bound_variable,
-							goedelize(e->body)
-						)
-					)
-				)
-			)
-		);
-		break;
+		struct godel_frame f = g.frames[--g.frame_top];
+		struct godel_value *v;
+		const char *names[3];
+		struct lambda_expression *body, *head, *rand;
+
+		switch (f.action)
+		{
+		case GODEL_VISIT:
+			if (!(ok = mogensen_parts(f.node, names, &body)))
+				break;
+			head = abbreviation_definition(body->rator);
+			rand = abbreviation_definition(body->rand);
+			if (VARIABLE == head->typ && names[0] == head->variable
+				&& VARIABLE == rand->typ && names[0] != rand->variable
+				&& names[1] != rand->variable && names[2] != rand->variable)
+				godel_value(&g, new_variable(ctx, rand->variable), 0);
+			else if (VARIABLE == head->typ && names[2] == head->variable
+				&& ABSTRACTION == rand->typ)
+			{
+				godel_push(&g, rand, 0, GODEL_ABSTRACT);
+				godel_push(&g, rand->body, 0, GODEL_VISIT);
+			} else if (APPLICATION == head->typ && !head->repeat
+				&& VARIABLE == abbreviation_definition(head->rator)->typ
+				&& names[1] == abbreviation_definition(head->rator)->variable)
+			{
+				godel_push(&g, NULL, 0, GODEL_APPLY);
+				godel_push(&g, body->rand, 0, GODEL_VISIT);
+				godel_push(&g, head->rand, 0, GODEL_VISIT);
+			} else
+				ok = 0;
+			break;
+
+		case GODEL_APPLY:
+			v = &g.values[g.value_top - 2];
+			v->term = new_application(ctx, v->term, v[1].term);
+			--g.value_top;
+			break;
+
+		case GODEL_ABSTRACT:
+			v = &g.values[g.value_top - 1];
+			v->term = new_abstraction(ctx, f.node->bound_variable, v->term);
+			break;
+		}
 	}
 
-	free_small_hashtable(term_free_vars);
-	free_small_hashtable(bnd_vrs);
+	if (ok)
+		r = g.values[0].term;
+	else
+		while (g.value_top > 0)
+			free_expression(ctx, g.values[--g.value_top].term);
+
+	free(g.frames);
+	free(g.values);
 
 	return r;
 }
@@ -676,14 +1518,23 @@ find_nonfree_var(
 		}
 	}
 
-	if (NULL == r)
+	if (NULL == r && 'a' == lower)
 	{
 		lower = 'A';
 		upper = 'Z';
 		goto try_again;
 	}
 
-	/* try 2, 3, 4... length strings of characters */
+	/* Every letter's taken: try v1, v2, v3... */
+	for (c = 1; NULL == r; ++c)
+	{
+		const char *candidate;
+		char buffer[24];
+		snprintf(buffer, sizeof(buffer), "v%d", c);
+		candidate = Atom_string(buffer);
+		if (NULL == find_value(free_vrs, candidate))
+			r = candidate;
+	}
 
 	return r;
 }
@@ -29,7 +29,7 @@
  * evaluation.
  */
 
-enum lambda_expression_type { VARIABLE, APPLICATION, ABSTRACTION };
+enum lambda_expression_type { VARIABLE, APPLICATION, ABSTRACTION, ABBREVIATION };
 
 struct lambda_expression {
 	enum lambda_expression_type typ;
@@ -44,43 +44,84 @@ struct lambda_expression {
 	/* typ == APPLICATION */
 	struct lambda_expression *rator;
 	struct lambda_expression *rand;
+	/* More than 1: this node stands for repeat applications of rator,
+	 * rator (rator (... (rator rand))), as deparameterize() makes them
+	 * for name{N}.  They get unfolded one at a time, as reduction gets
+	 * to them.  0 for an ordinary application. */
+	long repeat;
+
+	/* typ == ABBREVIATION, a not-yet-expanded use of an abbreviation */
+	struct abbreviation *abbreviation;
 
 	int parameterized;
 
+	/* Name of the abbreviation whose definition this node got copied
+	 * from, or NULL for typed-in terms.  Substitution passes it along
+	 * to the nodes it builds, so the profiler can charge work to it. */
+	const char *origin;
+
 	/* housekeeping */
 	struct lambda_expression *next_free;
 };
 
-struct lambda_expression *new_variable(const char *identifier);
+struct lambda_expression *new_variable(struct lc_context *ctx, const char *identifier);
 struct lambda_expression *new_application(
+	struct lc_context *ctx,
 	struct lambda_expression *rator,
 	struct lambda_expression *rand
 );
 struct lambda_expression *new_abstraction(
+	struct lc_context *ctx,
 	const char *bound_variable,
 	struct lambda_expression *body
 );
 
-struct lambda_expression *copy_expression(struct lambda_expression *le);
+struct lambda_expression *new_abbreviation_reference(struct lc_context *ctx, struct abbreviation *a);
 
-void free_expression(struct lambda_expression *expression);
+struct lambda_expression *copy_expression(struct lc_context *ctx, struct lambda_expression *le);
+struct lambda_expression *expand_expression(struct lc_context *ctx, struct lambda_expression *le);
+struct lambda_expression *expand_abbreviation(struct lc_context *ctx, struct lambda_expression *ref);
+struct lambda_expression *abbreviation_definition(struct lambda_expression *e);
 
-struct lambda_expression *deparameterize(struct lambda_expression *graph, int count);
+void free_expression(struct lc_context *ctx, struct lambda_expression *expression);
+void tag_expression(struct lambda_expression *expression, const char *origin);
 
-void buffer_expression(struct lambda_expression *expression, struct buffer *buf);
-void print_expression(struct lambda_expression *exp);
-int equivalent_graphs(struct lambda_expression *node1, struct lambda_expression *node2);
-int alpha_equivalent_graphs(struct lambda_expression *node1, struct lambda_expression *node2);
+struct lambda_expression *deparameterize(struct lc_context *ctx, struct lambda_expression *graph, long count);
+void unfold_application(struct lc_context *ctx, struct lambda_expression *application);
 
-void free_all(void);
+/* Bytes of output text print_expression() and friends hold at once */
+#define PRINT_CHUNK_SIZE 65536
 
-void free_vars(struct lambda_expression *term);
-void bound_vars(struct lambda_expression *term);
+void buffer_expression(struct lambda_expression *expression, struct buffer *buf);
+void print_expression(struct lc_context *ctx, struct lambda_expression *exp);
+int equivalent_graphs(struct lambda_expression *node1, struct lambda_expression *node2);
+int alpha_equivalent_graphs(struct lc_context *ctx, struct lambda_expression *node1, struct lambda_expression *node2);
+void free_alpha_state(struct lc_context *ctx);
+/* term as the words alpha_equivalent_graphs() compares big terms by:
+ * alpha-equivalent terms, and only those, get the same words.  With
+ * compact, a repeated application stays CANONICAL_REPEAT, its count
+ * in two words, its rator and its rand, and the same words still mean
+ * alpha-equivalent terms, but not the other way around.  The words
+ * belong to the session, and the next call reuses them. */
+#define CANONICAL_REPEAT 0xffffffffU
+const unsigned int *canonical_form(struct lc_context *ctx, struct lambda_expression *term, int compact, size_t *length);
+
+void free_all(struct lc_context *ctx);
+long nodes_allocated(struct lc_context *ctx);
+long nodes_freed(struct lc_context *ctx);
+long nodes_peak(struct lc_context *ctx);
+long nodes_peak_since_mark(struct lc_context *ctx);
+void mark_nodes_peak(struct lc_context *ctx);
+
+void free_vars(struct lc_context *ctx, struct lambda_expression *term);
+void bound_vars(struct lc_context *ctx, struct lambda_expression *term);
 void find_free_vars(
+	struct lc_context *ctx,
 	struct lambda_expression *term,
 	struct small_hashtable *current_bound_vars,
 	struct small_hashtable *dict
 );
 
-struct lambda_expression *goedelize(struct lambda_expression *e);
+struct lambda_expression *goedelize(struct lc_context *ctx, struct lambda_expression *e);
+struct lambda_expression *ungodelize(struct lc_context *ctx, struct lambda_expression *e);
 const char *find_nonfree_var(struct small_hashtable *free_vars);
@@ -0,0 +1,269 @@
+/*
+	Copyright (C) 2006-2011, Bruce Ediger
+
+    This file is part of lc.
+
+    lc is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    lc is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with lc; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/*
+ * lc, the interactive interpreter: command line flags, -L files and
+ * images, then a read-eval-print loop on stdin, or batch or server
+ * mode.  Reading and evaluating statements is grammar.y's work; this
+ * is only the front end to it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>    /* atoi(), atol(), malloc(), free() */
+#include <unistd.h>
+#include <getopt.h>    /* getopt_long() */
+#include <signal.h>    /* sig_atomic_t */
+#include <stdint.h>    /* uint64_t, for trace.h */
+#include <sys/time.h>  /* gettimeofday() */
+#include <sys/types.h>
+#include <sys/stat.h>  /* struct stat, for image.h */
+#include <sys/resource.h>  /* getrusage() */
+
+#include <context.h>
+#include <hashtable.h>
+#include <atom.h>
+#include <buffer.h>
+#include <small_hashtable.h>
+#include <lambda_expression.h>
+#include <image.h>
+#include <batch.h>
+#include <serve.h>
+#include <writer.h>
+#include <trace.h>
+#include <profile.h>
+#include <json.h>
+#include <liblc.h>
+
+/* these live in grammar.y and lex.l */
+extern int yyparse(struct lc_context *ctx, void *scanner);
+extern int load_file(struct lc_context *ctx, const char *filename);
+extern void take_signals(struct lc_context *ctx);
+extern void continue_reduction(struct lc_context *ctx);
+extern float elapsed_time(struct timeval before, struct timeval after);
+extern void set_yyin_stdin(struct lc_context *ctx);
+extern void reset_yyin(struct lc_context *ctx);
+
+void usage(char *progname);
+void print_statistics(struct lc_context *ctx);
+
+struct filename_node {
+	const char *filename;
+	struct filename_node *next;
+};
+
+int print_stats = 0;          /* -s: resource use on stderr at exit */
+static struct timeval started;  /* for -s */
+
+int
+main(int ac, char **av)
+{
+	int r, c;
+	struct lc_context *ctx;
+	struct filename_node *p;
+	struct filename_node *load_files = NULL, *load_tail = NULL;
+	const char *image_file = NULL;
+	int resume = 0;
+	int json_output = 0;
+	int batch_workers = 0;
+	const char *socket_path = NULL;
+	long node_budget = 0;
+	static struct option long_options[] = {
+		{"serve", required_argument, NULL, 'l'},
+		{NULL, 0, NULL, 0}
+	};
+
+	gettimeofday(&started, NULL);
+
+	/* A liblc session, except that it prompts and prints its
+	 * syntax errors, and it alone takes signals */
+	ctx = lc_open();
+	ctx->embedded = 0;
+	ctx->prompting = 1;
+	take_signals(ctx);
+
+	while (-1 != (c = getopt_long(ac, av, "aCdJL:R:S:Tj:m:n:pst:", long_options, NULL)))
+	{
+		switch (c)
+		{
+		case 'L':
+			p = malloc(sizeof(*p));
+			p->filename = Atom_string(optarg);
+			p->next = NULL;
+			if (load_tail)
+				load_tail->next = p;
+			load_tail = p;
+			if (!load_files)
+				load_files = p;
+			break;
+		case 'p':
+			ctx->prompting = 0;
+			break;
+		case 's':
+			print_stats = 1;
+			break;
+		case 'R':
+			resume = 1;
+			/* FALLTHROUGH */
+		case 'S':
+			image_file = Atom_string(optarg);
+			break;
+		case 'C':
+			ctx->use_compiled_files = 1;
+			break;
+		case 'a':
+			ctx->asynchronous_output = 1;
+			break;
+		case 'd':
+			ctx->detect_divergence = 1;
+			break;
+		case 'T':
+			ctx->typed_evaluation = 1;
+			break;
+		case 'J':
+			json_output = 1;
+			ctx->prompting = 0;
+			break;
+		case 'j':
+			batch_workers = atoi(optarg);
+			ctx->prompting = 0;
+			break;
+		case 't':
+			ctx->reduction_timeout = atoi(optarg);
+			break;
+		case 'n':
+			ctx->step_limit = atol(optarg);
+			break;
+		case 'm':
+			node_budget = atol(optarg);
+			break;
+		case 'l':  /* --serve, which has no short form */
+			socket_path = optarg;
+			ctx->prompting = 0;
+			break;
+		default:
+			usage(av[0]);
+			exit(1);
+			break;
+		}
+	}
+
+	/* Server answers have a format of their own */
+	if (json_output && !socket_path)
+		json_start(ctx);
+
+	if (image_file)
+		(void)read_image(ctx, image_file, &ctx->previous_result, &ctx->suspended,
+			&ctx->suspended_state, NULL);
+
+	if (load_files)
+	{
+		struct filename_node *t, *z;
+		for (z = load_files; z; z = t)
+		{
+			t = z->next;
+
+			if (!ctx->json)
+				fprintf(ctx->out, "load file named \"%s\"\n",
+					z->filename);
+
+			(void)load_file(ctx, z->filename);
+
+			free(z);
+		}
+	}
+
+	if (resume)
+	{
+		if (ctx->suspended)
+			continue_reduction(ctx);
+		else
+			fprintf(ctx->out, "No reduction in \"%s\"\n", image_file);
+	}
+
+	if (socket_path)
+		r = run_server(ctx, socket_path, batch_workers, node_budget);
+	else if (batch_workers > 0)
+		r = run_batch(ctx, stdin, batch_workers);
+	else {
+		set_yyin_stdin(ctx);
+
+		do {
+			if (ctx->prompting) fprintf(ctx->out, "LC> ");
+			r =  yyparse(ctx, ctx->scanner);
+		} while (r);
+		if (ctx->prompting) fprintf(ctx->out, "\n");
+	}
+
+	json_stop(ctx);
+	writer_finish(ctx);
+	trace_close(ctx);
+	profile_report_total(ctx);
+	if (print_stats) print_statistics(ctx);
+
+	reset_yyin(ctx);
+
+	free_context(ctx);
+	free_atom_table();
+
+	return r;
+}
+
+void
+usage(char *progname)
+{
+	fprintf(stderr, "%s: lambda calculater\n", progname);
+	fprintf(stderr, "Flags:\n");
+	fprintf(stderr, "  -L <filename>   read and evaluate filename before accepting user input.\n");
+	fprintf(stderr, "  -S <filename>   start from an image written by \"save\".\n");
+	fprintf(stderr, "  -R <filename>   start from an image, continuing its reduction.\n");
+	fprintf(stderr, "  -C              keep compiled images of loaded files, use them when current.\n");
+	fprintf(stderr, "  -p              don't do any prompting.\n");
+	fprintf(stderr, "  -j <number>     evaluate stdin lines in that many worker processes.\n");
+	fprintf(stderr, "  -t <seconds>    give up on a reduction after that long.\n");
+	fprintf(stderr, "  -n <steps>      give up on a reduction after that many steps.\n");
+	fprintf(stderr, "  -a              \"print > file\" writes files in a separate thread.\n");
+	fprintf(stderr, "  -d              stop reductions that cycle or grow around copies of themselves.\n");
+	fprintf(stderr, "  -T              evaluate terms with a simple type by need, not by substituting.\n");
+	fprintf(stderr, "  -J              print a JSON object for each statement, one per line.\n");
+	fprintf(stderr, "  -s              print steps, node counts and resource use on exit.\n");
+	fprintf(stderr, "  --serve <path>  answer requests on a Unix domain socket, with -j threads;\n");
+	fprintf(stderr, "                  -t, -n and -m <nodes> cap each request's budget.\n");
+}
+
+/* One line of key=value pairs, for bench/run and other scripts.
+ * Peak nodes counts lambda expression nodes in use at once. */
+void
+print_statistics(struct lc_context *ctx)
+{
+	struct rusage ru;
+	struct timeval now;
+	struct timeval zero = {0, 0};
+
+	gettimeofday(&now, NULL);
+	getrusage(RUSAGE_SELF, &ru);
+
+	fprintf(stderr, "beta=%ld eta=%ld typable=%ld fast_path=%ld nodes=%ld peak_nodes=%ld max_rss_kb=%ld seconds=%.3f cpu_seconds=%.3f\n",
+		ctx->total_beta_steps, ctx->total_eta_steps,
+		ctx->typed_reductions, ctx->fast_paths,
+		nodes_allocated(ctx), nodes_peak(ctx), ru.ru_maxrss,
+		elapsed_time(started, now),
+		elapsed_time(zero, ru.ru_utime) + elapsed_time(zero, ru.ru_stime));
+}
@@ -0,0 +1,124 @@
+/*
+	Copyright (C) 2006-2011, Bruce Ediger
+
+    This file is part of lc.
+
+    lc is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    lc is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with lc; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/*
+ * lcclient: send lines of standard input to an "lc --serve" server,
+ * one request at a time, and print each answer.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>     /* strlen(), strerror() */
+#include <errno.h>
+#include <unistd.h>     /* write(), close() */
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>     /* struct sockaddr_un */
+
+static void usage(const char *progname);
+static int  blank(const char *line);
+
+int
+main(int ac, char **av)
+{
+	struct sockaddr_un addr;
+	char *line = NULL, *answer = NULL;
+	size_t line_size = 0, answer_size = 0;
+	ssize_t length;
+	FILE *from;
+	int fd;
+
+	if (ac != 2 || strlen(av[1]) >= sizeof(addr.sun_path))
+	{
+		usage(av[0]);
+		exit(1);
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, av[1]);
+
+	if (0 > (fd = socket(AF_UNIX, SOCK_STREAM, 0))
+		|| connect(fd, (struct sockaddr *)&addr, sizeof(addr)))
+	{
+		fprintf(stderr, "Problem connecting to \"%s\": %s\n", av[1], strerror(errno));
+		exit(1);
+	}
+	from = fdopen(fd, "r");
+
+	while (0 < (length = getline(&line, &line_size, stdin)))
+	{
+		const char *p = line;
+
+		/* The server doesn't answer blank lines */
+		if (blank(line))
+			continue;
+
+		if ('\n' != line[length - 1])
+		{
+			line = realloc(line, length + 2);
+			line[length++] = '\n';
+			line[length] = '\0';
+		}
+
+		while (length > 0)
+		{
+			ssize_t n = write(fd, p, length);
+			if (n <= 0)
+			{
+				fprintf(stderr, "Problem sending to \"%s\": %s\n", av[1], strerror(errno));
+				exit(1);
+			}
+			p += n;
+			length -= n;
+		}
+
+		if (0 >= getline(&answer, &answer_size, from))
+		{
+			fprintf(stderr, "Server \"%s\" went away\n", av[1]);
+			exit(1);
+		}
+		fputs(answer, stdout);
+		fflush(stdout);
+	}
+
+	fclose(from);
+	free(line);
+	free(answer);
+
+	return 0;
+}
+
+static int
+blank(const char *line)
+{
+	for (; *line; ++line)
+		if (' ' != *line && '\t' != *line && '\r' != *line && '\n' != *line)
+			return 0;
+	return 1;
+}
+
+static void
+usage(const char *progname)
+{
+	fprintf(stderr, "%s: send requests to \"lc --serve\"\n", progname);
+	fprintf(stderr, "usage: %s socket < requests\n", progname);
+}
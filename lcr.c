@@ -0,0 +1,193 @@
+/*
+	Copyright (C) 2006-2011, Bruce Ediger
+
+    This file is part of lc.
+
+    lc is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    lc is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with lc; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/*
+ * lcr: produce random, yet syntactically-correct lambda calculus terms,
+ * for stress testing lc.  Takes the same arguments as the old lcr.py,
+ * which it replaces:
+ *
+ *   lcr [-s seed] [expressions [min_tokens [consecutive]]]
+ *
+ * Each expression is at least min_tokens variables long.  With
+ * consecutive greater than zero, each line applies one expression to
+ * that many more, all parenthesized.  The same seed always produces
+ * the same output, on any machine: the first line of output, an lc
+ * comment, records the seed used.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>       /* time() */
+#include <unistd.h>     /* getopt(), getpid() */
+
+static unsigned long long rng_state;
+
+static unsigned int choose(unsigned int n);
+static void output_binding(void);
+static void output_expression(long min_tokens);
+static void usage(const char *progname);
+
+/* Same tokens, in the same proportions, as lcr.py */
+static const char *tokens[] = {
+	"\\", "\\", "\\", "\\", "\\", "\\",
+	"a", "b", "c", "d", "e", "x", "y", "z",
+	"A", "B", "C", "D", "E", "F", "G",
+	"(", "(", "("
+};
+#define TOKEN_COUNT (sizeof(tokens)/sizeof(tokens[0]))
+
+/* Bound variables, then the chances of ending the binding list */
+static const char *binding_vars[] = {
+	"x", "y", "z", "w", "a", ".", ".", "."
+};
+
+int
+main(int ac, char **av)
+{
+	int c;
+	long expressions = 1;
+	long min_tokens = 3;
+	long consecutive = 0;
+	unsigned long long seed = (unsigned long long)time(NULL) ^ ((unsigned long long)getpid() << 32);
+	long i;
+
+	while (-1 != (c = getopt(ac, av, "s:")))
+	{
+		switch (c)
+		{
+		case 's':
+			seed = strtoull(optarg, NULL, 0);
+			break;
+		default:
+			usage(av[0]);
+			exit(1);
+			break;
+		}
+	}
+
+	if (optind < ac) expressions = atol(av[optind++]);
+	if (optind < ac) min_tokens  = atol(av[optind++]);
+	if (optind < ac) consecutive = atol(av[optind++]);
+	if (optind < ac || expressions < 0 || min_tokens < 1 || consecutive < 0)
+	{
+		usage(av[0]);
+		exit(1);
+	}
+
+	/* xorshift gets stuck at zero */
+	rng_state = seed? seed: 0x9E3779B97F4A7C15ULL;
+
+	setvbuf(stdout, NULL, _IOFBF, 1 << 16);
+	printf("# lcr -s %llu %ld %ld %ld\n", seed, expressions, min_tokens, consecutive);
+
+	for (i = 0; i < expressions; ++i)
+	{
+		long cnt;
+
+		if (consecutive > 0) fputs("( ", stdout);
+		output_expression(min_tokens);
+		if (consecutive > 0) fputs(") ", stdout);
+		for (cnt = consecutive; cnt > 0; --cnt)
+		{
+			fputs("( ", stdout);
+			output_expression(min_tokens);
+			fputs(") ", stdout);
+		}
+		putchar('\n');
+	}
+
+	if (fflush(stdout) || ferror(stdout))
+	{
+		perror("lcr: writing output");
+		return 1;
+	}
+
+	return 0;
+}
+
+/* xorshift64*: fast, and the same sequence everywhere */
+static unsigned int
+choose(unsigned int n)
+{
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return (unsigned int)(((rng_state * 0x2545F4914F6CDD1DULL) >> 32) % n);
+}
+
+static void
+output_binding(void)
+{
+	const char *token = binding_vars[choose(5)];
+
+	fputs("\\", stdout);
+	fputs(token, stdout);
+
+	while ('.' != *(token = binding_vars[choose(8)]))
+	{
+		putchar(' ');
+		fputs(token, stdout);
+	}
+
+	fputs(". ", stdout);
+}
+
+/* lcr.py recursed on "(": the parenthesized expression used up all
+ * the remaining tokens, so every ")" came at the very end.  Counting
+ * open parentheses does the same thing without recursion, which
+ * matters for multi-million token terms.
+ */
+static void
+output_expression(long min_tokens)
+{
+	long output_tokens = 0;
+	long open_parens = 0;
+
+	while (output_tokens < min_tokens)
+	{
+		const char *token = tokens[choose(TOKEN_COUNT)];
+
+		switch (token[0])
+		{
+		case '\\':
+			output_binding();
+			break;
+		case '(':
+			fputs("( ", stdout);
+			++open_parens;
+			break;
+		default:
+			fputs(token, stdout);
+			putchar(' ');
+			++output_tokens;
+			break;
+		}
+	}
+
+	while (open_parens-- > 0)
+		fputs(") ", stdout);
+}
+
+static void
+usage(const char *progname)
+{
+	fprintf(stderr, "usage: %s [-s seed] [expressions [min_tokens [consecutive]]]\n", progname);
+}
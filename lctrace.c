@@ -0,0 +1,330 @@
+/*
+	Copyright (C) 2006-2011, Bruce Ediger
+
+    This file is part of lc.
+
+    lc is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    lc is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with lc; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/*
+ * lctrace: decode a binary trace file written by lc's "trace > file"
+ * command.  By default, prints one line per event.  With -s, prints
+ * statistics about the steps instead.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>     /* memcmp(), strerror() */
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>       /* ctime() */
+#include <unistd.h>     /* getopt(), close() */
+#include <fcntl.h>      /* open() */
+#include <sys/types.h>
+#include <sys/stat.h>   /* fstat() */
+#include <sys/mman.h>   /* mmap() */
+
+#include <trace.h>
+
+struct name_count {
+	uint32_t name;
+	unsigned long count;
+};
+
+static const char *kind_names[] = {
+	"?", "start", "beta", "eta", "delta", "end"
+};
+
+static const char **names = NULL;
+static uint32_t name_count = 0;
+
+static void  usage(const char *progname);
+static void  read_names(const char *base, size_t size, uint64_t offset);
+static const char *name_of(uint32_t name, char *scratch);
+static const char *path_of(const struct trace_event *ev, char *scratch);
+static void  print_events(const struct trace_header *h, const struct trace_event *ring);
+static void  print_statistics(const struct trace_header *h, const struct trace_event *ring);
+static int   by_count(const void *a, const void *b);
+
+int
+main(int ac, char **av)
+{
+	int c, fd, statistics = 0;
+	struct stat st;
+	const char *base;
+	const struct trace_header *h;
+
+	while (-1 != (c = getopt(ac, av, "s")))
+	{
+		switch (c)
+		{
+		case 's':
+			statistics = 1;
+			break;
+		default:
+			usage(av[0]);
+			exit(1);
+		}
+	}
+
+	if (optind != ac - 1)
+	{
+		usage(av[0]);
+		exit(1);
+	}
+
+	if ((fd = open(av[optind], O_RDONLY)) < 0 || fstat(fd, &st) < 0)
+	{
+		fprintf(stderr, "Problem reading \"%s\": %s\n", av[optind], strerror(errno));
+		exit(1);
+	}
+
+	if (st.st_size < (off_t)sizeof(*h)
+		|| MAP_FAILED == (base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)))
+	{
+		fprintf(stderr, "\"%s\" isn't a trace file\n", av[optind]);
+		exit(1);
+	}
+
+	h = (const struct trace_header *)base;
+
+	if (memcmp(h->magic, TRACE_MAGIC, sizeof(h->magic))
+		|| TRACE_VERSION != h->version
+		|| sizeof(struct trace_event) != h->event_size
+		|| (uint64_t)st.st_size < sizeof(*h) + h->capacity*h->event_size)
+	{
+		fprintf(stderr, "\"%s\" isn't a trace file this lctrace understands\n", av[optind]);
+		exit(1);
+	}
+
+	if (h->names_offset)
+		read_names(base, st.st_size, h->names_offset);
+	else
+		fprintf(stderr, "No names in \"%s\": lc didn't finish tracing\n", av[optind]);
+
+	if (statistics)
+		print_statistics(h, (const struct trace_event *)(h + 1));
+	else
+		print_events(h, (const struct trace_event *)(h + 1));
+
+	free(names);
+	close(fd);
+
+	return 0;
+}
+
+static void
+usage(const char *progname)
+{
+	fprintf(stderr, "%s: decode lc binary trace files\n", progname);
+	fprintf(stderr, "usage: %s [-s] tracefile\n", progname);
+	fprintf(stderr, "  -s   print step statistics instead of each step\n");
+}
+
+static void
+read_names(const char *base, size_t size, uint64_t offset)
+{
+	uint32_t i, length;
+
+	if (offset + sizeof(name_count) > size)
+		return;
+	memcpy(&name_count, base + offset, sizeof(name_count));
+	offset += sizeof(name_count);
+
+	names = malloc((name_count + 1)*sizeof(*names));
+
+	for (i = 0; i < name_count; ++i)
+	{
+		if (offset + sizeof(length) > size)
+			break;
+		memcpy(&length, base + offset, sizeof(length));
+		offset += sizeof(length);
+		if (offset + length > size)
+			break;
+		names[i] = base + offset;   /* not NUL-terminated: see name_of() */
+		offset += length;
+	}
+	name_count = i;
+}
+
+/* Name for an event's atom ID plus one */
+static const char *
+name_of(uint32_t name, char *scratch)
+{
+	if (0 == name)
+		return "";
+	if (name <= name_count)
+	{
+		const char *p = names[name - 1];
+		uint32_t length;
+		memcpy(&length, p - sizeof(length), sizeof(length));
+		if (length > 63) length = 63;
+		memcpy(scratch, p, length);
+		scratch[length] = '\0';
+	} else
+		sprintf(scratch, "#%u", name - 1);
+	return scratch;
+}
+
+/* f: rator, a: rand, b: abstraction body */
+static const char *
+path_of(const struct trace_event *ev, char *scratch)
+{
+	int i, n = ev->depth < TRACE_PATH_EDGES? ev->depth: TRACE_PATH_EDGES;
+	char *p = scratch;
+
+	if (0 == ev->depth)
+		return "root";
+
+	for (i = 0; i < n; ++i)
+		switch ((ev->path >> 2*i) & 3)
+		{
+		case TRACE_RATOR: *p++ = 'f'; break;
+		case TRACE_RAND:  *p++ = 'a'; break;
+		case TRACE_BODY:  *p++ = 'b'; break;
+		default:          *p++ = '?'; break;
+		}
+
+	if (ev->depth > n)
+		p += sprintf(p, "... (depth %u)", ev->depth);
+	*p = '\0';
+
+	return scratch;
+}
+
+static void
+print_events(const struct trace_header *h, const struct trace_event *ring)
+{
+	uint64_t i, first = h->total > h->capacity? h->total - h->capacity: 0;
+	time_t started = h->start_time;
+
+	printf("# %llu events, %llu kept, tracing started %s",
+		(unsigned long long)h->total, (unsigned long long)(h->total - first),
+		ctime(&started));
+	printf("#    seconds reduction   step  event  name          nodes   path\n");
+
+	for (i = first; i < h->total; ++i)
+	{
+		const struct trace_event *ev = &ring[i % h->capacity];
+		char name[64], path[TRACE_PATH_EDGES + 32];
+
+		printf("%12.6f %9u %6u  %-5s  %-12s %+6d   ",
+			ev->time/1e9, ev->reduction, ev->step,
+			ev->kind < sizeof(kind_names)/sizeof(kind_names[0])? kind_names[ev->kind]: "?",
+			name_of(ev->name, name),
+			(int)ev->allocated - (int)ev->freed);
+
+		switch (ev->kind)
+		{
+		case TRACE_BETA:
+		case TRACE_ETA:
+			printf("%s", path_of(ev, path));
+			break;
+		case TRACE_END:
+			if (ev->flags & TRACE_LIMITED)
+				printf("step limit");
+			break;
+		}
+		printf("\n");
+	}
+}
+
+static void
+print_statistics(const struct trace_header *h, const struct trace_event *ring)
+{
+	uint64_t i, first = h->total > h->capacity? h->total - h->capacity: 0;
+	unsigned long kinds[6], depths[17];
+	unsigned long long allocated = 0, freed = 0, depth_sum = 0;
+	unsigned int max_depth = 0;
+	double elapsed = 0.0;
+	struct name_count *deltas = calloc(name_count + 1, sizeof(*deltas));
+	int k;
+
+	memset(kinds, 0, sizeof(kinds));
+	memset(depths, 0, sizeof(depths));
+
+	for (i = first; i < h->total; ++i)
+	{
+		const struct trace_event *ev = &ring[i % h->capacity];
+
+		if (ev->kind < sizeof(kinds)/sizeof(kinds[0]))
+			++kinds[ev->kind];
+		allocated += ev->allocated;
+		freed += ev->freed;
+
+		if (TRACE_BETA == ev->kind || TRACE_ETA == ev->kind)
+		{
+			int bucket = 0;
+			while (bucket < 16 && (1U << bucket) <= ev->depth)
+				++bucket;
+			++depths[bucket];
+			depth_sum += ev->depth;
+			if (ev->depth > max_depth)
+				max_depth = ev->depth;
+		}
+
+		if (TRACE_DELTA == ev->kind && ev->name <= name_count)
+		{
+			deltas[ev->name].name = ev->name;
+			++deltas[ev->name].count;
+		}
+	}
+
+	if (h->total > first)
+		elapsed = (ring[(h->total - 1) % h->capacity].time
+			- ring[first % h->capacity].time)/1e9;
+
+	printf("Events:        %llu (%llu kept)\n",
+		(unsigned long long)h->total, (unsigned long long)(h->total - first));
+	printf("Reductions:    %lu\n", kinds[TRACE_START]);
+	printf("Beta steps:    %lu\n", kinds[TRACE_BETA]);
+	printf("Eta steps:     %lu\n", kinds[TRACE_ETA]);
+	printf("Expansions:    %lu\n", kinds[TRACE_DELTA]);
+	printf("Elapsed:       %.6f seconds\n", elapsed);
+	if (elapsed > 0.0)
+		printf("Steps/second:  %.0f\n", (kinds[TRACE_BETA] + kinds[TRACE_ETA])/elapsed);
+	printf("Nodes:         %llu allocated, %llu freed\n", allocated, freed);
+
+	if (kinds[TRACE_BETA] + kinds[TRACE_ETA])
+	{
+		printf("Redex depth:   mean %.1f, max %u\n",
+			(double)depth_sum/(kinds[TRACE_BETA] + kinds[TRACE_ETA]), max_depth);
+		for (k = 0; k < 17; ++k)
+			if (depths[k])
+				printf("  %6u - %-6u %lu\n",
+					k? 1U << (k - 1): 0, k? (1U << k) - 1: 0, depths[k]);
+	}
+
+	if (kinds[TRACE_DELTA])
+	{
+		char name[64];
+		qsort(deltas, name_count + 1, sizeof(*deltas), by_count);
+		printf("Most expanded abbreviations:\n");
+		for (k = 0; k < 10 && deltas[k].count; ++k)
+			printf("  %-20s %lu\n", name_of(deltas[k].name, name), deltas[k].count);
+	}
+
+	free(deltas);
+}
+
+static int
+by_count(const void *a, const void *b)
+{
+	const struct name_count *x = a, *y = b;
+	if (x->count != y->count)
+		return x->count < y->count? 1: -1;
+	return x->name < y->name? -1: x->name > y->name;
+}
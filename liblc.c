@@ -0,0 +1,287 @@
+/*
+	Copyright (C) 2006-2011, Bruce Ediger
+
+    This file is part of lc.
+
+    lc is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    lc is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with lc; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/*
+ * liblc: the public face of the interpreter, for programs that
+ * link it in.  See liblc.h.  Parsing goes through the same grammar
+ * as lc's input, with the scanner reading the caller's text through
+ * fmemopen(), and reduction is normal_order_reduction() with limits
+ * held in the session for the length of one call.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>     /* memcpy(), strerror() */
+#include <errno.h>
+#include <signal.h>     /* sig_atomic_t */
+#include <stddef.h>     /* size_t */
+#include <sys/types.h>
+#include <sys/stat.h>   /* struct stat, for image.h */
+
+#include <context.h>
+#include <hashtable.h>
+#include <atom.h>
+#include <buffer.h>
+#include <small_hashtable.h>
+#include <lambda_expression.h>
+#include <evaluation.h>
+#include <abbreviations.h>
+#include <liblc.h>
+
+/* these live in grammar.y and lex.l */
+extern int yyparse(struct lc_context *ctx, void *scanner);
+extern int interpret_line(struct lc_context *ctx, const char *line, int length, int lineno);
+extern int load_file(struct lc_context *ctx, const char *filename);
+extern void prenormalize_abbreviation(struct lc_context *ctx, struct abbreviation *a);
+extern void set_yyin_stream(struct lc_context *ctx, FILE *fin, const char *name);
+extern void reset_yyin(struct lc_context *ctx);
+
+/* Where lc_print() puts text, and how much there was */
+struct print_sink {
+	char *buffer;
+	size_t size;
+	size_t length;
+};
+
+static void drain_to_caller(struct buffer *b);
+
+struct lc_context *
+lc_open(void)
+{
+	struct lc_context *ctx = new_context();
+
+	ctx->prompting = 0;
+	ctx->embedded = 1;
+
+	return ctx;
+}
+
+void
+lc_close(struct lc_context *ctx)
+{
+	reset_yyin(ctx);
+	free_context(ctx);
+}
+
+void
+lc_set_output(struct lc_context *ctx, FILE *out)
+{
+	ctx->out = out;
+}
+
+int
+lc_run(struct lc_context *ctx, const char *text, size_t length)
+{
+	ctx->error[0] = '\0';
+
+	if (length > 0)
+		(void)interpret_line(ctx, text, length, 1);
+
+	return '\0' != ctx->error[0];
+}
+
+int
+lc_load(struct lc_context *ctx, const char *filename)
+{
+	ctx->error[0] = '\0';
+
+	return load_file(ctx, filename) || '\0' != ctx->error[0];
+}
+
+struct lambda_expression *
+lc_parse(struct lc_context *ctx, const char *text, size_t length)
+{
+	struct lambda_expression *r = NULL;
+	/* Read-only for a stream opened "r", as in interpret_line() */
+	union { const char *text; void *buffer; } in;
+	FILE *fin;
+
+	ctx->error[0] = '\0';
+
+	if (0 == length)
+	{
+		strcpy(ctx->error, "no term");
+		return NULL;
+	}
+
+	in.text = text;
+	if (NULL == (fin = fmemopen(in.buffer, length, "r")))
+	{
+		snprintf(ctx->error, sizeof(ctx->error), "%s", strerror(errno));
+		return NULL;
+	}
+
+	set_yyin_stream(ctx, fin, "term");
+	ctx->parse_request = 1;
+	ctx->request = NULL;
+
+	if (0 == yyparse(ctx, ctx->scanner))
+		r = ctx->request;
+	else if (ctx->request)  /* something followed it */
+		free_expression(ctx, ctx->request);
+
+	ctx->request = NULL;
+	ctx->parse_request = 0;
+	reset_yyin(ctx);
+
+	return r;
+}
+
+const char *
+lc_error(struct lc_context *ctx)
+{
+	return ('\0' == ctx->error[0])? NULL: ctx->error;
+}
+
+void
+lc_define(struct lc_context *ctx, const char *name, struct lambda_expression *term)
+{
+	struct abbreviation *a = abbreviation_add(ctx, Atom_string(name), term);
+
+	if (ctx->prenormalize)
+		prenormalize_abbreviation(ctx, a);
+}
+
+struct lambda_expression *
+lc_reduce(
+	struct lc_context *ctx,
+	struct lambda_expression *term,
+	const struct lc_limits *limits,
+	struct lc_outcome *outcome
+)
+{
+	struct reduction_state rs;
+	int eta_reduction = ctx->eta_reduction;
+	double started = monotonic_seconds();
+
+	init_reduction_state(&rs, limits? limits->steps: 0);
+
+	if (limits)
+	{
+		ctx->eta_reduction = (LC_NORMAL_ORDER_BETA != limits->strategy);
+		if (limits->nodes > 0)
+			ctx->node_limit = nodes_allocated(ctx) - nodes_freed(ctx) + limits->nodes;
+		if (limits->seconds > 0.0)
+			ctx->deadline = started + limits->seconds;
+	}
+
+	term = normal_order_reduction(ctx, term, &rs);
+
+	ctx->eta_reduction = eta_reduction;
+	ctx->node_limit = 0;
+	ctx->deadline = 0.0;
+	ctx->total_beta_steps += rs.beta_steps;
+	ctx->total_eta_steps += rs.eta_steps;
+
+	/* lc_interrupt() stops one reduction */
+	if (1 == rs.interrupted)
+		ctx->interrupt_requested = 0;
+
+	if (outcome)
+	{
+		if (1 == rs.interrupted)
+			outcome->status = LC_INTERRUPTED;
+		else if (rs.interrupted)
+			outcome->status = LC_TIMEOUT;
+		else if (3 == rs.limited)
+			outcome->status = LC_CYCLE;
+		else if (4 == rs.limited)
+			outcome->status = LC_GROWTH;
+		else if (2 == rs.limited)
+			outcome->status = LC_NODE_LIMIT;
+		else if (rs.limited)
+			outcome->status = LC_STEP_LIMIT;
+		else
+			outcome->status = LC_NORMAL_FORM;
+		outcome->beta_steps = rs.beta_steps;
+		outcome->eta_steps = rs.eta_steps;
+		outcome->seconds = monotonic_seconds() - started;
+	}
+
+	return term;
+}
+
+void
+lc_interrupt(struct lc_context *ctx)
+{
+	ctx->interrupt_requested = 1;
+}
+
+int
+lc_alpha_equivalent(struct lc_context *ctx, struct lambda_expression *a, struct lambda_expression *b)
+{
+	return alpha_equivalent_graphs(ctx, a, b);
+}
+
+int
+lc_identical(struct lambda_expression *a, struct lambda_expression *b)
+{
+	return equivalent_graphs(a, b);
+}
+
+size_t
+lc_print(struct lambda_expression *term, char *buffer, size_t size)
+{
+	struct print_sink sink;
+	struct buffer *b = new_buffer(PRINT_CHUNK_SIZE);
+
+	sink.buffer = buffer;
+	sink.size = size;
+	sink.length = 0;
+	b->drain = drain_to_caller;
+	b->sink = &sink;
+
+	buffer_expression(term, b);
+	flush_buffer(b);
+	delete_buffer(b);
+
+	if (size > 0)
+		buffer[(sink.length < size)? sink.length: size - 1] = '\0';
+
+	return sink.length;
+}
+
+struct lambda_expression *
+lc_copy(struct lc_context *ctx, struct lambda_expression *term)
+{
+	return copy_expression(ctx, term);
+}
+
+void
+lc_free(struct lc_context *ctx, struct lambda_expression *term)
+{
+	free_expression(ctx, term);
+}
+
+/* Copies as much as fits, leaving room for a NUL, and counts it all */
+static void
+drain_to_caller(struct buffer *b)
+{
+	struct print_sink *s = b->sink;
+	size_t room = (s->length + 1 < s->size)? s->size - 1 - s->length: 0;
+	size_t n = ((size_t)b->offset < room)? (size_t)b->offset: room;
+
+	if (n > 0)
+		memcpy(&s->buffer[s->length], b->buffer, n);
+	s->length += b->offset;
+	b->offset = 0;
+	b->buffer[0] = '\0';
+}
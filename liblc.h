@@ -0,0 +1,123 @@
+/*
+	Copyright (C) 2006-2011, Bruce Ediger
+
+    This file is part of lc.
+
+    lc is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    lc is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with lc; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/*
+ * liblc: the interpreter as a library, for programs that want to
+ * parse, reduce and print lambda calculus terms in-process.
+ *
+ * A struct lc_context is one session: its abbreviations, settings,
+ * and the nodes of every term it made.  Terms belong to the session
+ * that parsed them, and only go to functions along with that session.
+ * Separate sessions can be used on separate threads at the same time,
+ * one session by one thread at a time.
+ *
+ * Uses FILE from <stdio.h> and size_t from <stddef.h>.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct lc_context;
+struct lambda_expression;
+
+enum lc_strategy {
+	LC_NORMAL_ORDER,         /* leftmost outermost, beta and eta */
+	LC_NORMAL_ORDER_BETA     /* leftmost outermost, beta only */
+};
+
+enum lc_status {
+	LC_NORMAL_FORM,
+	LC_STEP_LIMIT,
+	LC_NODE_LIMIT,
+	LC_TIMEOUT,
+	LC_INTERRUPTED,
+	LC_CYCLE,                /* with "divergence on": back to an earlier term */
+	LC_GROWTH                /* growing around copies of earlier terms */
+};
+
+/* 0 in a limit means none */
+struct lc_limits {
+	enum lc_strategy strategy;
+	long steps;        /* beta and eta steps */
+	double seconds;
+	long nodes;        /* nodes in use, over those at the start */
+};
+
+struct lc_outcome {
+	enum lc_status status;
+	long beta_steps;
+	long eta_steps;
+	double seconds;
+};
+
+/* Sessions.  A new one has no abbreviations, and sends the output of
+ * lc_run() and lc_load() to stdout. */
+struct lc_context *lc_open(void);
+void lc_close(struct lc_context *ctx);
+void lc_set_output(struct lc_context *ctx, FILE *out);
+
+/* Statements, as lc reads them: definitions, commands, terms to
+ * reduce and print.  Return 0, or 1 on a syntax error or, for
+ * lc_load(), a file that can't be read. */
+int lc_run(struct lc_context *ctx, const char *text, size_t length);
+int lc_load(struct lc_context *ctx, const char *filename);
+
+/* The term that text holds, which can end in a newline.  Reads text
+ * where it is: it doesn't need a NUL at the end.  Returns NULL on a
+ * syntax error, and lc_error() says what it was. */
+struct lambda_expression *lc_parse(struct lc_context *ctx, const char *text, size_t length);
+const char *lc_error(struct lc_context *ctx);
+
+/* Makes name an abbreviation for term, which the session takes */
+void lc_define(struct lc_context *ctx, const char *name, struct lambda_expression *term);
+
+/* Reduces term, which the session takes, and returns the normal form,
+ * or as far as reduction got within limits.  limits and outcome can
+ * be NULL. */
+struct lambda_expression *lc_reduce(
+	struct lc_context *ctx,
+	struct lambda_expression *term,
+	const struct lc_limits *limits,
+	struct lc_outcome *outcome
+);
+
+/* Stops the session's reduction in progress, or its next one, between
+ * two steps.  Another thread, or a signal handler, can call it. */
+void lc_interrupt(struct lc_context *ctx);
+
+/* 1 if the terms differ at most in names of bound variables */
+int lc_alpha_equivalent(struct lc_context *ctx, struct lambda_expression *a, struct lambda_expression *b);
+/* 1 if the terms read exactly the same */
+int lc_identical(struct lambda_expression *a, struct lambda_expression *b);
+
+/* Text of term, as lc prints it, NUL-terminated in buffer, cut short
+ * if it doesn't fit in size bytes.  Returns the length of the whole
+ * text, as snprintf() does, so a return of size or more means a
+ * bigger buffer is needed. */
+size_t lc_print(struct lambda_expression *term, char *buffer, size_t size);
+
+struct lambda_expression *lc_copy(struct lc_context *ctx, struct lambda_expression *term);
+void lc_free(struct lc_context *ctx, struct lambda_expression *term);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,147 @@
+/*
+	Copyright (C) 2006-2011, Bruce Ediger
+
+    This file is part of lc.
+
+    lc is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    lc is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with lc; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/*
+ * liblctest: calls each function of liblc.h and prints what they
+ * did, for runtests to compare against test.out/correct.liblc.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>     /* strlen() */
+#include <stddef.h>     /* size_t */
+
+#include <liblc.h>
+
+static void reduce(struct lc_context *ctx, const char *text, const struct lc_limits *limits);
+
+static const char *status_names[] = {
+	"normal form", "step limit", "node limit", "timeout", "interrupted",
+	"cycle", "growth"
+};
+
+int
+main(void)
+{
+	struct lc_context *ctx, *other;
+	struct lambda_expression *a, *b;
+	struct lc_limits limits = {LC_NORMAL_ORDER, 0, 0.0, 0};
+	const char *defs = "def I \\x.x\ndef K \\x y.x\n";
+	char text[] = "K I Ignored";
+	char small[10], tiny[5];
+	FILE *quiet = fopen("/dev/null", "w");
+	size_t n;
+
+	ctx = lc_open();
+	other = lc_open();
+
+	/* Statements, and a file of them */
+	printf("run: %d\n", lc_run(ctx, defs, strlen(defs)));
+	lc_set_output(ctx, quiet);
+	printf("load: %d\n", lc_load(ctx, "examples/church.numerals"));
+	lc_set_output(ctx, stdout);
+	printf("load missing: %d\n", lc_load(ctx, "test.out/no.such.file"));
+
+	/* Parsing reads only the length given: "K I" */
+	a = lc_reduce(ctx, lc_parse(ctx, text, 3), NULL, NULL);
+	lc_print(a, small, sizeof(small));
+	printf("K I: %s\n", small);
+	lc_free(ctx, a);
+
+	/* Limits and strategies */
+	reduce(ctx, "c{2} c{3}", NULL);
+	limits.steps = 5;
+	reduce(ctx, "(\\x.x x)(\\x.x x)", &limits);
+	limits.steps = 0;
+	limits.nodes = 100;
+	reduce(ctx, "(\\x.x x x)(\\x.x x x)", &limits);
+	limits.nodes = 0;
+	limits.seconds = 0.2;
+	reduce(ctx, "(\\x.x x)(\\x.x x)", &limits);
+	limits.seconds = 0.0;
+	reduce(ctx, "\\x.f x", &limits);
+	limits.strategy = LC_NORMAL_ORDER_BETA;
+	reduce(ctx, "\\x.f x", &limits);
+
+	/* Stopping reductions that can't get anywhere */
+	(void)lc_run(ctx, "divergence on\n", 14);
+	reduce(ctx, "(\\x.x x)(\\x.x x)", NULL);
+	reduce(ctx, "(\\x.x x x)(\\x.x x x)", NULL);
+	(void)lc_run(ctx, "divergence off\n", 15);
+
+	/* Syntax errors */
+	if (NULL == lc_parse(ctx, "(\\x.", 4))
+		printf("parse error: %s\n", lc_error(ctx) != NULL? "yes": "no");
+	if (NULL == lc_parse(ctx, "x y\nz\n", 6))
+		printf("two lines: error\n");
+
+	/* Definitions, and sessions that don't see each other's */
+	lc_define(ctx, "twice", lc_parse(ctx, "\\f x.f (f x)", 12));
+	reduce(ctx, "twice twice", NULL);
+	reduce(other, "twice twice", NULL);
+
+	/* Comparisons */
+	a = lc_parse(ctx, "\\x y.x", 6);
+	b = lc_parse(ctx, "\\a b.a", 6);
+	printf("alpha: %d, identical: %d\n", lc_alpha_equivalent(ctx, a, b), lc_identical(a, b));
+	lc_free(ctx, b);
+	b = lc_copy(ctx, a);
+	printf("copy identical: %d\n", lc_identical(a, b));
+
+	/* Text cut short to fit */
+	n = lc_print(a, tiny, sizeof(tiny));
+	printf("print: %lu \"%s\"\n", (unsigned long)n, tiny);
+	n = lc_print(a, NULL, 0);
+	printf("print, no buffer: %lu\n", (unsigned long)n);
+	lc_free(ctx, a);
+	lc_free(ctx, b);
+
+	lc_close(other);
+	lc_close(ctx);
+	fclose(quiet);
+
+	return 0;
+}
+
+static void
+reduce(struct lc_context *ctx, const char *text, const struct lc_limits *limits)
+{
+	struct lambda_expression *e = lc_parse(ctx, text, strlen(text));
+	struct lc_outcome outcome;
+	char buffer[256];
+
+	if (!e)
+	{
+		printf("%s: %s\n", text, lc_error(ctx));
+		return;
+	}
+
+	e = lc_reduce(ctx, e, limits, &outcome);
+	lc_print(e, buffer, sizeof(buffer));
+	printf("%s: %s", text, status_names[outcome.status]);
+	/* How far a timeout gets varies */
+	if (LC_TIMEOUT != outcome.status)
+		printf(", %ld beta, %ld eta", outcome.beta_steps, outcome.eta_steps);
+	if (LC_NORMAL_FORM == outcome.status)
+		printf(": %s", buffer);
+	printf("\n");
+	lc_free(ctx, e);
+}
@@ -19,4 +19,17 @@
 
 */
 /* $Id: parser.h,v 1.4 2011/11/12 04:50:28 bediger Exp $ */
-enum ModifiableCommands { CMD_TIMER, CMD_TRACE, CMD_STEP, CMD_ETA };
+enum ModifiableCommands { CMD_TIMER, CMD_TRACE, CMD_STEP, CMD_ETA, CMD_PRENORMALIZE, CMD_PROFILE,
+	CMD_CHECKPOINT, CMD_DIVERGENCE, CMD_TYPED };
+
+/* What a file "load" started with, so as to tell
+ * what it did once it's all read in. */
+struct loading {
+	unsigned int first_seq;   /* sequence number of first abbreviation */
+	int output_statements;
+	int settings_made;
+};
+
+void start_loading(struct lc_context *ctx, struct loading *l);
+void finish_loading(struct lc_context *ctx, const char *filename, struct loading *l);
+int  load_compiled(struct lc_context *ctx, const char *filename);
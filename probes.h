@@ -0,0 +1,64 @@
+/*
+	Copyright (C) 2006-2011, Bruce Ediger
+
+    This file is part of lc.
+
+    lc is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    lc is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with lc; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/* Static tracepoints for perf, bpftrace and friends: build with
+ * -DLC_PROBES ("make probes"), which needs <sys/sdt.h> from systemtap.
+ * Otherwise every probe compiles to nothing, arguments included.
+ *
+ * Probes in provider "lc", and their arguments:
+ *   reduce_start  nodes allocated so far, nodes freed so far
+ *   reduce_end    beta steps, eta steps, nodes allocated, nodes freed,
+ *                 result (0 normal form, 1 interrupt, 2 timeout, 3 step limit)
+ *   beta          step number, depth of redex, nodes allocated, bound variable
+ *   eta           step number, depth of redex, nodes allocated, bound variable
+ *   rename        nodes allocated, old bound variable, new bound variable
+ *   expand        nodes allocated, abbreviation name
+ *   slab_refill   nodes in slabs, bytes per slab
+ *
+ * "Nodes allocated" is a running total: the difference between two
+ * probes is the number of nodes allocated in between.
+ */
+
+#ifdef LC_PROBES
+#include <sys/sdt.h>
+#define LC_PROBE_REDUCE_START(allocated, freed) \
+	DTRACE_PROBE2(lc, reduce_start, allocated, freed)
+#define LC_PROBE_REDUCE_END(beta, eta, allocated, freed, result) \
+	DTRACE_PROBE5(lc, reduce_end, beta, eta, allocated, freed, result)
+#define LC_PROBE_BETA(step, depth, allocated, variable) \
+	DTRACE_PROBE4(lc, beta, step, depth, allocated, variable)
+#define LC_PROBE_ETA(step, depth, allocated, variable) \
+	DTRACE_PROBE4(lc, eta, step, depth, allocated, variable)
+#define LC_PROBE_RENAME(allocated, old_variable, new_variable) \
+	DTRACE_PROBE3(lc, rename, allocated, old_variable, new_variable)
+#define LC_PROBE_EXPAND(allocated, name) \
+	DTRACE_PROBE2(lc, expand, allocated, name)
+#define LC_PROBE_SLAB_REFILL(nodes, bytes) \
+	DTRACE_PROBE2(lc, slab_refill, nodes, bytes)
+#else
+#define LC_PROBE_REDUCE_START(allocated, freed)
+#define LC_PROBE_REDUCE_END(beta, eta, allocated, freed, result)
+#define LC_PROBE_BETA(step, depth, allocated, variable)
+#define LC_PROBE_ETA(step, depth, allocated, variable)
+#define LC_PROBE_RENAME(allocated, old_variable, new_variable)
+#define LC_PROBE_EXPAND(allocated, name)
+#define LC_PROBE_SLAB_REFILL(nodes, bytes)
+#endif
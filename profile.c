@@ -0,0 +1,248 @@
+/*
+	Copyright (C) 2006-2011, Bruce Ediger
+
+    This file is part of lc.
+
+    lc is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    lc is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with lc; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/*
+ * Per-abbreviation cost profiler.  Counters live in arrays indexed by
+ * atom ID, so charging a step costs an array index, not a lookup.
+ * One set of counters covers the current statement, the other
+ * everything since lc started.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>     /* memset() */
+#include <time.h>       /* clock_gettime() */
+#include <signal.h>     /* sig_atomic_t */
+
+#include <context.h>
+#include <hashtable.h>
+#include <atom.h>
+#include <small_hashtable.h>
+#include <buffer.h>
+#include <lambda_expression.h>
+#include <profile.h>
+
+struct profile_entry {
+	long beta;
+	long eta;
+	long expansions;
+	long nodes;
+	double seconds;
+	int touched;   /* index is in the touched list */
+};
+
+struct profile_table {
+	struct profile_entry *entries;  /* [0] is typed-in terms, [n] atom ID n-1 */
+	int size;
+	int *touched;
+	int touched_count;
+};
+
+/* One session's counters, in ctx->profile once it charges anything.
+ * Callers check ctx->profiling before calling profile_charge(). */
+struct profile_state {
+	struct profile_table statement;
+	struct profile_table total;
+	struct timespec mark;
+	long mark_allocated;
+};
+
+static struct profile_state *state(struct lc_context *ctx);
+static struct profile_entry *entry(struct profile_table *t, int idx);
+static void print_table(struct lc_context *ctx, const char *title, struct profile_table *t);
+static void clear_table(struct profile_table *t);
+
+/* Work done before a reduction, like parsing, doesn't get charged */
+void
+profile_start(struct lc_context *ctx)
+{
+	struct profile_state *ps = state(ctx);
+	clock_gettime(CLOCK_MONOTONIC, &ps->mark);
+	ps->mark_allocated = nodes_allocated(ctx);
+}
+
+void
+profile_charge(struct lc_context *ctx, enum profile_kind kind, const char *origin)
+{
+	struct timespec now;
+	double seconds;
+	long nodes;
+	int idx = origin? Atom_id(origin) + 1: 0;
+	struct profile_state *ps = state(ctx);
+	struct profile_table *tables[2];
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	seconds = (now.tv_sec - ps->mark.tv_sec) + (now.tv_nsec - ps->mark.tv_nsec)/1.0e9;
+	nodes = nodes_allocated(ctx) - ps->mark_allocated;
+	ps->mark = now;
+	ps->mark_allocated += nodes;
+
+	tables[0] = &ps->statement;
+	tables[1] = &ps->total;
+	for (i = 0; i < 2; ++i)
+	{
+		struct profile_entry *p = entry(tables[i], idx);
+		switch (kind)
+		{
+		case PROFILE_BETA:      ++p->beta; break;
+		case PROFILE_ETA:       ++p->eta; break;
+		case PROFILE_EXPANSION: ++p->expansions; break;
+		}
+		p->nodes += nodes;
+		p->seconds += seconds;
+	}
+}
+
+/* Report on the statement just finished, if it did any reductions */
+void
+profile_report(struct lc_context *ctx)
+{
+	struct profile_state *ps = ctx->profile;
+
+	if (!ps)
+		return;
+	if (ps->statement.touched_count > 0)
+		print_table(ctx, "Profile", &ps->statement);
+	clear_table(&ps->statement);
+}
+
+/* Report on everything since lc started, at exit */
+void
+profile_report_total(struct lc_context *ctx)
+{
+	struct profile_state *ps = ctx->profile;
+
+	if (!ps)
+		return;
+	if (ps->total.touched_count > 0)
+		print_table(ctx, "Total profile", &ps->total);
+	free(ps->statement.entries);
+	free(ps->statement.touched);
+	free(ps->total.entries);
+	free(ps->total.touched);
+	free(ps);
+	ctx->profile = NULL;
+}
+
+static struct profile_state *
+state(struct lc_context *ctx)
+{
+	if (!ctx->profile)
+		ctx->profile = calloc(1, sizeof(*ctx->profile));
+	return ctx->profile;
+}
+
+static struct profile_entry *
+entry(struct profile_table *t, int idx)
+{
+	struct profile_entry *p;
+
+	if (idx >= t->size)
+	{
+		int new_size = 2*t->size;
+		if (new_size <= idx)
+			new_size = Atom_count() + 1 > idx? Atom_count() + 1: idx + 1;
+		t->entries = realloc(t->entries, new_size*sizeof(*t->entries));
+		t->touched = realloc(t->touched, new_size*sizeof(*t->touched));
+		memset(&t->entries[t->size], 0, (new_size - t->size)*sizeof(*t->entries));
+		t->size = new_size;
+	}
+
+	p = &t->entries[idx];
+	if (!p->touched)
+	{
+		p->touched = 1;
+		t->touched[t->touched_count++] = idx;
+	}
+
+	return p;
+}
+
+/* What print_table() sorts on, copied out of the table, so that
+ * qsort()'s comparison function needs no other state */
+struct ranking {
+	int idx;
+	double seconds;
+	long steps;
+};
+
+/* Most time first, then most steps */
+static int
+costlier(const void *a, const void *b)
+{
+	const struct ranking *p = a;
+	const struct ranking *q = b;
+
+	if (p->seconds != q->seconds)
+		return p->seconds > q->seconds? -1: 1;
+	if (p->steps != q->steps)
+		return p->steps > q->steps? -1: 1;
+	return p->idx - q->idx;
+}
+
+static void
+print_table(struct lc_context *ctx, const char *title, struct profile_table *t)
+{
+	struct profile_entry sum;
+	struct ranking *order = malloc(t->touched_count*sizeof(*order));
+	int i;
+
+	memset(&sum, 0, sizeof(sum));
+	for (i = 0; i < t->touched_count; ++i)
+	{
+		struct profile_entry *p = &t->entries[t->touched[i]];
+		sum.beta += p->beta;
+		sum.eta += p->eta;
+		sum.expansions += p->expansions;
+		sum.nodes += p->nodes;
+		sum.seconds += p->seconds;
+		order[i].idx = t->touched[i];
+		order[i].seconds = p->seconds;
+		order[i].steps = p->beta + p->eta;
+	}
+
+	qsort(order, t->touched_count, sizeof(*order), costlier);
+
+	fprintf(ctx->out, "%s: %ld beta, %ld eta, %ld expansions, %ld nodes, %.6f seconds\n",
+		title, sum.beta, sum.eta, sum.expansions, sum.nodes, sum.seconds);
+	fprintf(ctx->out, "%10s %8s %8s %10s %10s  %s\n",
+		"beta", "eta", "expand", "nodes", "seconds", "abbreviation");
+	for (i = 0; i < t->touched_count; ++i)
+	{
+		int idx = order[i].idx;
+		struct profile_entry *p = &t->entries[idx];
+		fprintf(ctx->out, "%10ld %8ld %8ld %10ld %10.6f  %s\n",
+			p->beta, p->eta, p->expansions, p->nodes, p->seconds,
+			idx? Atom_from_id(idx - 1): "(input)");
+	}
+
+	free(order);
+}
+
+static void
+clear_table(struct profile_table *t)
+{
+	int i;
+	for (i = 0; i < t->touched_count; ++i)
+		memset(&t->entries[t->touched[i]], 0, sizeof(*t->entries));
+	t->touched_count = 0;
+}
@@ -0,0 +1,36 @@
+/*
+	Copyright (C) 2006-2011, Bruce Ediger
+
+    This file is part of lc.
+
+    lc is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    lc is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with lc; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/* Charging reduction work to the abbreviations it came from.
+ * Every node carries the name of the abbreviation whose definition it
+ * got copied out of (struct lambda_expression, origin member).  Each
+ * beta or eta step, and each expansion of an abbreviation, gets charged
+ * with the nodes allocated and the time spent since the previous one:
+ * a step to the origin of the abstraction it reduces, an expansion to
+ * the abbreviation expanded.  Work on typed-in nodes goes to "(input)".
+ */
+
+enum profile_kind { PROFILE_BETA, PROFILE_ETA, PROFILE_EXPANSION };
+
+void profile_start(struct lc_context *ctx);
+void profile_charge(struct lc_context *ctx, enum profile_kind kind, const char *origin);
+void profile_report(struct lc_context *ctx);
+void profile_report_total(struct lc_context *ctx);
@@ -0,0 +1,637 @@
+/*
+	Copyright (C) 2006-2011, Bruce Ediger
+
+    This file is part of lc.
+
+    lc is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    lc is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with lc; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/*
+ * Server mode.  The main thread accepts connections on a Unix domain
+ * socket and reads lines from them, and a pool of worker threads
+ * reduces the expressions on those lines.  Each worker has its own
+ * liblc session, filled from an image of the abbreviations and settings
+ * that -L files and -S images gave the main session, so libraries
+ * get parsed just once, and workers never share nodes or tables.
+ *
+ * A request is one line: optional budget words, then an expression.
+ *
+ *     steps=100000 seconds=2 nodes=1000000 c{2} c{2}
+ *
+ * Budgets get capped at the -n, -t and -m maxima the server started
+ * with, and default to them.  The answer is one line too:
+ *
+ *     status=normal beta=6 eta=0 nodes=11 seconds=0.000 result=%n.%a.n (n (n (n a)))
+ *
+ * status is one of normal, step_limit, node_limit, timeout, syntax_error,
+ * cycle or growth (for a server started with -d, see divergence.h),
+ * or interrupted when the server stops, and only a normal form comes
+ * with a result.  nodes counts the nodes of the result.  Definitions,
+ * "load" and the other interpreter commands aren't requests.
+ *
+ * A connection gets its answers in the order it sent the requests,
+ * one at a time.  Separate connections' requests run in parallel.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>     /* malloc(), free(), realloc(), strtod() */
+#include <string.h>     /* strncmp(), memchr(), memmove(), strerror() */
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>     /* read(), write(), close(), unlink(), pipe() */
+#include <fcntl.h>      /* fcntl() */
+#include <poll.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>   /* stat(), struct stat for image.h */
+#include <sys/socket.h>
+#include <sys/un.h>     /* struct sockaddr_un */
+
+#include <context.h>
+#include <buffer.h>
+#include <small_hashtable.h>
+#include <lambda_expression.h>
+#include <evaluation.h>
+#include <image.h>
+#include <liblc.h>
+#include <serve.h>
+
+/* Threads, without -j */
+#define DEFAULT_WORKERS 4
+
+/* find_redex() and friends recurse as deep as the term goes.  A
+ * thread's default stack holds a lot less than that, so reserve
+ * plenty: it's address space, memory only gets used as needed. */
+#define WORKER_STACK (256L*1024*1024)
+
+/* A line longer than this, without a newline, ends its connection */
+#define MAX_REQUEST (64*1024*1024)
+
+struct connection {
+	int fd;
+	int busy;        /* a worker has its request: don't read or close */
+	int eof;         /* client has sent everything it will */
+	char *text;      /* what's come in, not yet handed to a worker */
+	int length;
+	int size;
+	struct connection *next;
+};
+
+struct request {
+	struct connection *conn;
+	char *line;      /* ends in a newline */
+	int length;
+	struct request *next;
+};
+
+struct server {
+	pthread_mutex_t lock;
+	pthread_cond_t ready;   /* a request got queued, or stopping got set */
+	struct request *head;
+	struct request *tail;
+	int stopping;
+
+	long max_steps;
+	double max_seconds;
+	long max_nodes;
+};
+
+struct worker {
+	pthread_t thread;
+	struct lc_context *ctx;
+	struct server *srv;
+};
+
+/* Workers finishing a request, and the signal handler, write a byte
+ * here to get the main thread out of poll() */
+static int wake_fd = -1;
+static volatile sig_atomic_t stop_requested = 0;
+
+static int open_socket(const char *path);
+static void stop_handler(int signo);
+static void *serve_requests(void *arg);
+static void answer(struct worker *w, struct request *rq);
+static double clamp_budget(double asked, double most);
+static void drain_to_connection(struct buffer *b);
+static void write_all(int fd, const char *p, int length);
+static int read_connection(struct connection *conn);
+static int dispatch(struct server *srv, struct connection *conn);
+
+int
+run_server(struct lc_context *ctx, const char *path, int worker_count, long max_nodes)
+{
+	struct server srv;
+	struct worker *workers;
+	struct connection *conns = NULL, *conn, **cpp;
+	struct connection **polled = NULL;
+	struct pollfd *fds = NULL;
+	int nfds = 0, wake[2];
+	int listen_fd, i;
+	char *image;
+	sigset_t blocked, old_mask;
+	pthread_attr_t attr;
+	void (*old_sigint)(int), (*old_sigterm)(int), (*old_sigpipe)(int);
+
+	if (worker_count < 1)
+		worker_count = DEFAULT_WORKERS;
+
+	if (0 > (listen_fd = open_socket(path)))
+		return 1;
+
+	if (pipe(wake))
+	{
+		fprintf(stderr, "Problem making a pipe: %s\n", strerror(errno));
+		close(listen_fd);
+		unlink(path);
+		return 1;
+	}
+	fcntl(wake[0], F_SETFL, O_NONBLOCK);
+	fcntl(wake[1], F_SETFL, O_NONBLOCK);
+	wake_fd = wake[1];
+
+	/* Workers start from an image of this session: whatever it
+	 * loaded gets parsed once, however many workers there are. */
+	if (NULL == (image = malloc(strlen(path) + 8)))
+	{
+		fprintf(stderr, "Problem allocating a temporary file name: %s\n",
+			strerror(errno));
+		wake_fd = -1;
+		close(wake[0]);
+		close(wake[1]);
+		close(listen_fd);
+		unlink(path);
+		return 1;
+	}
+	sprintf(image, "%s.XXXXXX", path);
+	if (0 > (i = mkstemp(image)))
+	{
+		fprintf(stderr, "Problem making a temporary file \"%s\": %s\n",
+			image, strerror(errno));
+		free(image);
+		wake_fd = -1;
+		close(wake[0]);
+		close(wake[1]);
+		close(listen_fd);
+		unlink(path);
+		return 1;
+	}
+	close(i);
+	(void)write_image(ctx, image, 0, NULL, NULL, NULL, NULL, IMAGE_ALL_SETTINGS);
+
+	pthread_mutex_init(&srv.lock, NULL);
+	pthread_cond_init(&srv.ready, NULL);
+	srv.head = srv.tail = NULL;
+	srv.stopping = 0;
+	srv.max_steps = ctx->step_limit;
+	srv.max_seconds = ctx->reduction_timeout;
+	srv.max_nodes = max_nodes;
+
+	/* Only the main thread takes SIGINT and SIGTERM */
+	sigemptyset(&blocked);
+	sigaddset(&blocked, SIGINT);
+	sigaddset(&blocked, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &blocked, &old_mask);
+
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, WORKER_STACK);
+
+	workers = calloc(worker_count, sizeof(*workers));
+	for (i = 0; i < worker_count; ++i)
+	{
+		workers[i].srv = &srv;
+		workers[i].ctx = lc_open();
+		(void)read_image(workers[i].ctx, image, NULL, NULL, NULL, NULL);
+		pthread_create(&workers[i].thread, &attr, serve_requests, &workers[i]);
+	}
+	pthread_attr_destroy(&attr);
+
+	pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+	unlink(image);
+	free(image);
+
+	stop_requested = 0;
+	old_sigint = signal(SIGINT, stop_handler);
+	old_sigterm = signal(SIGTERM, stop_handler);
+	old_sigpipe = signal(SIGPIPE, SIG_IGN);
+
+	fprintf(ctx->out, "Serving \"%s\" with %d threads\n", path, worker_count);
+	fflush(ctx->out);
+
+	while (!stop_requested)
+	{
+		int n = 2;
+		char scratch[64];
+
+		for (conn = conns; conn; conn = conn->next)
+			++n;
+		if (n > nfds)
+		{
+			nfds = 2*n;
+			fds = realloc(fds, nfds*sizeof(*fds));
+			polled = realloc(polled, nfds*sizeof(*polled));
+		}
+
+		fds[0].fd = listen_fd;
+		fds[0].events = POLLIN;
+		fds[1].fd = wake[0];
+		fds[1].events = POLLIN;
+		n = 2;
+		pthread_mutex_lock(&srv.lock);
+		for (conn = conns; conn; conn = conn->next)
+		{
+			if (conn->busy || conn->eof)
+				continue;
+			fds[n].fd = conn->fd;
+			fds[n].events = POLLIN;
+			polled[n++] = conn;
+		}
+		pthread_mutex_unlock(&srv.lock);
+
+		if (0 > poll(fds, n, -1))
+		{
+			if (EINTR == errno)
+				continue;
+			fprintf(stderr, "Problem waiting for clients: %s\n", strerror(errno));
+			break;
+		}
+
+		if (fds[1].revents)
+			while (0 < read(wake[0], scratch, sizeof(scratch)))
+				;
+
+		if (fds[0].revents & POLLIN)
+		{
+			int fd = accept(listen_fd, NULL, NULL);
+			if (0 <= fd)
+			{
+				conn = calloc(1, sizeof(*conn));
+				conn->fd = fd;
+				conn->next = conns;
+				conns = conn;
+			}
+		}
+
+		for (i = 2; i < n; ++i)
+			if (fds[i].revents)
+				polled[i]->eof = !read_connection(polled[i]);
+
+		/* Idle connections get their next request going, or get
+		 * closed once they've had all their answers. */
+		cpp = &conns;
+		while (NULL != (conn = *cpp))
+		{
+			if (dispatch(&srv, conn) || !conn->eof)
+			{
+				cpp = &conn->next;
+				continue;
+			}
+			*cpp = conn->next;
+			close(conn->fd);
+			free(conn->text);
+			free(conn);
+		}
+	}
+
+	/* Requests still queued get dropped, and ones in progress get
+	 * interrupted between two steps, as Control-C would. */
+	pthread_mutex_lock(&srv.lock);
+	srv.stopping = 1;
+	while (srv.head)
+	{
+		struct request *rq = srv.head;
+		srv.head = rq->next;
+		free(rq->line);
+		free(rq);
+	}
+	srv.tail = NULL;
+	for (i = 0; i < worker_count; ++i)
+		lc_interrupt(workers[i].ctx);
+	pthread_cond_broadcast(&srv.ready);
+	pthread_mutex_unlock(&srv.lock);
+
+	for (i = 0; i < worker_count; ++i)
+	{
+		pthread_join(workers[i].thread, NULL);
+		lc_close(workers[i].ctx);
+	}
+	free(workers);
+
+	while (NULL != (conn = conns))
+	{
+		conns = conn->next;
+		close(conn->fd);
+		free(conn->text);
+		free(conn);
+	}
+	free(fds);
+	free(polled);
+
+	signal(SIGINT, old_sigint);
+	signal(SIGTERM, old_sigterm);
+	signal(SIGPIPE, old_sigpipe);
+	wake_fd = -1;
+	close(wake[0]);
+	close(wake[1]);
+	close(listen_fd);
+	unlink(path);
+
+	pthread_cond_destroy(&srv.ready);
+	pthread_mutex_destroy(&srv.lock);
+
+	return 0;
+}
+
+/* A listening socket at path.  A socket left over from an earlier
+ * server gets replaced, but not any other kind of file. */
+static int
+open_socket(const char *path)
+{
+	struct sockaddr_un addr;
+	struct stat st;
+	int fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path))
+	{
+		fprintf(stderr, "Socket name \"%s\" is too long\n", path);
+		return -1;
+	}
+
+	if (0 == stat(path, &st) && S_ISSOCK(st.st_mode))
+		unlink(path);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	if (0 > (fd = socket(AF_UNIX, SOCK_STREAM, 0)))
+	{
+		fprintf(stderr, "Problem making a socket: %s\n", strerror(errno));
+		return -1;
+	}
+
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(fd, 64))
+	{
+		fprintf(stderr, "Problem listening on \"%s\": %s\n", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static void
+stop_handler(int signo)
+{
+	(void)signo;
+	stop_requested = 1;
+	if (0 <= wake_fd)
+		(void)write(wake_fd, "", 1);
+}
+
+/* Append whatever the client has sent.  Returns 0 at end of
+ * file, on an error, or when a line gets too long. */
+static int
+read_connection(struct connection *conn)
+{
+	int n;
+
+	if (conn->size - conn->length < 4096)
+	{
+		conn->size = conn->size? 2*conn->size: 8192;
+		conn->text = realloc(conn->text, conn->size);
+	}
+
+	n = read(conn->fd, &conn->text[conn->length], conn->size - conn->length);
+	if (n <= 0)
+		return 0;
+
+	conn->length += n;
+
+	if (conn->length > MAX_REQUEST
+		&& !memchr(conn->text, '\n', conn->length))
+	{
+		conn->length = 0;
+		return 0;
+	}
+
+	return 1;
+}
+
+/* Queue the next complete line of an idle connection.  Blank
+ * lines don't get an answer.  Returns 1 if the connection is busy. */
+static int
+dispatch(struct server *srv, struct connection *conn)
+{
+	int busy;
+
+	pthread_mutex_lock(&srv->lock);
+	busy = conn->busy;
+	pthread_mutex_unlock(&srv->lock);
+
+	while (!busy)
+	{
+		struct request *rq;
+		char *nl, *p;
+		int length;
+
+		if (NULL == (nl = memchr(conn->text, '\n', conn->length)))
+		{
+			/* The last line doesn't need a newline */
+			if (!conn->eof || 0 == conn->length)
+				break;
+			if (conn->length == conn->size)
+				conn->text = realloc(conn->text, ++conn->size);
+			conn->text[conn->length++] = '\n';
+			nl = &conn->text[conn->length - 1];
+		}
+		length = nl - conn->text + 1;
+
+		for (p = conn->text; p < nl; ++p)
+			if (' ' != *p && '\t' != *p && '\r' != *p)
+				break;
+
+		if (p < nl)
+		{
+			rq = malloc(sizeof(*rq));
+			rq->conn = conn;
+			rq->line = malloc(length);
+			memcpy(rq->line, conn->text, length);
+			rq->length = length;
+			rq->next = NULL;
+
+			pthread_mutex_lock(&srv->lock);
+			conn->busy = busy = 1;
+			if (srv->tail)
+				srv->tail->next = rq;
+			else
+				srv->head = rq;
+			srv->tail = rq;
+			pthread_cond_signal(&srv->ready);
+			pthread_mutex_unlock(&srv->lock);
+		}
+
+		memmove(conn->text, &conn->text[length], conn->length - length);
+		conn->length -= length;
+	}
+
+	return busy;
+}
+
+static void *
+serve_requests(void *arg)
+{
+	struct worker *w = arg;
+	struct server *srv = w->srv;
+
+	for (;;)
+	{
+		struct request *rq;
+
+		pthread_mutex_lock(&srv->lock);
+		while (!srv->head && !srv->stopping)
+			pthread_cond_wait(&srv->ready, &srv->lock);
+		if (NULL == (rq = srv->head))
+		{
+			pthread_mutex_unlock(&srv->lock);
+			break;
+		}
+		srv->head = rq->next;
+		if (!srv->head)
+			srv->tail = NULL;
+		pthread_mutex_unlock(&srv->lock);
+
+		answer(w, rq);
+
+		pthread_mutex_lock(&srv->lock);
+		rq->conn->busy = 0;
+		pthread_mutex_unlock(&srv->lock);
+		(void)write(wake_fd, "", 1);
+
+		free(rq->line);
+		free(rq);
+	}
+
+	return NULL;
+}
+
+/* Parse, reduce and answer one request, in the worker's session */
+static void
+answer(struct worker *w, struct request *rq)
+{
+	static const char *status_names[] = {
+		"normal", "step_limit", "node_limit", "timeout", "interrupted",
+		"cycle", "growth"
+	};
+	struct lc_context *ctx = w->ctx;
+	struct server *srv = w->srv;
+	double steps = srv->max_steps, seconds = srv->max_seconds;
+	double nodes = srv->max_nodes;
+	double started = monotonic_seconds();
+	long in_use;
+	const char *status = "syntax_error";
+	char *p = rq->line, *end;
+	struct lambda_expression *e;
+	struct lc_limits limits;
+	struct lc_outcome outcome;
+	struct buffer *b;
+	char numbers[128];
+
+	for (;;)
+	{
+		while (' ' == *p || '\t' == *p)
+			++p;
+		if (!strncmp(p, "steps=", 6))
+			steps = clamp_budget(strtod(p + 6, &end), srv->max_steps);
+		else if (!strncmp(p, "seconds=", 8))
+			seconds = clamp_budget(strtod(p + 8, &end), srv->max_seconds);
+		else if (!strncmp(p, "nodes=", 6))
+			nodes = clamp_budget(strtod(p + 6, &end), srv->max_nodes);
+		else
+			break;
+		p = end;
+	}
+
+	limits.strategy = ctx->eta_reduction? LC_NORMAL_ORDER: LC_NORMAL_ORDER_BETA;
+	limits.steps = steps;
+	limits.seconds = seconds;
+	outcome.beta_steps = outcome.eta_steps = 0;
+	in_use = nodes_allocated(ctx) - nodes_freed(ctx);
+
+	if (NULL != (e = lc_parse(ctx, p, rq->length - (p - rq->line))))
+	{
+		/* The term itself counts against the request's nodes */
+		long term_nodes = nodes_allocated(ctx) - nodes_freed(ctx) - in_use;
+		limits.nodes = (nodes <= 0.0)? 0: (nodes > term_nodes)? nodes - term_nodes: 1;
+		e = lc_reduce(ctx, e, &limits, &outcome);
+		status = status_names[outcome.status];
+	}
+
+	b = new_buffer(PRINT_CHUNK_SIZE);
+	b->drain = drain_to_connection;
+	b->sink = &rq->conn->fd;
+
+	buffer_append(b, "status=", 7);
+	buffer_append(b, status, strlen(status));
+	sprintf(numbers, " beta=%ld eta=%ld nodes=%ld seconds=%.3f",
+		outcome.beta_steps, outcome.eta_steps,
+		e? nodes_allocated(ctx) - nodes_freed(ctx) - in_use: 0,
+		monotonic_seconds() - started);
+	buffer_append(b, numbers, strlen(numbers));
+	if (e && LC_NORMAL_FORM == outcome.status)
+	{
+		buffer_append(b, " result=", 8);
+		buffer_expression(e, b);
+	}
+	buffer_append(b, "\n", 1);
+	flush_buffer(b);
+	delete_buffer(b);
+
+	if (e)
+		free_expression(ctx, e);
+}
+
+/* A request's budget, where 0 means as much as the server allows */
+static double
+clamp_budget(double asked, double most)
+{
+	if (asked <= 0.0 || (most > 0.0 && asked > most))
+		return most;
+	return asked;
+}
+
+static void
+drain_to_connection(struct buffer *b)
+{
+	write_all(*(int *)b->sink, b->buffer, b->offset);
+	b->offset = 0;
+	b->buffer[0] = '\0';
+}
+
+/* A client that went away just doesn't get its answer */
+static void
+write_all(int fd, const char *p, int length)
+{
+	while (length > 0)
+	{
+		int n = write(fd, p, length);
+		if (n < 0 && EINTR == errno)
+			continue;
+		if (n <= 0)
+			break;
+		p += n;
+		length -= n;
+	}
+}
@@ -0,0 +1,28 @@
+/*
+	Copyright (C) 2006-2011, Bruce Ediger
+
+    This file is part of lc.
+
+    lc is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    lc is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with lc; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/* Server mode: answer requests, one expression per line, from any
+ * number of clients of a Unix domain socket, on a pool of threads
+ * that each have a session holding whatever ctx had loaded.  Steps,
+ * seconds and nodes of each request get capped at ctx's step_limit
+ * and reduction_timeout, and max_nodes, where those aren't 0.
+ */
+int run_server(struct lc_context *ctx, const char *path, int worker_count, long max_nodes);
@@ -28,44 +28,43 @@
  * can exist inside an abstraction (\x.x y (\x.F) z) it has the ability
  * to delete single elements, as well as cleaning out the entire table.
  * Not only does it keep unused structs small_hashtable on a free-list,
- * it has a free-list for unused structs small_hashnode, too.
+ * it has a free-list for unused structs small_hashnode, too.  Both
+ * free-lists belong to the session.
+ * Keys have to be Atoms: hashing uses the value cached in the atom.
  */
 
 #include <stdio.h>
+#include <signal.h>  /* sig_atomic_t */
 #include <stdlib.h>  /* malloc(), free() */
 #include <assert.h>  /* assert macro */
 
+#include <context.h>
 #include <small_hashtable.h>
+#include <hashtable.h>
+#include <atom.h>
 
-struct small_hashnode *new_small_hashnode(void);
-unsigned long hash(const unsigned char *str);
+struct small_hashnode *new_small_hashnode(struct lc_context *ctx);
 struct small_hashnode *find_node(struct small_hashtable *h, const char *key);
-void free_small_hashnode(struct small_hashnode *p);
+void free_small_hashnode(struct lc_context *ctx, struct small_hashnode *p);
 
 /* number of buckets has to be a power of 2 for this to work */
 /* XXX - need to guarantee power-of-2 number of buckets? */
 #define MOD(x,y) ((x)&((y)-1))
 
-struct small_hashnode *free_hashnode_list = NULL;
-struct small_hashtable *free_hashtable_list = NULL;
-
-static int hashtables_allocated = 0;
-static int hashnodes_allocated = 0;
-
 /* Value of bucketcount needs to constitute a power of 2 - does not
  * use '%' modulus operator, so an arbitrary bucket count won't work. */
 struct small_hashtable *
-init_small_hashtable(int bucketcount)
+init_small_hashtable(struct lc_context *ctx, int bucketcount)
 {
 	unsigned int i;
 	struct small_hashtable *h = NULL;
 
-	if (free_hashtable_list)
+	if (ctx->free_hashtable_list)
 	{
 		/* Giving back a previously allocated struct small_hashtable.
 		 * Note that this ignores value of bucketcount. */
-		h = free_hashtable_list;
-		free_hashtable_list = h->next_free;
+		h = ctx->free_hashtable_list;
+		ctx->free_hashtable_list = h->next_free;
 	} else {
 		/* Heap allocation of an entirely new struct small_hashtable. */
 		h = malloc(sizeof(*h));
@@ -73,14 +72,14 @@ init_small_hashtable(int bucketcount)
 		h->size  = 0;
 		h->buckets = malloc(sizeof(struct small_hashnode *) * h->count);
 
-		++hashtables_allocated;
+		++ctx->hashtables_allocated;
 
 		for (i = 0; i < h->count; ++i)
 		{
 			struct small_hashnode *head, *tail;
 
-			head = new_small_hashnode();
-			tail = new_small_hashnode();
+			head = new_small_hashnode(ctx);
+			tail = new_small_hashnode(ctx);
 
 			head->next = tail;
 			tail->prev = head;
@@ -107,7 +106,7 @@ find_node(struct small_hashtable *h, const char *key)
 	if (h->size)
 	{
 		unsigned int index;
-		unsigned long hv = hash((const unsigned char *)key);
+		unsigned long hv = Atom_hash(key);
 
 		index = MOD(hv, h->count);
 		chain = h->buckets[index]->next;
@@ -146,14 +145,14 @@ find_value(struct small_hashtable *h, const char *key)
 }
 
 const void *
-insert_value(struct small_hashtable *h, const char *key, const void *value)
+insert_value(struct lc_context *ctx, struct small_hashtable *h, const char *key, const void *value)
 {
 	unsigned long hv;
 	unsigned long index;
 	struct small_hashnode *head, *n;
 	struct small_hashnode *chain = NULL;
 
-	hv = hash((const unsigned char *)key);
+	hv = Atom_hash(key);
 
 	index = MOD(hv, h->count);
 	head = h->buckets[index];
@@ -169,7 +168,7 @@ insert_value(struct small_hashtable *h, const char *key, const void *value)
 	if (NULL != chain)
 		return chain->key;
 
-	n = new_small_hashnode();
+	n = new_small_hashnode(ctx);
 
 	n->key = key;
 	n->value = value;
@@ -188,7 +187,7 @@ insert_value(struct small_hashtable *h, const char *key, const void *value)
 /* The neccessities of removal causes me to make
  *  the hashchains into doubly-linked lists */
 const void *
-remove_key(struct small_hashtable *h, const char *key)
+remove_key(struct lc_context *ctx, struct small_hashtable *h, const char *key)
 {
 	const void *r = NULL;
 	struct small_hashnode *n;
@@ -198,7 +197,7 @@ remove_key(struct small_hashtable *h, const char *key)
 		r = n->value;
 		n->next->prev = n->prev;
 		n->prev->next = n->next;
-		free_small_hashnode(n);
+		free_small_hashnode(ctx, n);
 		--h->size;
 	}
 
@@ -206,7 +205,7 @@ remove_key(struct small_hashtable *h, const char *key)
 }
 
 void
-free_small_hashtable(struct small_hashtable *h)
+free_small_hashtable(struct lc_context *ctx, struct small_hashtable *h)
 {
 	unsigned int i;
 
@@ -219,8 +218,8 @@ free_small_hashtable(struct small_hashtable *h)
 			struct small_hashnode *first = head->next;
 			struct small_hashnode *last  = head->prev->prev;
 
-			last->next = free_hashnode_list;
-			free_hashnode_list = first;
+			last->next = ctx->free_hashnode_list;
+			ctx->free_hashnode_list = first;
 
 			head->next = head->prev;
 			head->prev->prev = head;
@@ -229,22 +228,22 @@ free_small_hashtable(struct small_hashtable *h)
 
 	h->size = 0;
 
-	h->next_free = free_hashtable_list;
-	free_hashtable_list = h;
+	h->next_free = ctx->free_hashtable_list;
+	ctx->free_hashtable_list = h;
 }
 
 struct small_hashnode *
-new_small_hashnode(void)
+new_small_hashnode(struct lc_context *ctx)
 {
 	struct small_hashnode *r = NULL;
 
-	if (free_hashnode_list)
+	if (ctx->free_hashnode_list)
 	{
-		r = free_hashnode_list;
-		free_hashnode_list = free_hashnode_list->next;
+		r = ctx->free_hashnode_list;
+		ctx->free_hashnode_list = ctx->free_hashnode_list->next;
 	} else {
 		r = malloc(sizeof(*r));
-		++hashnodes_allocated;
+		++ctx->hashnodes_allocated;
 	}
 
 	r->next = r->prev = NULL;
@@ -255,71 +254,57 @@ new_small_hashnode(void)
 }
 
 void
-free_small_hashnode(struct small_hashnode *p)
+free_small_hashnode(struct lc_context *ctx, struct small_hashnode *p)
 {
 	p->prev = NULL;
 	p->key = NULL;
 	p->value = NULL;
-	p->next = free_hashnode_list;
-	free_hashnode_list = p;
+	p->next = ctx->free_hashnode_list;
+	ctx->free_hashnode_list = p;
 }
 
 void
-free_all_small_hashtable(void)
+free_all_small_hashtable(struct lc_context *ctx)
 {
 	int hashtables_freed = 0;
 	int hashnodes_freed  = 0;
 
-	while (free_hashtable_list)
+	while (ctx->free_hashtable_list)
 	{
 		unsigned int i;
-		struct small_hashtable *tmp = free_hashtable_list->next_free;
+		struct small_hashtable *tmp = ctx->free_hashtable_list->next_free;
 
-		for (i = 0; i < free_hashtable_list->count; ++i)
+		for (i = 0; i < ctx->free_hashtable_list->count; ++i)
 		{
 			struct small_hashnode *head
-				= free_hashtable_list->buckets[i];
-			head->prev->next = free_hashnode_list;
-			free_hashnode_list = head;
+				= ctx->free_hashtable_list->buckets[i];
+			head->prev->next = ctx->free_hashnode_list;
+			ctx->free_hashnode_list = head;
 		}
 
-		free_hashtable_list->next_free = NULL;
-		free(free_hashtable_list->buckets);
-		free_hashtable_list->buckets = NULL;
-		free(free_hashtable_list);
+		ctx->free_hashtable_list->next_free = NULL;
+		free(ctx->free_hashtable_list->buckets);
+		ctx->free_hashtable_list->buckets = NULL;
+		free(ctx->free_hashtable_list);
 
-		free_hashtable_list = tmp;
+		ctx->free_hashtable_list = tmp;
 		++hashtables_freed;
 	}
 
-	while (free_hashnode_list)
+	while (ctx->free_hashnode_list)
 	{
-		struct small_hashnode *tmp = free_hashnode_list->next;
-		free_hashnode_list->next = NULL;
-		free(free_hashnode_list);
-		free_hashnode_list = tmp;
+		struct small_hashnode *tmp = ctx->free_hashnode_list->next;
+		ctx->free_hashnode_list->next = NULL;
+		free(ctx->free_hashnode_list);
+		ctx->free_hashnode_list = tmp;
 		++hashnodes_freed;
 	}
 
-	if (hashtables_freed != hashtables_allocated)
-		printf("Allocated %d structs small_hashtables, freed %d\n",
-			hashtables_allocated, hashtables_freed);
-
-	if (hashnodes_freed != hashnodes_allocated)
-		printf("Allocated %d structs small_hashnode, freed %d\n",
-			hashnodes_allocated, hashnodes_freed);
-}
-
-/* djb2 hash function */
-unsigned long
-hash(const unsigned char *str)
-{
-	unsigned long hv = 5381;
-	unsigned int c;
-
-	while ((c = *str++))
-		hv = (hv * 33) ^ c;
-	/*	hv = ((hv << 5) + hv) ^ c; */
+	if (hashtables_freed != ctx->hashtables_allocated)
+		fprintf(ctx->out, "Allocated %d structs small_hashtables, freed %d\n",
+			ctx->hashtables_allocated, hashtables_freed);
 
-	return hv;
+	if (hashnodes_freed != ctx->hashnodes_allocated)
+		fprintf(ctx->out, "Allocated %d structs small_hashnode, freed %d\n",
+			ctx->hashnodes_allocated, hashnodes_freed);
 }
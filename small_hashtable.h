@@ -35,12 +35,12 @@ struct small_hashtable {
 	struct small_hashtable *next_free;
 };
 
-struct small_hashtable *init_small_hashtable(int bucketcount);
+struct small_hashtable *init_small_hashtable(struct lc_context *ctx, int bucketcount);
 const void *find_value(struct small_hashtable   *h, const char *key);
 struct small_hashnode *find_node(struct small_hashtable *h, const char *key);
-const void *remove_key(struct small_hashtable   *h, const char *key);
-const void *insert_value(struct small_hashtable *h, const char *key, const void *value);
-void free_small_hashtable(struct small_hashtable *h);
+const void *remove_key(struct lc_context *ctx, struct small_hashtable   *h, const char *key);
+const void *insert_value(struct lc_context *ctx, struct small_hashtable *h, const char *key, const void *value);
+void free_small_hashtable(struct lc_context *ctx, struct small_hashtable *h);
 void print_small_hashtable(struct small_hashtable *h, int print_vars_only);
-void free_all_small_hashtable(void);
+void free_all_small_hashtable(struct lc_context *ctx);
 
@@ -0,0 +1,213 @@
+/*
+	Copyright (C) 2006-2011, Bruce Ediger
+
+    This file is part of lc.
+
+    lc is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    lc is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with lc; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/*
+ * Writing binary reduction traces.  See trace.h for the file layout.
+ * Recording an event costs a clock_gettime() and a 48-byte store into
+ * mmap()ed memory: the kernel does the writing.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>     /* memcpy(), memset(), strerror() */
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>       /* clock_gettime(), time() */
+#include <unistd.h>     /* ftruncate(), pwrite(), close() */
+#include <fcntl.h>      /* open() */
+#include <sys/types.h>
+#include <sys/mman.h>   /* mmap(), munmap() */
+#include <signal.h>     /* sig_atomic_t */
+
+#include <context.h>
+#include <hashtable.h>
+#include <atom.h>
+#include <small_hashtable.h>
+#include <buffer.h>
+#include <lambda_expression.h>
+#include <json.h>
+#include <trace.h>
+
+/* One session's trace, in ctx->trace while tracing.  Callers check
+ * ctx->binary_trace before calling trace_record(). */
+struct trace_state {
+	int fd;
+	struct trace_header *header;
+	struct trace_event *ring;
+	size_t mapped_size;
+	struct timespec started;
+	uint32_t reductions;
+	long last_allocated;
+	long last_freed;
+};
+
+static int write_names(int fd, off_t offset);
+
+int
+trace_open(struct lc_context *ctx, const char *filename)
+{
+	struct trace_state *t;
+	void *p;
+
+	trace_close(ctx);
+
+	t = malloc(sizeof(*t));
+
+	if ((t->fd = open(filename, O_RDWR|O_CREAT|O_TRUNC, 0666)) < 0)
+	{
+		statement_error(ctx, "Could not open \"%s\" for write: %s",
+			filename, strerror(errno));
+		free(t);
+		return 0;
+	}
+
+	t->mapped_size = sizeof(*t->header) + TRACE_CAPACITY*sizeof(*t->ring);
+
+	if (ftruncate(t->fd, t->mapped_size) < 0
+		|| MAP_FAILED == (p = mmap(NULL, t->mapped_size,
+			PROT_READ|PROT_WRITE, MAP_SHARED, t->fd, 0)))
+	{
+		statement_error(ctx, "Problem setting up trace file \"%s\": %s",
+			filename, strerror(errno));
+		close(t->fd);
+		free(t);
+		return 0;
+	}
+
+	t->header = p;
+	t->ring = (struct trace_event *)(t->header + 1);
+
+	memset(t->header, 0, sizeof(*t->header));
+	memcpy(t->header->magic, TRACE_MAGIC, sizeof(t->header->magic));
+	t->header->version = TRACE_VERSION;
+	t->header->event_size = sizeof(*t->ring);
+	t->header->capacity = TRACE_CAPACITY;
+	t->header->start_time = time(NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &t->started);
+	t->reductions = 0;
+	t->last_allocated = nodes_allocated(ctx);
+	t->last_freed = nodes_freed(ctx);
+
+	ctx->trace = t;
+	ctx->binary_trace = 1;
+
+	return 1;
+}
+
+void
+trace_close(struct lc_context *ctx)
+{
+	struct trace_state *t = ctx->trace;
+
+	if (!t)
+		return;
+
+	ctx->binary_trace = 0;
+
+	/* Names go after the ring, so the ring can stay mapped
+	 * at a fixed size while lc runs. */
+	if (write_names(t->fd, t->mapped_size))
+		t->header->names_offset = t->mapped_size;
+
+	munmap(t->header, t->mapped_size);
+	close(t->fd);
+
+	free(t);
+	ctx->trace = NULL;
+}
+
+void
+trace_record(
+	struct lc_context *ctx,
+	enum trace_kind kind,
+	unsigned int step,
+	const char *name,
+	int depth,
+	uint64_t path,
+	int flags
+)
+{
+	struct trace_state *t = ctx->trace;
+	struct trace_event *ev = &t->ring[t->header->total % t->header->capacity];
+	struct timespec now;
+	long allocated = nodes_allocated(ctx);
+	long freed = nodes_freed(ctx);
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	if (TRACE_START == kind)
+		++t->reductions;
+
+	ev->time = (uint64_t)(now.tv_sec - t->started.tv_sec)*1000000000
+		+ now.tv_nsec - t->started.tv_nsec;
+	ev->path = path;
+	ev->reduction = t->reductions;
+	ev->step = step;
+	ev->name = name? Atom_id(name) + 1: 0;
+	ev->allocated = allocated - t->last_allocated;
+	ev->freed = freed - t->last_freed;
+	ev->depth = depth > 0xffff? 0xffff: depth;
+	ev->kind = kind;
+	ev->flags = flags;
+
+	t->last_allocated = allocated;
+	t->last_freed = freed;
+
+	++t->header->total;
+}
+
+static int
+write_names(int fd, off_t offset)
+{
+	uint32_t count = Atom_count(), i;
+	struct buffer *b = new_buffer(4096);
+	int r = 1;
+
+	buffer_append(b, (const char *)&count, sizeof(count));
+
+	for (i = 0; i < count && r; ++i)
+	{
+		const char *name = Atom_from_id(i);
+		uint32_t length = Atom_length(name);
+
+		buffer_append(b, (const char *)&length, sizeof(length));
+		buffer_append(b, name, length);
+
+		if (b->offset > 65536 || i == count - 1)
+		{
+			if (pwrite(fd, b->buffer, b->offset, offset) != b->offset)
+				r = 0;
+			offset += b->offset;
+			b->offset = 0;
+		}
+	}
+
+	if (0 == count && pwrite(fd, b->buffer, b->offset, offset) != b->offset)
+		r = 0;
+
+	if (!r)
+		fprintf(stderr, "Problem writing names to trace file: %s\n", strerror(errno));
+
+	delete_buffer(b);
+
+	return r;
+}
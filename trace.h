@@ -0,0 +1,84 @@
+/*
+	Copyright (C) 2006-2011, Bruce Ediger
+
+    This file is part of lc.
+
+    lc is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    lc is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with lc; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/* Binary reduction traces.  "trace > file" makes every reduction step
+ * store one fixed-size event in a ring of events in an mmap()ed file:
+ * no printing, and no walking the term.  lctrace turns the file back
+ * into text, or into statistics, afterwards.
+ *
+ * File layout: a struct trace_header, capacity events (the newest
+ * "total % capacity" of them overwriting the oldest), and after
+ * tracing stops, the names of all atoms, in ID order: a uint32_t
+ * count, then per atom a uint32_t length and the bytes.
+ */
+
+#define TRACE_MAGIC    "lctrace"
+#define TRACE_VERSION  2
+#define TRACE_CAPACITY (1024*1024)  /* events in the ring, 40 MB */
+
+enum trace_kind {
+	TRACE_START = 1,  /* a reduction begins; name: 0 */
+	TRACE_BETA,       /* name: bound variable */
+	TRACE_ETA,        /* name: bound variable */
+	TRACE_DELTA,      /* an abbreviation got expanded; name: abbreviation */
+	TRACE_END         /* a reduction ends; step: steps taken */
+};
+
+#define TRACE_LIMITED  1  /* TRACE_END: ran out of step budget */
+
+/* Directions along the path from the root to a redex, two bits per
+ * edge, first edge in the low bits.  Only the first 32 edges fit,
+ * depth has the whole length. */
+#define TRACE_RATOR 1
+#define TRACE_RAND  2
+#define TRACE_BODY  3
+#define TRACE_PATH_EDGES 32
+
+struct trace_header {
+	char     magic[8];
+	uint32_t version;
+	uint32_t event_size;
+	uint64_t capacity;
+	uint64_t total;         /* events ever recorded */
+	uint64_t names_offset;  /* 0 until tracing stops */
+	uint64_t start_time;    /* seconds since the epoch */
+	uint8_t  pad[16];
+};
+
+struct trace_event {
+	uint64_t time;       /* nanoseconds since tracing started */
+	uint64_t path;
+	uint32_t reduction;  /* counts TRACE_START events */
+	uint32_t step;       /* beta and eta steps so far in this reduction */
+	uint32_t name;       /* atom ID plus one, 0 for none */
+	uint32_t allocated;  /* expression nodes allocated during the step */
+	uint32_t freed;      /* and freed */
+	uint16_t depth;      /* edges from root to redex */
+	uint8_t  kind;
+	uint8_t  flags;
+};
+
+/* lc's side.  lctrace doesn't see struct lc_context, only this. */
+struct lc_context;
+int  trace_open(struct lc_context *ctx, const char *filename);
+void trace_close(struct lc_context *ctx);
+void trace_record(struct lc_context *ctx, enum trace_kind kind, unsigned int step,
+	const char *name, int depth, uint64_t path, int flags);
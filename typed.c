@@ -0,0 +1,1159 @@
+/*
+	Copyright (C) 2006-2011, Bruce Ediger
+
+    This file is part of lc.
+
+    lc is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    lc is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with lc; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+
+/*
+ * Typed evaluation.  type_of() infers a simple type for a term, by
+ * unification on a graph of types, without an occurs check: a type
+ * that would have to contain itself shows up as a cycle in the graph,
+ * which one pass looks for at the end.  typed_normal_form() evaluates
+ * a typable term in a lazy Krivine machine: an application pushes its
+ * argument, unevaluated, with the environment it needs, and a variable
+ * evaluates its argument the first time something needs it, keeping the
+ * value for every other use.  Reading the values back, evaluating under
+ * abstractions as it goes, gives the beta normal form.  Walks of terms,
+ * types and values all use explicit stacks, never the C stack.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>     /* memset(), strlen() */
+#include <signal.h>     /* sig_atomic_t */
+
+#include <context.h>
+#include <small_hashtable.h>
+#include <buffer.h>
+#include <lambda_expression.h>
+#include <abbreviations.h>
+#include <evaluation.h>
+#include <atom.h>
+#include <typed.h>
+
+#define TYPE_LIMIT (1<<22)     /* types one inference may make */
+#define MACHINE_CHUNK 65536    /* bytes the machine allocates at once */
+
+/* A type variable, or with from and to, an arrow.  Unification links
+ * a type to one it got unified with; find() follows the links to the
+ * type that stands for all of them.  Index 0 is no type. */
+struct type {
+	int link;
+	int from, to;
+	unsigned int mark;  /* which walk of the graph last got here */
+	int copy;           /* that walk's copy of it, or name for it */
+};
+
+/* infer()'s explicit stack: a term to type, or a step to finish
+ * once the types of a term's parts are on the stack of values */
+enum type_step { TYPE_TERM, TYPE_APPLIED, TYPE_ABSTRACTED, TYPE_EXPANDED };
+struct type_frame {
+	enum type_step step;
+	struct lambda_expression *node;
+	int type;           /* TYPE_ABSTRACTED: the bound variable's type, */
+	int saved;          /* and the binding its abstraction hides */
+};
+
+/* A closed abbreviation's type, generalized, and its value while
+ * the machine runs */
+struct abbreviation_slot {
+	struct abbreviation *abbreviation;
+	int type;
+	struct thunk *thunk;
+};
+
+struct typing_state {
+	struct type *types;
+	int type_count;
+	int types_size;
+	int overflow;
+	unsigned int walk;
+
+	/* per atom: a bound variable's type, a free variable's type,
+	 * and how many abstractions read back so far use it */
+	int *binding;
+	int *free_type;
+	int *in_scope;
+	unsigned int atoms;
+	unsigned int *typed_free;   /* atoms free_type has an entry for */
+	unsigned int free_count;
+
+	struct type_frame *frames;
+	size_t frames_size;
+	int *values;
+	size_t values_size;
+	int *work;
+	size_t work_size;
+
+	struct abbreviation_slot *slots;  /* open addressing, by seq */
+	unsigned int slots_size;
+	unsigned int slots_used;
+};
+
+/* The machine: arguments not yet evaluated, with their environments,
+ * and the values they come to.  A value is a closure, or is stuck: a
+ * variable, free or bound by an abstraction being read back, applied
+ * to arguments. */
+struct env {
+	const char *name;
+	struct thunk *thunk;
+	struct env *next;
+};
+
+struct thunk {
+	struct lambda_expression *term;   /* NULL once value is in */
+	struct env *env;
+	long repeat;        /* term's repeated applications left, 0: all,
+	                     * or -1: a variable read_back() binds */
+	struct value *value;
+};
+
+struct spine {
+	struct thunk *arg;
+	struct spine *next;
+};
+
+struct value {
+	struct lambda_expression *abstraction;  /* NULL: stuck */
+	struct env *env;
+	int level;          /* stuck on the level-th abstraction read back, */
+	const char *name;   /* or, with level -1, on a free variable */
+	struct spine *args; /* last argument first */
+};
+
+/* whnf()'s stack: an argument for the value to come, or a thunk
+ * to keep the value in */
+struct machine_frame {
+	int update;
+	struct thunk *thunk;
+};
+
+/* read_back()'s stack: a thunk whose value goes in place.  And
+ * name_binders()'s: a term read back, in place, or with name set,
+ * the scope of an abstraction's name to leave. */
+struct readback_task {
+	struct thunk *thunk;
+	struct lambda_expression **place;
+	int depth;
+	const char *name;
+};
+
+struct chunk {
+	struct chunk *next;
+	size_t used;
+};
+
+struct machine {
+	struct lc_context *ctx;
+	struct typing_state *s;
+	struct reduction_state *rs;
+	int stopped;
+	struct chunk *chunks;
+	struct machine_frame *frames;
+	size_t frames_size;
+	struct readback_task *tasks;
+	size_t tasks_size;
+	const char **names;         /* per level of abstraction */
+	size_t names_size;
+	struct value **closures;    /* per abstraction read back */
+	size_t closures_size;
+	size_t closures_used;
+	struct lambda_expression **walk;  /* binder_name()'s stack */
+	size_t walk_size;
+};
+
+static struct typing_state *typing_state(struct lc_context *ctx);
+static void atom_slots(struct typing_state *s);
+static struct abbreviation_slot *abbreviation_slot(struct typing_state *s, struct abbreviation *a);
+static int  new_type(struct typing_state *s, int from, int to);
+static int  find(struct typing_state *s, int t);
+static void push_work(struct typing_state *s, size_t *n, int t);
+static void unify(struct typing_state *s, int a, int b);
+static int  instantiate(struct typing_state *s, int t);
+static int  acyclic(struct typing_state *s);
+static enum typing infer(struct typing_state *s, struct lambda_expression *term, int *type);
+static void buffer_type(struct typing_state *s, int t, struct buffer *b, int *names);
+
+static void *allocate(struct machine *m, size_t size);
+static struct thunk *new_thunk(struct machine *m, struct lambda_expression *term, struct env *env, long repeat);
+static struct env *extend(struct machine *m, struct env *env, const char *name, struct thunk *thunk);
+static struct value *stuck(struct machine *m, int level, const char *name, struct spine *args);
+static void push_frame(struct machine *m, size_t *n, int update, struct thunk *thunk);
+static int  step(struct machine *m, long *steps);
+static struct value *whnf(struct machine *m, struct thunk *t);
+static void push_task(struct machine *m, size_t *n, struct thunk *thunk, struct lambda_expression **place, int depth, const char *name);
+static int  eta_redex(struct lc_context *ctx, struct lambda_expression *abstraction);
+static struct lambda_expression *read_back(struct machine *m, struct thunk *root);
+static void name_binders(struct machine *m, struct lambda_expression **root);
+static const char *binder_name(struct machine *m, struct lambda_expression *abstraction, struct value *closure, int depth);
+
+enum typing
+type_of(struct lc_context *ctx, struct lambda_expression *term, struct buffer *text)
+{
+	struct typing_state *s = typing_state(ctx);
+	int type, names = 0;
+	enum typing r = infer(s, term, &type);
+
+	if (TYPE_FOUND == r && text)
+	{
+		++s->walk;
+		buffer_type(s, type, text, &names);
+	}
+
+	return r;
+}
+
+struct lambda_expression *
+typed_normal_form(struct lc_context *ctx, struct lambda_expression *term, struct reduction_state *rs)
+{
+	struct typing_state *s = typing_state(ctx);
+	struct lambda_expression *r;
+	struct machine m;
+	long beta_steps = rs->beta_steps;
+	int type;
+
+	if (TYPE_FOUND != infer(s, term, &type))
+		return NULL;
+	++ctx->typed_reductions;
+
+	memset(&m, 0, sizeof(m));
+	m.ctx = ctx;
+	m.s = s;
+	m.rs = rs;
+
+	r = read_back(&m, new_thunk(&m, term, NULL, 0));
+	if (r)
+		name_binders(&m, &r);
+
+	while (m.chunks)
+	{
+		struct chunk *next = m.chunks->next;
+		free(m.chunks);
+		m.chunks = next;
+	}
+	free(m.frames);
+	free(m.tasks);
+	free(m.names);
+	free(m.closures);
+	free(m.walk);
+
+	if (!r)
+	{
+		rs->beta_steps = beta_steps;
+		return NULL;
+	}
+
+	++ctx->fast_paths;
+	free_expression(ctx, term);
+
+	return r;
+}
+
+void
+free_typing_state(struct lc_context *ctx)
+{
+	struct typing_state *s = ctx->typing;
+
+	if (!s)
+		return;
+
+	free(s->types);
+	free(s->binding);
+	free(s->free_type);
+	free(s->in_scope);
+	free(s->typed_free);
+	free(s->frames);
+	free(s->values);
+	free(s->work);
+	free(s->slots);
+	free(s);
+	ctx->typing = NULL;
+}
+
+static struct typing_state *
+typing_state(struct lc_context *ctx)
+{
+	if (!ctx->typing)
+		ctx->typing = calloc(1, sizeof(*ctx->typing));
+	return ctx->typing;
+}
+
+/* Per-atom arrays, big enough for every atom so far */
+static void
+atom_slots(struct typing_state *s)
+{
+	unsigned int atoms = Atom_count();
+
+	if (atoms > s->atoms)
+	{
+		size_t bytes;
+		atoms += atoms/2;
+		s->binding = realloc(s->binding, atoms*sizeof(int));
+		s->free_type = realloc(s->free_type, atoms*sizeof(int));
+		s->in_scope = realloc(s->in_scope, atoms*sizeof(int));
+		s->typed_free = realloc(s->typed_free, atoms*sizeof(unsigned int));
+		bytes = (atoms - s->atoms)*sizeof(int);
+		memset(&s->binding[s->atoms], 0, bytes);
+		memset(&s->free_type[s->atoms], 0, bytes);
+		memset(&s->in_scope[s->atoms], 0, bytes);
+		s->atoms = atoms;
+	}
+}
+
+static struct abbreviation_slot *
+abbreviation_slot(struct typing_state *s, struct abbreviation *a)
+{
+	unsigned int i;
+
+	if (2*(s->slots_used + 1) > s->slots_size)
+	{
+		struct abbreviation_slot *old = s->slots;
+		unsigned int old_size = s->slots_size;
+
+		s->slots_size = old_size? 2*old_size: 64;
+		s->slots = calloc(s->slots_size, sizeof(*s->slots));
+		for (i = 0; i < old_size; ++i)
+			if (old[i].abbreviation)
+				*abbreviation_slot(s, old[i].abbreviation) = old[i];
+		free(old);
+	}
+
+	for (i = a->seq & (s->slots_size - 1); s->slots[i].abbreviation; i = (i + 1) & (s->slots_size - 1))
+		if (s->slots[i].abbreviation == a)
+			return &s->slots[i];
+
+	++s->slots_used;
+	s->slots[i].abbreviation = a;
+	return &s->slots[i];
+}
+
+/* A type variable, or an arrow: 0 once the graph has TYPE_LIMIT */
+static int
+new_type(struct typing_state *s, int from, int to)
+{
+	struct type *t;
+
+	if (s->type_count >= TYPE_LIMIT)
+	{
+		s->overflow = 1;
+		return 0;
+	}
+	if (s->type_count == s->types_size)
+	{
+		s->types_size = s->types_size? 2*s->types_size: 1024;
+		s->types = realloc(s->types, s->types_size*sizeof(*s->types));
+	}
+
+	t = &s->types[s->type_count];
+	t->link = 0;
+	t->from = from;
+	t->to = to;
+	t->mark = 0;
+	t->copy = 0;
+
+	return s->type_count++;
+}
+
+static int
+find(struct typing_state *s, int t)
+{
+	while (s->types[t].link)
+	{
+		int next = s->types[t].link;
+		if (s->types[next].link)
+			s->types[t].link = s->types[next].link;
+		t = next;
+	}
+	return t;
+}
+
+static void
+push_work(struct typing_state *s, size_t *n, int t)
+{
+	if (*n == s->work_size)
+	{
+		s->work_size = s->work_size? 2*s->work_size: 1024;
+		s->work = realloc(s->work, s->work_size*sizeof(*s->work));
+	}
+	s->work[(*n)++] = t;
+}
+
+/* Merging two arrows before unifying their parts means unification
+ * stops even on a graph with cycles in it. */
+static void
+unify(struct typing_state *s, int a, int b)
+{
+	size_t n = 0;
+
+	push_work(s, &n, a);
+	push_work(s, &n, b);
+
+	while (n)
+	{
+		b = find(s, s->work[--n]);
+		a = find(s, s->work[--n]);
+
+		if (a == b)
+			continue;
+		if (!s->types[a].from)
+			s->types[a].link = b;
+		else if (!s->types[b].from)
+			s->types[b].link = a;
+		else {
+			s->types[a].link = b;
+			push_work(s, &n, s->types[a].from);
+			push_work(s, &n, s->types[b].from);
+			push_work(s, &n, s->types[a].to);
+			push_work(s, &n, s->types[b].to);
+		}
+	}
+}
+
+/* A copy of t with new type variables, sharing as t shares.  A
+ * negative entry on the work stack is an arrow whose copy needs its
+ * parts filled in, once they have copies. */
+static int
+instantiate(struct typing_state *s, int t)
+{
+	unsigned int walk = ++s->walk;
+	size_t n = 0;
+
+	push_work(s, &n, find(s, t));
+
+	while (n)
+	{
+		int u = s->work[--n];
+		int c;
+
+		if (u < 0)
+		{
+			u = -u;
+			c = s->types[u].copy;
+			s->types[c].from = s->types[find(s, s->types[u].from)].copy;
+			s->types[c].to = s->types[find(s, s->types[u].to)].copy;
+			continue;
+		}
+
+		u = find(s, u);
+		if (walk == s->types[u].mark)
+			continue;
+		if (0 == (c = new_type(s, 0, 0)))
+			return 0;
+		s->types[u].mark = walk;
+		s->types[u].copy = c;
+		if (s->types[u].from)
+		{
+			push_work(s, &n, -u);
+			push_work(s, &n, s->types[u].from);
+			push_work(s, &n, s->types[u].to);
+		}
+	}
+
+	return s->types[find(s, t)].copy;
+}
+
+/* Depth first search of the whole graph for a type that contains
+ * itself.  Arrows still under search have the mark gray. */
+static int
+acyclic(struct typing_state *s)
+{
+	unsigned int gray = ++s->walk;
+	unsigned int black = ++s->walk;
+	int i;
+
+	for (i = 1; i < s->type_count; ++i)
+	{
+		size_t n = 0;
+
+		push_work(s, &n, find(s, i));
+
+		while (n)
+		{
+			int u = s->work[--n];
+
+			if (u < 0)
+			{
+				s->types[-u].mark = black;
+				continue;
+			}
+			u = find(s, u);
+			if (black == s->types[u].mark)
+				continue;
+			if (gray == s->types[u].mark)
+				return 0;
+			if (!s->types[u].from)
+			{
+				s->types[u].mark = black;
+				continue;
+			}
+			s->types[u].mark = gray;
+			push_work(s, &n, -u);
+			push_work(s, &n, s->types[u].from);
+			push_work(s, &n, s->types[u].to);
+		}
+	}
+
+	return 1;
+}
+
+/* Type of term in *type.  A variable bound by no abstraction gets the
+ * same type everywhere it appears.  An abbreviation that isn't closed
+ * gets typed where it appears, as if it were spelled out there. */
+static enum typing
+infer(struct typing_state *s, struct lambda_expression *term, int *type)
+{
+	size_t frames = 0, values = 0;
+	unsigned int i;
+
+	atom_slots(s);
+	for (i = 0; i < s->free_count; ++i)
+		s->free_type[s->typed_free[i]] = 0;
+	s->free_count = 0;
+	if (s->slots_used)
+		memset(s->slots, 0, s->slots_size*sizeof(*s->slots));
+	s->slots_used = 0;
+	s->type_count = 0;
+	s->overflow = 0;
+	(void)new_type(s, 0, 0);  /* index 0, no type */
+
+	if (!s->frames_size)
+	{
+		s->frames_size = 256;
+		s->frames = realloc(s->frames, s->frames_size*sizeof(*s->frames));
+	}
+	s->frames[frames].step = TYPE_TERM;
+	s->frames[frames++].node = term;
+
+	while (frames && !s->overflow)
+	{
+		struct type_frame f = s->frames[--frames];
+		struct lambda_expression *n = f.node;
+		struct abbreviation_slot *slot;
+		int t = 0, arrow;
+
+		/* an application or abstraction pushes 3 frames, at most */
+		if (frames + 3 > s->frames_size)
+		{
+			s->frames_size *= 2;
+			s->frames = realloc(s->frames, s->frames_size*sizeof(*s->frames));
+		}
+
+		switch (f.step)
+		{
+		case TYPE_TERM:
+			switch (n->typ)
+			{
+			case VARIABLE:
+				i = Atom_id(n->variable);
+				if (0 == (t = s->binding[i]))
+				{
+					if (0 == s->free_type[i])
+					{
+						s->free_type[i] = new_type(s, 0, 0);
+						s->typed_free[s->free_count++] = i;
+					}
+					t = s->free_type[i];
+				}
+				break;
+			case ABSTRACTION:
+				i = Atom_id(n->bound_variable);
+				s->frames[frames].step = TYPE_ABSTRACTED;
+				s->frames[frames].node = n;
+				s->frames[frames].type = new_type(s, 0, 0);
+				s->frames[frames].saved = s->binding[i];
+				s->binding[i] = s->frames[frames++].type;
+				s->frames[frames].step = TYPE_TERM;
+				s->frames[frames++].node = n->body;
+				continue;
+			case APPLICATION:
+				s->frames[frames].step = TYPE_APPLIED;
+				s->frames[frames++].node = n;
+				s->frames[frames].step = TYPE_TERM;
+				s->frames[frames++].node = n->rand;
+				s->frames[frames].step = TYPE_TERM;
+				s->frames[frames++].node = n->rator;
+				continue;
+			case ABBREVIATION:
+				slot = abbreviation_slot(s, n->abbreviation);
+				if (slot->type)
+				{
+					t = instantiate(s, slot->type);
+					break;
+				}
+				s->frames[frames].step = TYPE_EXPANDED;
+				s->frames[frames++].node = n;
+				s->frames[frames].step = TYPE_TERM;
+				s->frames[frames++].node = n->abbreviation->expression;
+				continue;
+			}
+			break;
+		case TYPE_APPLIED:
+			/* rator (rator (... rand)) needs rator to take
+			 * what it gives back: rator : rand -> rand */
+			t = s->values[--values];
+			if (n->repeat > 1)
+				arrow = new_type(s, t, t);
+			else {
+				int result = new_type(s, 0, 0);
+				arrow = new_type(s, t, result);
+				t = result;
+			}
+			if (!s->overflow)
+				unify(s, s->values[--values], arrow);
+			break;
+		case TYPE_ABSTRACTED:
+			s->binding[Atom_id(n->bound_variable)] = f.saved;
+			t = new_type(s, f.type, s->values[--values]);
+			break;
+		case TYPE_EXPANDED:
+			t = s->values[--values];
+			if (n->abbreviation->closed)
+			{
+				int generic = instantiate(s, t);
+				abbreviation_slot(s, n->abbreviation)->type = generic;
+			}
+			break;
+		}
+
+		if (values == s->values_size)
+		{
+			s->values_size = s->values_size? 2*s->values_size: 256;
+			s->values = realloc(s->values, s->values_size*sizeof(*s->values));
+		}
+		s->values[values++] = t;
+	}
+
+	/* Giving up part way leaves abstractions' bindings to undo */
+	while (frames--)
+		if (TYPE_ABSTRACTED == s->frames[frames].step)
+			s->binding[Atom_id(s->frames[frames].node->bound_variable)] = s->frames[frames].saved;
+
+	if (s->overflow)
+		return TYPE_UNKNOWN;
+	if (!acyclic(s))
+		return TYPE_NONE;
+
+	*type = s->values[0];
+	return TYPE_FOUND;
+}
+
+/* Type variables get named a, b, ... z, a1, b1 and so on, in order of
+ * appearance.  Arrows associate to the right, so only an arrow on the
+ * left of another needs parentheses, and only those recurse. */
+static void
+buffer_type(struct typing_state *s, int t, struct buffer *b, int *names)
+{
+	for (;;)
+	{
+		t = find(s, t);
+		if (!s->types[t].from)
+		{
+			char name[32];
+			int length;
+			if (s->walk != s->types[t].mark)
+			{
+				s->types[t].mark = s->walk;
+				s->types[t].copy = (*names)++;
+			}
+			if (s->types[t].copy < 26)
+				length = snprintf(name, sizeof(name), "%c", 'a' + s->types[t].copy);
+			else
+				length = snprintf(name, sizeof(name), "%c%d", 'a' + s->types[t].copy%26, s->types[t].copy/26);
+			buffer_append(b, name, length);
+			return;
+		}
+		if (s->types[find(s, s->types[t].from)].from)
+		{
+			buffer_append(b, "(", 1);
+			buffer_type(s, s->types[t].from, b, names);
+			buffer_append(b, ")", 1);
+		} else
+			buffer_type(s, s->types[t].from, b, names);
+		buffer_append(b, " -> ", 4);
+		t = s->types[t].to;
+	}
+}
+
+static void *
+allocate(struct machine *m, size_t size)
+{
+	void *r;
+
+	size = (size + 7) & ~(size_t)7;
+	if (!m->chunks || m->chunks->used + size > MACHINE_CHUNK)
+	{
+		struct chunk *c = malloc(sizeof(*c) + MACHINE_CHUNK);
+		c->next = m->chunks;
+		c->used = 0;
+		m->chunks = c;
+	}
+	r = (char *)(m->chunks + 1) + m->chunks->used;
+	m->chunks->used += size;
+
+	return r;
+}
+
+static struct thunk *
+new_thunk(struct machine *m, struct lambda_expression *term, struct env *env, long repeat)
+{
+	struct thunk *t = allocate(m, sizeof(*t));
+	t->term = term;
+	t->env = env;
+	t->repeat = repeat;
+	t->value = NULL;
+	return t;
+}
+
+static struct env *
+extend(struct machine *m, struct env *env, const char *name, struct thunk *thunk)
+{
+	struct env *r = allocate(m, sizeof(*r));
+	r->name = name;
+	r->thunk = thunk;
+	r->next = env;
+	return r;
+}
+
+static struct value *
+stuck(struct machine *m, int level, const char *name, struct spine *args)
+{
+	struct value *v = allocate(m, sizeof(*v));
+	v->abstraction = NULL;
+	v->env = NULL;
+	v->level = level;
+	v->name = name;
+	v->args = args;
+	return v;
+}
+
+static void
+push_frame(struct machine *m, size_t *n, int update, struct thunk *thunk)
+{
+	if (*n == m->frames_size)
+	{
+		m->frames_size = m->frames_size? 2*m->frames_size: 256;
+		m->frames = realloc(m->frames, m->frames_size*sizeof(*m->frames));
+	}
+	m->frames[*n].update = update;
+	m->frames[(*n)++].thunk = thunk;
+}
+
+/* Count a beta or eta step in steps, or stop the machine where
+ * normal order would stop, leaving normal order to stop there again. */
+static int
+step(struct machine *m, long *steps)
+{
+	struct reduction_state *rs = m->rs;
+	struct lc_context *ctx = m->ctx;
+
+	if ((rs->step_limit && rs->beta_steps + rs->eta_steps >= rs->step_limit)
+		|| ctx->interrupt_requested
+		|| (ctx->deadline && 0 == (rs->beta_steps & 63)
+			&& monotonic_seconds() >= ctx->deadline))
+	{
+		m->stopped = 1;
+		return 0;
+	}
+
+	++*steps;
+	return 1;
+}
+
+/* t's value: a closure, or stuck.  NULL if the machine stopped. */
+static struct value *
+whnf(struct machine *m, struct thunk *t)
+{
+	struct lambda_expression *n = t->term;
+	struct env *env = t->env;
+	long repeat = t->repeat;
+	struct value *v = t->value;
+	size_t frames = 0;
+
+	if (v)
+		return v;
+	push_frame(m, &frames, 1, t);
+
+	for (;;)
+	{
+		if (!v)
+		{
+			struct thunk *arg = NULL;
+			struct env *p;
+
+			switch (n->typ)
+			{
+			case APPLICATION:
+				if (!repeat)
+					repeat = n->repeat;
+				if (repeat > 1)
+					arg = new_thunk(m, n, env, repeat - 1);
+				else if (VARIABLE == n->rand->typ) {
+					/* no thunk of a thunk */
+					for (p = env; p && p->name != n->rand->variable; p = p->next)
+						;
+					arg = p? p->thunk: new_thunk(m, n->rand, env, 0);
+				} else
+					arg = new_thunk(m, n->rand, env, 0);
+				push_frame(m, &frames, 0, arg);
+				n = n->rator;
+				repeat = 0;
+				continue;
+			case ABSTRACTION:
+				v = allocate(m, sizeof(*v));
+				v->abstraction = n;
+				v->env = env;
+				break;
+			case VARIABLE:
+				for (p = env; p && p->name != n->variable; p = p->next)
+					;
+				if (!p)
+					v = stuck(m, -1, n->variable, NULL);
+				else
+					arg = p->thunk;
+				break;
+			case ABBREVIATION:
+				/* closed: one value, for every use of it */
+				if (!n->abbreviation->closed)
+				{
+					n = n->abbreviation->expression;
+					continue;
+				}
+				arg = abbreviation_slot(m->s, n->abbreviation)->thunk;
+				if (!arg)
+				{
+					arg = new_thunk(m, n->abbreviation->expression, NULL, 0);
+					abbreviation_slot(m->s, n->abbreviation)->thunk = arg;
+				}
+				break;
+			}
+
+			if (arg)
+			{
+				if (!(v = arg->value))
+				{
+					push_frame(m, &frames, 1, arg);
+					n = arg->term;
+					env = arg->env;
+					repeat = arg->repeat;
+					continue;
+				}
+			}
+		}
+
+		if (!frames)
+			return v;
+
+		t = m->frames[--frames].thunk;
+		if (m->frames[frames].update)
+		{
+			t->value = v;
+			t->term = NULL;
+			t->env = NULL;
+		} else if (v->abstraction) {
+			if (!step(m, &m->rs->beta_steps))
+				return NULL;
+			env = extend(m, v->env, v->abstraction->bound_variable, t);
+			n = v->abstraction->body;
+			repeat = 0;
+			v = NULL;
+		} else {
+			struct spine *args = allocate(m, sizeof(*args));
+			args->arg = t;
+			args->next = v->args;
+			v = stuck(m, v->level, v->name, args);
+		}
+	}
+}
+
+static void
+push_task(struct machine *m, size_t *n, struct thunk *thunk, struct lambda_expression **place, int depth, const char *name)
+{
+	if (*n == m->tasks_size)
+	{
+		m->tasks_size = m->tasks_size? 2*m->tasks_size: 256;
+		m->tasks = realloc(m->tasks, m->tasks_size*sizeof(*m->tasks));
+	}
+	m->tasks[*n].thunk = thunk;
+	m->tasks[*n].place = place;
+	m->tasks[*n].depth = depth;
+	m->tasks[(*n)++].name = name;
+}
+
+/* Would normal order take an eta step on abstraction, as it finds it
+ * in the source?  It looks before going into the body, so read_back()
+ * has to as well for the binders' names to come out the same. */
+static int
+eta_redex(struct lc_context *ctx, struct lambda_expression *abstraction)
+{
+	struct lambda_expression *body = abstraction->body;
+	struct lambda_expression *rand;
+	struct small_hashtable *free_vars, *bound_vars;
+	int r;
+
+	if (!ctx->eta_reduction || APPLICATION != body->typ || body->repeat)
+		return 0;
+	rand = abbreviation_definition(body->rand);
+	if (VARIABLE != rand->typ || rand->variable != abstraction->bound_variable)
+		return 0;
+
+	free_vars = init_small_hashtable(ctx, 16);
+	bound_vars = init_small_hashtable(ctx, 16);
+	find_free_vars(ctx, body->rator, bound_vars, free_vars);
+	r = (NULL == find_node(free_vars, abstraction->bound_variable));
+	free_small_hashtable(ctx, free_vars);
+	free_small_hashtable(ctx, bound_vars);
+
+	return r;
+}
+
+/* The beta normal form of root's value, less the eta redexes
+ * eta_redex() finds on the way, or NULL if the machine stopped.  Abstractions get their source's names, and variables
+ * they bind get none yet, only the binder's level in repeat, for
+ * name_binders() to settle once the whole term is in.  An
+ * abstraction's repeat holds where its closure went in closures. */
+static struct lambda_expression *
+read_back(struct machine *m, struct thunk *root)
+{
+	struct lc_context *ctx = m->ctx;
+	struct lambda_expression *r = NULL;
+	size_t n = 0;
+
+	push_task(m, &n, root, &r, 0, NULL);
+
+	while (n)
+	{
+		struct readback_task task = m->tasks[--n];
+		struct value *v;
+
+		if (ctx->node_limit && nodes_allocated(ctx) - nodes_freed(ctx) > ctx->node_limit)
+			m->stopped = 1;
+		if (m->stopped || NULL == (v = whnf(m, task.thunk)))
+		{
+			/* fill the holes, so as to free what got built */
+			const char *hole = Atom_string("_");
+			*task.place = new_variable(ctx, hole);
+			while (n--)
+				*m->tasks[n].place = new_variable(ctx, hole);
+			free_expression(ctx, r);
+			return NULL;
+		}
+
+		if (v->abstraction && eta_redex(ctx, v->abstraction))
+		{
+			/* stopping, this task comes round again to fill its hole */
+			struct thunk *rator = task.thunk;
+			if (step(m, &m->rs->eta_steps))
+				rator = new_thunk(m, v->abstraction->body->rator, v->env, 0);
+			push_task(m, &n, rator, task.place, task.depth, NULL);
+		} else if (v->abstraction) {
+			struct thunk *var = new_thunk(m, NULL, NULL, 0);
+			struct thunk *body;
+
+			var->repeat = -1;
+			var->value = stuck(m, task.depth, NULL, NULL);
+			body = new_thunk(m, v->abstraction->body,
+				extend(m, v->env, v->abstraction->bound_variable, var), 0);
+
+			if (m->closures_used == m->closures_size)
+			{
+				m->closures_size = m->closures_size? 2*m->closures_size: 64;
+				m->closures = realloc(m->closures, m->closures_size*sizeof(*m->closures));
+			}
+			*task.place = new_abstraction(ctx, v->abstraction->bound_variable, NULL);
+			(*task.place)->repeat = m->closures_used;
+			m->closures[m->closures_used++] = v;
+			push_task(m, &n, body, &(*task.place)->body, task.depth + 1, NULL);
+		} else {
+			struct lambda_expression **place = task.place;
+			struct spine *p;
+
+			/* the last argument's application is outermost */
+			for (p = v->args; p; p = p->next)
+			{
+				*place = new_application(ctx, NULL, NULL);
+				push_task(m, &n, p->arg, &(*place)->rand, task.depth, NULL);
+				place = &(*place)->rator;
+			}
+			*place = new_variable(ctx, v->level < 0? v->name: NULL);
+			(*place)->repeat = v->level < 0? 0: v->level;
+		}
+	}
+
+	return r;
+}
+
+/* Outermost abstraction first, so that the names of the abstractions
+ * around one are settled when it gets its own. */
+static void
+name_binders(struct machine *m, struct lambda_expression **root)
+{
+	struct typing_state *s = m->s;
+	size_t n = 0;
+
+	push_task(m, &n, NULL, root, 0, NULL);
+
+	while (n)
+	{
+		struct readback_task task = m->tasks[--n];
+		struct lambda_expression *e;
+		struct value *closure;
+		const char *name;
+
+		if (task.name)
+		{
+			--s->in_scope[Atom_id(task.name)];
+			continue;
+		}
+
+		e = *task.place;
+		switch (e->typ)
+		{
+		case VARIABLE:
+			if (!e->variable)
+			{
+				e->variable = m->names[e->repeat];
+				e->repeat = 0;
+			}
+			break;
+		case APPLICATION:
+			push_task(m, &n, NULL, &e->rand, task.depth, NULL);
+			push_task(m, &n, NULL, &e->rator, task.depth, NULL);
+			break;
+		case ABSTRACTION:
+			closure = m->closures[e->repeat];
+			e->repeat = 0;
+			name = e->bound_variable;
+			if (s->in_scope[Atom_id(name)] || s->free_type[Atom_id(name)])
+				name = binder_name(m, e, closure, task.depth);
+			e->bound_variable = name;
+
+			if ((size_t)task.depth == m->names_size)
+			{
+				m->names_size = m->names_size? 2*m->names_size: 64;
+				m->names = realloc(m->names, m->names_size*sizeof(*m->names));
+			}
+			m->names[task.depth] = name;
+			++s->in_scope[Atom_id(name)];
+
+			push_task(m, &n, NULL, NULL, task.depth, name);
+			push_task(m, &n, NULL, &e->body, task.depth + 1, NULL);
+			break;
+		case ABBREVIATION:
+			break;
+		}
+	}
+}
+
+/* An abstraction keeps its source's name unless its body uses that
+ * name for some other variable, an enclosing abstraction's or a free
+ * one, that the abstraction would then capture.  Then it gets what
+ * find_nonfree_var() picks, as normal order's substitutions do, from
+ * the names of the variables free in the abstraction, and of those
+ * free in its source's body: the ones substituted for keep their
+ * own names, the ones read back take their abstraction's. */
+static const char *
+binder_name(struct machine *m, struct lambda_expression *abstraction, struct value *closure, int depth)
+{
+	struct lc_context *ctx = m->ctx;
+	const char *name = abstraction->bound_variable;
+	struct small_hashtable *used = init_small_hashtable(ctx, 16);
+	int captures = 0;
+	size_t n = 0;
+
+	(void)insert_value(ctx, used, name, name);
+
+	if (!m->walk_size)
+	{
+		m->walk_size = 256;
+		m->walk = malloc(m->walk_size*sizeof(*m->walk));
+	}
+	m->walk[n++] = abstraction->body;
+
+	while (n)
+	{
+		struct lambda_expression *e = m->walk[--n];
+		const char *used_name = NULL;
+
+		if (n + 2 > m->walk_size)
+		{
+			m->walk_size *= 2;
+			m->walk = realloc(m->walk, m->walk_size*sizeof(*m->walk));
+		}
+
+		switch (e->typ)
+		{
+		case VARIABLE:
+			if (e->variable)
+				used_name = e->variable;
+			else if (e->repeat < depth)
+				used_name = m->names[e->repeat];
+			break;
+		case APPLICATION:
+			m->walk[n++] = e->rand;
+			m->walk[n++] = e->rator;
+			break;
+		case ABSTRACTION:
+			m->walk[n++] = e->body;
+			break;
+		case ABBREVIATION:
+			break;
+		}
+
+		if (used_name)
+		{
+			if (used_name == name)
+				captures = 1;
+			(void)insert_value(ctx, used, used_name, used_name);
+		}
+	}
+
+	if (captures)
+	{
+		struct small_hashtable *bound = init_small_hashtable(ctx, 16);
+		struct small_hashtable *source = init_small_hashtable(ctx, 16);
+		int i;
+
+		find_free_vars(ctx, closure->abstraction->body, bound, source);
+		for (i = 0; i < source->count; ++i)
+		{
+			struct small_hashnode *chain = source->buckets[i]->next;
+			for (; chain; chain = chain->next)
+			{
+				const char *used_name = chain->key;
+				struct env *p;
+
+				if (!used_name)
+					continue;
+				for (p = closure->env; p && p->name != used_name; p = p->next)
+					;
+				if (p && -1 == p->thunk->repeat)
+					used_name = m->names[p->thunk->value->level];
+				(void)insert_value(ctx, used, used_name, used_name);
+			}
+		}
+		free_small_hashtable(ctx, source);
+		free_small_hashtable(ctx, bound);
+
+		name = find_nonfree_var(used);
+		atom_slots(m->s);
+	}
+	free_small_hashtable(ctx, used);
+
+	return name;
+}
@@ -0,0 +1,45 @@
+/*
+	Copyright (C) 2006-2011, Bruce Ediger
+
+    This file is part of lc.
+
+    lc is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    lc is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with lc; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+
+/* Simple types, for "type expression", and the fast path they open up
+ * for "typed on" and -T.  A term with a simple type is strongly
+ * normalizing: any order of reduction gets to its normal form, so
+ * normal_order_reduction() can hand it to typed_normal_form(), which
+ * evaluates it by need in an environment machine, without substituting.
+ * Abbreviations get typed as if let-bound: a closed one's type gets
+ * worked out once and copied afresh for every use of it.
+ */
+
+/* TYPE_UNKNOWN: inference gave up, having made too many types */
+enum typing { TYPE_FOUND, TYPE_NONE, TYPE_UNKNOWN };
+
+/* With TYPE_FOUND, and text not NULL, the type, as in
+ * "(a -> b) -> a -> b", goes on the end of text. */
+enum typing type_of(struct lc_context *ctx, struct lambda_expression *term, struct buffer *text);
+
+/* A beta normal form of term, which it frees, with the machine's beta
+ * steps added to rs.  NULL if term has no type, or if rs's step limit,
+ * the session's node limit or deadline, or an interrupt stop the
+ * machine short.  Then term and rs are as they were. */
+struct lambda_expression *typed_normal_form(struct lc_context *ctx, struct lambda_expression *term, struct reduction_state *rs);
+
+void free_typing_state(struct lc_context *ctx);
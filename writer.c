@@ -0,0 +1,216 @@
+/*
+	Copyright (C) 2006-2011, Bruce Ediger
+
+    This file is part of lc.
+
+    lc is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    lc is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with lc; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>   /* malloc(), calloc(), free() */
+#include <string.h>   /* strcpy(), strerror() */
+#include <errno.h>
+#include <signal.h>   /* sig_atomic_t */
+#include <pthread.h>
+
+#include <context.h>
+#include <buffer.h>
+#include <writer.h>
+
+/* The session's thread waits when this many bytes are queued, so
+ * that a writer on a slow disk can't use up all of memory. */
+#define WRITER_MAX_QUEUED (64*1024*1024)
+
+enum writer_op { WRITER_OPEN, WRITER_WRITE, WRITER_CLOSE };
+
+struct writer_item {
+	enum writer_op op;
+	char *data;     /* file name for WRITER_OPEN */
+	int   length;
+	struct writer_item *next;
+};
+
+/* Each session that prints to files has its own queue and thread, so
+ * sessions running at once, as lc --serve and liblc.c allow, can't
+ * get each other's output.  Only the session's own thread starts or
+ * finishes its writer. */
+struct writer_state {
+	pthread_mutex_t lock;
+	pthread_cond_t  work;   /* item queued */
+	pthread_cond_t  room;   /* item done */
+	pthread_t thread;
+	int stopping;
+	long queued_bytes;
+	struct writer_item *head;
+	struct writer_item *tail;
+};
+
+static void *writer_main(void *arg);
+static void  queue_item(struct lc_context *ctx, enum writer_op op, char *data, int length);
+
+void
+writer_open(struct lc_context *ctx, const char *filename)
+{
+	char *name = malloc(strlen(filename) + 1);
+	strcpy(name, filename);
+	queue_item(ctx, WRITER_OPEN, name, 0);
+}
+
+void
+writer_write(struct lc_context *ctx, char *data, int length)
+{
+	queue_item(ctx, WRITER_WRITE, data, length);
+}
+
+void
+writer_close(struct lc_context *ctx)
+{
+	queue_item(ctx, WRITER_CLOSE, NULL, 0);
+}
+
+void
+writer_finish(struct lc_context *ctx)
+{
+	struct writer_state *w = ctx->writer;
+
+	if (!w)
+		return;
+
+	pthread_mutex_lock(&w->lock);
+	w->stopping = 1;
+	pthread_cond_signal(&w->work);
+	pthread_mutex_unlock(&w->lock);
+
+	pthread_join(w->thread, NULL);
+
+	pthread_cond_destroy(&w->room);
+	pthread_cond_destroy(&w->work);
+	pthread_mutex_destroy(&w->lock);
+	free(w);
+	ctx->writer = NULL;
+}
+
+/* sink is the session */
+void
+drain_to_writer(struct buffer *b)
+{
+	writer_write(b->sink, b->buffer, b->offset);
+	b->buffer = malloc(b->size);
+	b->buffer[0] = '\0';
+	b->offset = 0;
+}
+
+static void
+queue_item(struct lc_context *ctx, enum writer_op op, char *data, int length)
+{
+	struct writer_item *item = malloc(sizeof(*item));
+	struct writer_state *w = ctx->writer;
+
+	item->op = op;
+	item->data = data;
+	item->length = length;
+	item->next = NULL;
+
+	if (!w)
+	{
+		int e;
+
+		w = calloc(1, sizeof(*w));
+		pthread_mutex_init(&w->lock, NULL);
+		pthread_cond_init(&w->work, NULL);
+		pthread_cond_init(&w->room, NULL);
+		if (0 != (e = pthread_create(&w->thread, NULL, writer_main, w)))
+		{
+			fprintf(stderr, "Problem starting writer thread: %s\n", strerror(e));
+			exit(1);
+		}
+		ctx->writer = w;
+	}
+
+	pthread_mutex_lock(&w->lock);
+	while (w->queued_bytes > WRITER_MAX_QUEUED)
+		pthread_cond_wait(&w->room, &w->lock);
+	if (w->tail)
+		w->tail->next = item;
+	else
+		w->head = item;
+	w->tail = item;
+	w->queued_bytes += length;
+	pthread_cond_signal(&w->work);
+	pthread_mutex_unlock(&w->lock);
+}
+
+static void *
+writer_main(void *arg)
+{
+	struct writer_state *w = arg;
+	FILE *fp = NULL;
+	char *filename = NULL;
+
+	for (;;)
+	{
+		struct writer_item *item;
+
+		pthread_mutex_lock(&w->lock);
+		while (!w->head && !w->stopping)
+			pthread_cond_wait(&w->work, &w->lock);
+		item = w->head;
+		if (item)
+		{
+			w->head = item->next;
+			if (!w->head)
+				w->tail = NULL;
+		}
+		pthread_mutex_unlock(&w->lock);
+
+		if (!item)
+			break;
+
+		switch (item->op)
+		{
+		case WRITER_OPEN:
+			if (NULL == (fp = fopen(item->data, "w")))
+				fprintf(stderr, "Could not open \"%s\" for write: %s\n",
+					item->data, strerror(errno));
+			filename = item->data;
+			item->data = NULL;
+			break;
+		case WRITER_WRITE:
+			if (fp && (int)fwrite(item->data, 1, item->length, fp) != item->length)
+				fprintf(stderr, "Problem writing \"%s\": %s\n",
+					filename, strerror(errno));
+			break;
+		case WRITER_CLOSE:
+			if (fp && fclose(fp))
+				fprintf(stderr, "Problem writing \"%s\": %s\n",
+					filename, strerror(errno));
+			fp = NULL;
+			free(filename);
+			filename = NULL;
+			break;
+		}
+
+		pthread_mutex_lock(&w->lock);
+		w->queued_bytes -= item->length;
+		pthread_cond_signal(&w->room);
+		pthread_mutex_unlock(&w->lock);
+
+		free(item->data);
+		free(item);
+	}
+
+	return NULL;
+}
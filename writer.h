@@ -0,0 +1,37 @@
+/*
+	Copyright (C) 2006-2011, Bruce Ediger
+
+    This file is part of lc.
+
+    lc is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    lc is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with lc; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/* Files written by a separate thread, so that the next reduction
+ * can start while a big result is still going out.  Opening, writing
+ * and closing happen in the order they got queued, one file at a time.
+ * Each session gets its own thread, started by its first writer_open(),
+ * and ended by writer_finish() before free_context().
+ *
+ * Uses struct lc_context from context.h.
+ */
+void writer_open(struct lc_context *ctx, const char *filename);
+void writer_write(struct lc_context *ctx, char *data, int length);  /* takes over malloc'ed data */
+void writer_close(struct lc_context *ctx);
+void writer_finish(struct lc_context *ctx);  /* wait until everything queued is written */
+
+/* For a struct buffer's drain, with the session as its sink: hand
+ * the full chunk to the session's writer */
+void drain_to_writer(struct buffer *b);